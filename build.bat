@@ -18,7 +18,7 @@ call fxc /nologo /T vs_5_0 /E VertexMain /O3 /WX /Fh refterm_vs.h /Vn ReftermVSS
 set CFLAGS=/nologo /W3 /Z7 /GS- /Gs999999
 set LDFLAGS=/incremental:no /opt:icf /opt:ref
 
-set CLANGCompileFlags= -g -nostdlib -nostdlib++ -mno-stack-arg-probe -maes
+set CLANGCompileFlags= -g -nostdlib -nostdlib++ -mno-stack-arg-probe -maes -mpopcnt
 set CLANGLinkFlags=-fuse-ld=lld -Wl,-subsystem:windows
 
 set BASE_FILES=refterm.c refterm_example_dwrite.cpp
@@ -29,6 +29,8 @@ call cl -O2 -Ferefterm_release_msvc.exe %CFLAGS% %BASE_FILES% /link %LDFLAGS% /s
 call cl -O2 -Fesplat.exe %CFLAGS% splat.cpp /link %LDFLAGS% /subsystem:console
 call cl -O2 -Fesplat2.exe %CFLAGS% splat2.cpp /link %LDFLAGS% /subsystem:console
 
+call cl -O2 -Ferefterm_bench.exe %CFLAGS% refterm_bench.c refterm_example_dwrite.cpp /link %LDFLAGS% /subsystem:console
+
 where /q clang || (
   echo WARNING: "clang" not found - to run the fastest version of refterm, please install CLANG.
   exit /b 1
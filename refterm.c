@@ -21,6 +21,7 @@
 #include <intrin.h>
 
 #include "refterm.h"
+#include "fast_ring.h"
 
 #include "refterm_glyph_cache.h"
 #include "refterm_glyph_cache.c"
@@ -28,12 +29,22 @@
 #include "refterm_vs.h"
 #include "refterm_ps.h"
 #include "refterm_cs.h"
+#include "refterm_example_cold_store.h"
 #include "refterm_example_source_buffer.h"
+#include "refterm_example_trigram_index.h"
+#include "refterm_example_search.h"
+#include "refterm_example_telemetry.h"
+#include "refterm_example_recording.h"
 #include "refterm_example_dwrite.h"
 #include "refterm_example_d3d11.h"
 #include "refterm_example_glyph_generator.h"
 #include "refterm_example_terminal.h"
+#include "refterm_example_cold_store.c"
 #include "refterm_example_source_buffer.c"
+#include "refterm_example_trigram_index.c"
+#include "refterm_example_search.c"
+#include "refterm_example_telemetry.c"
+#include "refterm_example_recording.c"
 #include "refterm_example_glyph_generator.c"
 #include "refterm_example_d3d11.c"
 #include "refterm_example_terminal.c"
@@ -17,11 +17,49 @@ cbuffer ConstBuffer : register(b0)
     uint StrikeMax;
     uint UnderlineMin;
     uint UnderlineMax;
+
+    uint CompactCells;
+    uint BlankColor;
+    uint2 DispatchOrigin;
 };
 
 StructuredBuffer<TerminalCell> Cells : register(t0);
 Texture2D<float4> GlyphTexture : register(t1);
 
+// NOTE: The compact format is the glyph index, then a palette index with the foreground's flags on top
+StructuredBuffer<uint2> CompactCellBuffer : register(t2);
+StructuredBuffer<uint2> Palette : register(t3);
+
+// NOTE: Cells past the end of their row are never uploaded, and show as blank
+StructuredBuffer<uint> RowLengths : register(t4);
+
+TerminalCell LoadCell(uint2 CellIndex)
+{
+    uint Index = CellIndex.y * TermSize.x + CellIndex.x;
+
+    TerminalCell Result;
+    if(CellIndex.x >= RowLengths[CellIndex.y])
+    {
+        Result.GlyphIndex = 0;
+        Result.Foreground = BlankColor;
+        Result.Background = BlankColor;
+    }
+    else if(CompactCells)
+    {
+        uint2 Packed = CompactCellBuffer[Index];
+        uint2 Colors = Palette[Packed.y & 0xffffff];
+        Result.GlyphIndex = Packed.x;
+        Result.Foreground = Colors.x | (Packed.y & 0xff000000);
+        Result.Background = Colors.y;
+    }
+    else
+    {
+        Result = Cells[Index];
+    }
+
+    return Result;
+}
+
 float3 UnpackColor(uint Packed)
 {
     int R = Packed & 0xff;
@@ -49,7 +87,7 @@ float4 ComputeOutputColor(uint2 ScreenPos)
        (CellIndex.x < TermSize.x) &&
        (CellIndex.y < TermSize.y))
     {
-        TerminalCell Cell = Cells[CellIndex.y * TermSize.x + CellIndex.x];
+        TerminalCell Cell = LoadCell(CellIndex);
         uint2 GlyphPos = UnpackGlyphXY(Cell.GlyphIndex)*CellSize;
 
         uint2 PixelPos = GlyphPos + CellPos;
@@ -104,10 +142,10 @@ float4 PixelMain(float4 ScreenPos:SV_POSITION):SV_TARGET
 
 RWTexture2D<float4> Output : register(u0);
 
-// dispatch with (TermSize*CellSize+7)/8 groups for x,y and 1 for z
+// dispatch with (RectSize+7)/8 groups for x,y and 1 for z, once per damage rect
 [numthreads(8, 8, 1)]
 void ComputeMain(uint3 Id: SV_DispatchThreadID)
 {
-    uint2 ScreenPos = Id.xy;
+    uint2 ScreenPos = DispatchOrigin + Id.xy;
     Output[ScreenPos] = ComputeOutputColor(ScreenPos);
 }
@@ -0,0 +1,779 @@
+/* NOTE:
+
+   Microbenchmarks for refterm's hot functions, each run in isolation on fixed inputs that are
+   generated at startup, so runs on different builds are comparable.
+
+   Every case is warmed up first, then timed with __rdtsc over a number of samples.  Setup that
+   isn't part of what is being measured goes in the case's Prepare function, which runs before
+   each sample but outside the timing.  Results are TSC cycles per unit (bytes, lookups, cells,
+   etc.), reported as the minimum, the median, and the standard deviation as a percentage of
+   the mean.  The thread is pinned to one core and raised in priority while this runs.
+
+   refterm_bench [filter] [-samples N]
+
+   Only cases whose names contain filter are run.
+*/
+
+#define COBJMACROS
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <shlwapi.h>
+#include <d3d11_1.h>
+#include <dxgi1_3.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <intrin.h>
+#include <usp10.h>
+#include <strsafe.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "refterm.h"
+#include "fast_ring.h"
+
+#include "refterm_glyph_cache.h"
+#include "refterm_glyph_cache.c"
+
+#include "refterm_vs.h"
+#include "refterm_ps.h"
+#include "refterm_cs.h"
+#include "refterm_example_cold_store.h"
+#include "refterm_example_source_buffer.h"
+#include "refterm_example_trigram_index.h"
+#include "refterm_example_search.h"
+#include "refterm_example_telemetry.h"
+#include "refterm_example_recording.h"
+#include "refterm_example_dwrite.h"
+#include "refterm_example_d3d11.h"
+#include "refterm_example_glyph_generator.h"
+#include "refterm_example_terminal.h"
+#include "refterm_example_cold_store.c"
+#include "refterm_example_source_buffer.c"
+#include "refterm_example_trigram_index.c"
+#include "refterm_example_search.c"
+#include "refterm_example_telemetry.c"
+#include "refterm_example_recording.c"
+#include "refterm_example_glyph_generator.c"
+#include "refterm_example_d3d11.c"
+#include "refterm_example_terminal.c"
+
+#pragma comment (lib, "kernel32")
+#pragma comment (lib, "user32")
+#pragma comment (lib, "gdi32")
+#pragma comment (lib, "usp10")
+#pragma comment (lib, "dwrite")
+#pragma comment (lib, "d2d1")
+#pragma comment (lib, "mincore")
+
+#define BENCH_MAX_SAMPLES 1024
+#define BENCH_HASH_COUNT 8192
+#define BENCH_LOOKUP_COUNT 1024
+#define BENCH_CORPUS_SIZE (1024*1024)
+#define BENCH_ROW_COUNT 64
+
+typedef struct bench_case bench_case;
+typedef void bench_function(bench_case *Case);
+struct bench_case
+{
+    char *Name;
+    char *UnitName;
+    size_t UnitCount;
+    bench_function *Prepare;
+    bench_function *Run;
+
+    example_terminal *Terminal;
+    source_buffer_range Input;
+    uint32_t Length;
+    int ContainsComplexChars;
+};
+
+typedef struct
+{
+    double Min;
+    double Median;
+    double DeviationPercent;
+} bench_result;
+
+// NOTE: Everything measured feeds this, so the compiler can't throw the work away
+static volatile uint32_t BenchSink;
+
+static glyph_table_params BenchTableParams = {4096, 2048, 1, 64};
+static void *BenchTableMemory;
+static glyph_table *BenchTable;
+static glyph_hash BenchHashes[BENCH_HASH_COUNT];
+static renderer_cell *BenchUploadCells;
+static uint32_t *BenchUploadRowLengths;
+static renderer_color_pair BenchPaletteColors[RENDERER_PALETTE_MAX];
+static renderer_const_buffer BenchConstants;
+static uint32_t BenchFrameIndex;
+
+static void PrepareNothing(bench_case *Case)
+{
+}
+
+static void BenchComputeGlyphHash(bench_case *Case)
+{
+    uint32_t Sink = 0;
+    for(uint32_t Index = 0; Index < 4096; ++Index)
+    {
+        glyph_hash Hash = ComputeGlyphHash(Case->Length, (char unsigned *)Case->Input.Data + (Index & 255), DefaultSeed);
+        Sink += _mm_cvtsi128_si32(Hash.Value);
+    }
+    BenchSink += Sink;
+}
+
+static void PrepareEmptyTable(bench_case *Case)
+{
+    BenchTable = PlaceGlyphTableInMemory(BenchTableParams, BenchTableMemory);
+}
+
+static void PrepareWarmTable(bench_case *Case)
+{
+    PrepareEmptyTable(Case);
+    for(uint32_t Index = 0; Index < BENCH_LOOKUP_COUNT; ++Index)
+    {
+        FindGlyphEntryByHash(BenchTable, BenchHashes[Index]);
+    }
+}
+
+static void PrepareFullTable(bench_case *Case)
+{
+    PrepareEmptyTable(Case);
+    for(uint32_t Index = 0; Index < BenchTableParams.EntryCount; ++Index)
+    {
+        FindGlyphEntryByHash(BenchTable, BenchHashes[Index]);
+    }
+}
+
+static void BenchFindGlyphHit(bench_case *Case)
+{
+    uint32_t Sink = 0;
+    for(uint32_t Index = 0; Index < 4*BENCH_LOOKUP_COUNT; ++Index)
+    {
+        Sink += FindGlyphEntryByHash(BenchTable, BenchHashes[Index % BENCH_LOOKUP_COUNT]).ID;
+    }
+    BenchSink += Sink;
+}
+
+static void BenchFindGlyphMiss(bench_case *Case)
+{
+    // NOTE: Fewer lookups than there are free entries, so nothing gets recycled
+    uint32_t Sink = 0;
+    for(uint32_t Index = 0; Index < BENCH_LOOKUP_COUNT; ++Index)
+    {
+        Sink += FindGlyphEntryByHash(BenchTable, BenchHashes[Index]).ID;
+    }
+    BenchSink += Sink;
+}
+
+static void BenchFindGlyphRecycle(bench_case *Case)
+{
+    // NOTE: The table is full of other hashes, so every lookup evicts one
+    uint32_t Sink = 0;
+    for(uint32_t Index = 0; Index < BenchTableParams.EntryCount; ++Index)
+    {
+        Sink += FindGlyphEntryByHash(BenchTable, BenchHashes[BENCH_HASH_COUNT - 1 - Index]).ID;
+    }
+    BenchSink += Sink;
+}
+
+static void PrepareParseLines(bench_case *Case)
+{
+    example_terminal *Terminal = Case->Terminal;
+    ClearCursor(Terminal, &Terminal->RunningCursor);
+    ResetLineIndex(&Terminal->Lines, Case->Input.AbsoluteP, Terminal->RunningCursor.Props);
+}
+
+static void BenchParseLines(bench_case *Case)
+{
+    example_terminal *Terminal = Case->Terminal;
+    ParseLines(Terminal, Case->Input, &Terminal->RunningCursor);
+    BenchSink += (uint32_t)Terminal->Lines.LineCount;
+}
+
+static void PrepareReflow(bench_case *Case)
+{
+    PrepareParseLines(Case);
+    BenchParseLines(Case);
+}
+
+static void BenchReflow(bench_case *Case)
+{
+    // NOTE: A drag-resize across 100 widths, finding the lines that fill the screen at each one.
+    // The screen buffer isn't reallocated, so this is the reflow alone.
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    uint32_t OldDimX = Buffer->DimX;
+
+    terminal_snapshot Snapshot = {0};
+    Snapshot.LineCount = Terminal->Lines.LineCount;
+    int64_t LastLineNumber = (int64_t)Snapshot.LineCount - 2;
+
+    size_t Sink = 0;
+    for(uint32_t Step = 0; Step < 100; ++Step)
+    {
+        int ShortOfRows = 0;
+        Buffer->DimX = 40 + 2*Step;
+        Sink += FindFirstVisibleLine(Terminal, &Snapshot, LastLineNumber, GetLayoutFloorLineNumber(Terminal, &Snapshot, 0), 1, &ShortOfRows);
+    }
+    BenchSink += (uint32_t)Sink;
+
+    Buffer->DimX = OldDimX;
+}
+
+static void BenchParseEscape(bench_case *Case)
+{
+    example_terminal *Terminal = Case->Terminal;
+    cursor_state Cursor;
+    ClearCursor(Terminal, &Cursor);
+
+    uint32_t Sink = 0;
+    source_buffer_range Range = Case->Input;
+    while(Range.Count)
+    {
+        Sink += ParseEscape(Terminal, &Range, &Cursor);
+    }
+    BenchSink += Sink + Cursor.Props.Foreground;
+}
+
+static void BenchParseLineIntoGlyphs(bench_case *Case)
+{
+    example_terminal *Terminal = Case->Terminal;
+    cursor_state Cursor;
+    ClearCursor(Terminal, &Cursor);
+
+    for(uint32_t Row = 0; Row < BENCH_ROW_COUNT; ++Row)
+    {
+        Cursor.At.X = 0;
+        Cursor.At.Y = Row;
+        ParseLineIntoGlyphs(Terminal, Case->Input, &Cursor, Case->ContainsComplexChars);
+    }
+    BenchSink += Terminal->ScreenBuffer.Cells[0].GlyphIndex;
+}
+
+static void BenchSetCellDirect(bench_case *Case)
+{
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    cursor_state Cursor;
+    ClearCursor(Terminal, &Cursor);
+
+    uint32_t CellCount = Buffer->DimX*Buffer->DimY;
+    for(uint32_t CellIndex = 0; CellIndex < CellCount; ++CellIndex)
+    {
+        gpu_glyph_index GPUIndex = Terminal->ReservedTileTable[CellIndex % ArrayCount(Terminal->ReservedTileTable)];
+        SetCellDirect(GPUIndex, Cursor.Props, Buffer->Cells + CellIndex);
+    }
+    BenchSink += Buffer->Cells[CellCount - 1].GlyphIndex;
+}
+
+static void BenchClearCellCount(bench_case *Case)
+{
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    ClearCellCount(Terminal, Buffer->DimX*Buffer->DimY, Buffer->Cells);
+    BenchSink += Buffer->Cells[0].Background;
+}
+
+static void PrepareFullRows(bench_case *Case)
+{
+    // NOTE: Every row in use all the way across, which is the most the upload ever has to copy
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    ClearCellCount(Terminal, Buffer->DimX*Buffer->DimY, Buffer->Cells);
+    for(uint32_t Y = 0; Y < Buffer->DimY; ++Y)
+    {
+        Buffer->RowLengths[Y] = Buffer->DimX;
+    }
+}
+
+static void BenchCopyCellsForUpload(bench_case *Case)
+{
+    // NOTE: Into ordinary memory, so this is the copy alone, without the write-combining
+    // a real mapped GPU buffer adds
+    terminal_buffer *Buffer = &Case->Terminal->ScreenBuffer;
+    BenchSink += CopyRowLengthsForUpload(BenchUploadRowLengths, Buffer);
+    CopyCellsForUpload(BenchUploadCells, Buffer, Case->Terminal->DefaultBackgroundColor);
+    BenchSink += BenchUploadCells[0].Foreground;
+}
+
+static void BenchResizeStorm(bench_case *Case)
+{
+    // NOTE: Sizes jump around the way they do when a window edge is dragged quickly, and the
+    // last one puts the buffer back the way the other cases expect it
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    uint32_t OldDimX = Buffer->DimX;
+    uint32_t OldDimY = Buffer->DimY;
+
+    for(uint32_t Step = 0; Step < 99; ++Step)
+    {
+        ResizeScreenBuffer(Terminal, 80 + (Step*53) % 160, 24 + (Step*29) % 40);
+    }
+    ResizeScreenBuffer(Terminal, OldDimX, OldDimY);
+
+    BenchSink += Buffer->Cells[0].Background;
+}
+
+static void PrepareColoredScreen(bench_case *Case)
+{
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    cursor_state Cursor;
+    ClearCursor(Terminal, &Cursor);
+
+    PrepareFullRows(Case);
+    for(uint32_t Row = 0; Row < Buffer->DimY; ++Row)
+    {
+        Cursor.At.X = 0;
+        Cursor.At.Y = Row;
+        ParseLineIntoGlyphs(Terminal, Case->Input, &Cursor, 0);
+    }
+}
+
+static void PrepareLogTail(bench_case *Case)
+{
+    // NOTE: A wide window tailing a log, where every row is short and the rest of it is blank.
+    // This leaves the screen at 480 columns, so these cases go last.
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    ResizeScreenBuffer(Terminal, 480, BENCH_ROW_COUNT);
+
+    cursor_state Cursor;
+    ClearCursor(Terminal, &Cursor);
+
+    Clear(Terminal, Buffer);
+    for(uint32_t Row = 0; Row < Buffer->DimY; ++Row)
+    {
+        Cursor.At.X = 0;
+        Cursor.At.Y = Row;
+        ParseLineIntoGlyphs(Terminal, Case->Input, &Cursor, 0);
+    }
+}
+
+static void BenchLayoutLogTail(bench_case *Case)
+{
+    // NOTE: What layout does to the screen for each frame of a log tail, without the scrollback walk
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    cursor_state Cursor;
+    ClearCursor(Terminal, &Cursor);
+
+    Clear(Terminal, Buffer);
+    for(uint32_t Row = 0; Row < Buffer->DimY; ++Row)
+    {
+        Cursor.At.X = 0;
+        Cursor.At.Y = Row;
+        ParseLineIntoGlyphs(Terminal, Case->Input, &Cursor, 0);
+    }
+    BenchSink += Buffer->RowLengths[0];
+}
+
+static void BenchPackCompactCells(bench_case *Case)
+{
+    // NOTE: Like CopyCellsForUpload, into ordinary memory
+    terminal_buffer *Buffer = &Case->Terminal->ScreenBuffer;
+    renderer_palette *Palette = Case->Terminal->Renderer.Palette;
+    BenchSink += PackCompactCells(Palette, (renderer_compact_cell *)BenchUploadCells, BenchPaletteColors, Buffer);
+    BenchSink += Palette->Count;
+}
+
+static void PrepareDamage(bench_case *Case)
+{
+    // NOTE: Starts from a frame that was just drawn, after one that damaged everything
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    d3d11_renderer *Renderer = &Terminal->Renderer;
+
+    renderer_const_buffer Constants =
+    {
+        .CellSize = {Terminal->GlyphGen.FontWidth, Terminal->GlyphGen.FontHeight},
+        .TermSize = {Buffer->DimX, Buffer->DimY},
+        .TopLeftMargin = {8, 8},
+        .BlinkModulate = 0xffffffff,
+    };
+    BenchConstants = Constants;
+
+    Renderer->Damage.Valid = 0;
+    UpdateDamage(Renderer, Buffer, &BenchConstants, Terminal->FontGeneration);
+    UpdateDamage(Renderer, Buffer, &BenchConstants, Terminal->FontGeneration);
+    BenchFrameIndex = 0;
+}
+
+static void PrepareTypingDamage(bench_case *Case)
+{
+    PrepareColoredScreen(Case);
+    PrepareDamage(Case);
+}
+
+static void PrepareLogTailDamage(bench_case *Case)
+{
+    PrepareLogTail(Case);
+    PrepareDamage(Case);
+}
+
+static void BenchTypingDamage(bench_case *Case)
+{
+    // NOTE: One character typed per frame, which should damage one cell
+    example_terminal *Terminal = Case->Terminal;
+    d3d11_renderer *Renderer = &Terminal->Renderer;
+    RECT Rects[2*RENDERER_MAX_DAMAGE_RECTS];
+    for(uint32_t Frame = 0; Frame < Case->UnitCount; ++Frame)
+    {
+        terminal_point Point = {(int32_t)(BenchFrameIndex++ % Terminal->ScreenBuffer.DimX), 10};
+        renderer_cell *Cell = GetCellsForWrite(Terminal, Point, 1, 0);
+        Cell->GlyphIndex = Terminal->ReservedTileTable[BenchFrameIndex % ArrayCount(Terminal->ReservedTileTable)].Value;
+
+        UpdateDamage(Renderer, &Terminal->ScreenBuffer, &BenchConstants, Terminal->FontGeneration);
+        BenchSink += GetComposeRects(&Renderer->Damage, Renderer->CurrentWidth, Renderer->CurrentHeight, Rects);
+    }
+}
+
+static void BenchLogTailDamage(bench_case *Case)
+{
+    // NOTE: The screen scrolls a line per frame, which damages every row
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    d3d11_renderer *Renderer = &Terminal->Renderer;
+    RECT Rects[2*RENDERER_MAX_DAMAGE_RECTS];
+    cursor_state Cursor;
+    ClearCursor(Terminal, &Cursor);
+    for(uint32_t Frame = 0; Frame < Case->UnitCount; ++Frame)
+    {
+        uint32_t Y = Buffer->FirstLineY;
+        Buffer->FirstLineY = (Buffer->FirstLineY + 1) % Buffer->DimY;
+        ClearLine(Terminal, Buffer, Y);
+
+        source_buffer_range Line = Case->Input;
+        Line.Data += (BenchFrameIndex++ * 7) % 10;
+        Cursor.At.X = 0;
+        Cursor.At.Y = Y;
+        ParseLineIntoGlyphs(Terminal, Line, &Cursor, 0);
+
+        UpdateDamage(Renderer, Buffer, &BenchConstants, Terminal->FontGeneration);
+        BenchSink += GetComposeRects(&Renderer->Damage, Renderer->CurrentWidth, Renderer->CurrentHeight, Rects);
+    }
+}
+
+static void PrepareBlinkDamage(bench_case *Case)
+{
+    // NOTE: The usual screen for a blink-only frame, where the only blinking cell is the cursor
+    example_terminal *Terminal = Case->Terminal;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    PrepareColoredScreen(Case);
+
+    Buffer->BlinkRunCount = 0;
+    Buffer->BlinkOverflow = 0;
+    terminal_point Point = {2, (int32_t)(Buffer->DimY - 1)};
+    renderer_cell *Cell = GetCellsForWrite(Terminal, Point, 1, TerminalCell_Blinking);
+    Cell->Foreground |= (TerminalCell_Blinking << 24);
+
+    PrepareDamage(Case);
+}
+
+static void BenchBlinkDamage(bench_case *Case)
+{
+    example_terminal *Terminal = Case->Terminal;
+    d3d11_renderer *Renderer = &Terminal->Renderer;
+    RECT Rects[2*RENDERER_MAX_DAMAGE_RECTS];
+    for(uint32_t Frame = 0; Frame < Case->UnitCount; ++Frame)
+    {
+        AddBlinkDamage(Renderer, &Terminal->ScreenBuffer, (Frame & 1) ? 0xffffffff : 0xff222222);
+        BenchSink += GetComposeRects(&Renderer->Damage, Renderer->CurrentWidth, Renderer->CurrentHeight, Rects);
+    }
+}
+
+static source_buffer_range MakeRepeatedInput(char *Memory, size_t Size, char *Pattern, size_t PatternCount)
+{
+    source_buffer_range Result = {0};
+    Result.Data = Memory;
+
+    while((Result.Count + PatternCount) <= Size)
+    {
+        memcpy(Result.Data + Result.Count, Pattern, PatternCount);
+        Result.Count += PatternCount;
+    }
+
+    return Result;
+}
+
+static void SortSamples(double *Samples, uint32_t Count)
+{
+    for(uint32_t Outer = 1; Outer < Count; ++Outer)
+    {
+        double Value = Samples[Outer];
+        uint32_t Inner = Outer;
+        while(Inner && (Samples[Inner - 1] > Value))
+        {
+            Samples[Inner] = Samples[Inner - 1];
+            --Inner;
+        }
+        Samples[Inner] = Value;
+    }
+}
+
+static bench_result RunBenchCase(bench_case *Case, uint32_t SampleCount)
+{
+    bench_result Result = {0};
+
+    for(uint32_t Warmup = 0; Warmup < 3; ++Warmup)
+    {
+        Case->Prepare(Case);
+        Case->Run(Case);
+    }
+
+    double Samples[BENCH_MAX_SAMPLES];
+    double Sum = 0;
+    for(uint32_t SampleIndex = 0; SampleIndex < SampleCount; ++SampleIndex)
+    {
+        Case->Prepare(Case);
+
+        _mm_lfence();
+        uint64_t StartClock = __rdtsc();
+        Case->Run(Case);
+        _mm_lfence();
+        uint64_t EndClock = __rdtsc();
+
+        Samples[SampleIndex] = (double)(EndClock - StartClock) / (double)Case->UnitCount;
+        Sum += Samples[SampleIndex];
+    }
+
+    double Mean = Sum / SampleCount;
+    double Variance = 0;
+    for(uint32_t SampleIndex = 0; SampleIndex < SampleCount; ++SampleIndex)
+    {
+        double Delta = Samples[SampleIndex] - Mean;
+        Variance += Delta*Delta;
+    }
+    Variance /= SampleCount;
+
+    SortSamples(Samples, SampleCount);
+    Result.Min = Samples[0];
+    Result.Median = Samples[SampleCount / 2];
+    Result.DeviationPercent = (Mean > 0) ? (100.0*sqrt(Variance) / Mean) : 0;
+
+    return Result;
+}
+
+static example_terminal *CreateBenchTerminal(void)
+{
+    // NOTE: The glyph generator needs a renderer, and the renderer needs a window, but the
+    // window is never shown
+    WNDCLASSEXW WindowClass = {sizeof(WindowClass)};
+    WindowClass.lpfnWndProc = DefWindowProcW;
+    WindowClass.hInstance = GetModuleHandleW(0);
+    WindowClass.lpszClassName = L"reftermbenchclass";
+    RegisterClassExW(&WindowClass);
+    HWND Window = CreateWindowExW(0, WindowClass.lpszClassName, L"refterm_bench", WS_OVERLAPPEDWINDOW,
+                                  CW_USEDEFAULT, CW_USEDEFAULT, 1024, 768, 0, 0, WindowClass.hInstance, 0);
+
+    example_terminal *Terminal = VirtualAlloc(0, sizeof(example_terminal), MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+    Terminal->Window = Window;
+    Terminal->LineWrap = 1;
+    Terminal->DefaultForegroundColor = 0x00afafaf;
+    Terminal->DefaultBackgroundColor = 0x000c0c0c;
+
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+    Terminal->Telemetry.TicksPerSecond = Frequency.QuadPart;
+
+    Terminal->REFTERM_TEXTURE_WIDTH = 2048;
+    Terminal->REFTERM_TEXTURE_HEIGHT = 2048;
+    Terminal->TransferWidth = 1024;
+    Terminal->TransferHeight = 512;
+    Terminal->REFTERM_MAX_WIDTH = 1024;
+    Terminal->REFTERM_MAX_HEIGHT = 1024;
+
+    Terminal->Renderer = AcquireD3D11Renderer(Window, 0);
+    SetD3D11GlyphCacheDim(&Terminal->Renderer, Terminal->REFTERM_TEXTURE_WIDTH, Terminal->REFTERM_TEXTURE_HEIGHT);
+    SetD3D11GlyphTransferDim(&Terminal->Renderer, Terminal->TransferWidth, Terminal->TransferHeight);
+    Terminal->GlyphGen = AllocateGlyphGenerator(Terminal->TransferWidth, Terminal->TransferHeight, Terminal->Renderer.GlyphTransferSurface);
+
+    ScriptRecordDigitSubstitution(LOCALE_USER_DEFAULT, &Terminal->Partitioner.UniDigiSub);
+    ScriptApplyDigitSubstitution(&Terminal->Partitioner.UniDigiSub, &Terminal->Partitioner.UniControl, &Terminal->Partitioner.UniState);
+
+    ClearCursor(Terminal, &Terminal->RunningCursor);
+    Terminal->Lines = AllocateLineIndex(1024*1024);
+    AppendLine(&Terminal->Lines, 0, Terminal->RunningCursor.Props);
+    Terminal->ScreenBuffer = AllocateTerminalBuffer(Terminal->REFTERM_MAX_WIDTH, Terminal->REFTERM_MAX_HEIGHT);
+    ResizeTerminalBuffer(Terminal, &Terminal->ScreenBuffer, 240, BENCH_ROW_COUNT);
+
+    RevertToDefaultFont(Terminal);
+    RefreshFont(Terminal);
+
+    // NOTE: Damage is clipped to the window, so this stands in for one big enough to hold the screen
+    SetD3D11MaxCellCount(&Terminal->Renderer, Terminal->REFTERM_MAX_WIDTH*Terminal->REFTERM_MAX_HEIGHT);
+    SetD3D11MaxRowCount(&Terminal->Renderer, Terminal->REFTERM_MAX_HEIGHT);
+    Terminal->Renderer.CurrentWidth = 8192;
+    Terminal->Renderer.CurrentHeight = 8192;
+
+    return Terminal;
+}
+
+int main(int ArgCount, char **Args)
+{
+    char *Filter = "";
+    uint32_t SampleCount = 25;
+    for(int ArgIndex = 1; ArgIndex < ArgCount; ++ArgIndex)
+    {
+        if((strcmp(Args[ArgIndex], "-samples") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            SampleCount = atoi(Args[++ArgIndex]);
+            if(SampleCount < 1) SampleCount = 1;
+            if(SampleCount > BENCH_MAX_SAMPLES) SampleCount = BENCH_MAX_SAMPLES;
+        }
+        else
+        {
+            Filter = Args[ArgIndex];
+        }
+    }
+
+    // NOTE: One core, so the TSC and the caches stay the same for the whole run
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    DWORD_PTR Core = (SystemInfo.dwNumberOfProcessors > 2) ? 2 : 0;
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << Core);
+    SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+    example_terminal *Terminal = CreateBenchTerminal();
+    if(!Terminal->Renderer.Device || !Terminal->Renderer.Palette || !Terminal->GlyphTable)
+    {
+        fprintf(stderr, "Unable to create a renderer and glyph table to benchmark with.\n");
+        return 1;
+    }
+
+    BenchTableMemory = VirtualAlloc(0, GetGlyphTableFootprint(BenchTableParams), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    for(uint32_t Index = 0; Index < BENCH_HASH_COUNT; ++Index)
+    {
+        BenchHashes[Index] = ComputeGlyphHash(sizeof(Index), (char unsigned *)&Index, DefaultSeed);
+    }
+    BenchUploadCells = VirtualAlloc(0, Terminal->REFTERM_MAX_WIDTH*Terminal->REFTERM_MAX_HEIGHT*sizeof(renderer_cell),
+                                    MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    BenchUploadRowLengths = VirtualAlloc(0, Terminal->REFTERM_MAX_HEIGHT*sizeof(uint32_t), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+
+    //
+    // NOTE: Fixed inputs
+    //
+
+    char *Memory = VirtualAlloc(0, 8*BENCH_CORPUS_SIZE, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    char *At = Memory;
+
+    source_buffer_range HashInput = {0};
+    HashInput.Data = At;
+    HashInput.Count = 1024;
+    for(uint32_t Index = 0; Index < HashInput.Count; ++Index)
+    {
+        HashInput.Data[Index] = (char)(Index*7 + 13);
+    }
+    At += HashInput.Count;
+
+    char AsciiLine[82];
+    for(uint32_t Index = 0; Index < 80; ++Index)
+    {
+        AsciiLine[Index] = (char)(' ' + (Index % 95));
+    }
+    AsciiLine[80] = '\r';
+    AsciiLine[81] = '\n';
+    source_buffer_range AsciiCorpus = MakeRepeatedInput(At, BENCH_CORPUS_SIZE, AsciiLine, sizeof(AsciiLine));
+    At += BENCH_CORPUS_SIZE;
+
+    char SGRLine[] = "\x1b[38;2;255;128;0mcolored \x1b[1mbold\x1b[0m and \x1b[48;2;0;0;128mbackground\x1b[0m text\r\n";
+    source_buffer_range SGRCorpus = MakeRepeatedInput(At, BENCH_CORPUS_SIZE, SGRLine, sizeof(SGRLine) - 1);
+    At += BENCH_CORPUS_SIZE;
+
+    source_buffer_range UTF8Corpus = MakeRepeatedInput(At, BENCH_CORPUS_SIZE, OpeningMessage, sizeof(OpeningMessage));
+    At += BENCH_CORPUS_SIZE;
+
+    source_buffer_range LongLineCorpus = MakeRepeatedInput(At, BENCH_CORPUS_SIZE, AsciiLine, 80);
+    At += BENCH_CORPUS_SIZE;
+
+    // NOTE: Lines from empty to a few hundred columns, so they wrap differently at every width
+    source_buffer_range ReflowCorpus = {0};
+    ReflowCorpus.Data = At;
+    for(uint32_t LineIndex = 0; (ReflowCorpus.Count + 302) <= BENCH_CORPUS_SIZE; ++LineIndex)
+    {
+        uint32_t Length = (LineIndex*37) % 300;
+        memcpy(ReflowCorpus.Data + ReflowCorpus.Count, LongLineCorpus.Data, Length);
+        ReflowCorpus.Count += Length;
+        ReflowCorpus.Data[ReflowCorpus.Count++] = '\r';
+        ReflowCorpus.Data[ReflowCorpus.Count++] = '\n';
+    }
+    At += BENCH_CORPUS_SIZE;
+
+    char ResetSequence[] = "\x1b[0m";
+    char BoldSequence[] = "\x1b[1m";
+    char ColorSequence[] = "\x1b[38;2;255;128;0m";
+    char MoveSequence[] = "\x1b[12;40H";
+    source_buffer_range ResetInput = MakeRepeatedInput(At, 4096*(sizeof(ResetSequence) - 1), ResetSequence, sizeof(ResetSequence) - 1);
+    At += ResetInput.Count;
+    source_buffer_range BoldInput = MakeRepeatedInput(At, 4096*(sizeof(BoldSequence) - 1), BoldSequence, sizeof(BoldSequence) - 1);
+    At += BoldInput.Count;
+    source_buffer_range ColorInput = MakeRepeatedInput(At, 4096*(sizeof(ColorSequence) - 1), ColorSequence, sizeof(ColorSequence) - 1);
+    At += ColorInput.Count;
+    source_buffer_range MoveInput = MakeRepeatedInput(At, 4096*(sizeof(MoveSequence) - 1), MoveSequence, sizeof(MoveSequence) - 1);
+    At += MoveInput.Count;
+
+    source_buffer_range AsciiRow = AsciiCorpus;
+    AsciiRow.Count = 80;
+    source_buffer_range SGRRow = SGRCorpus;
+    SGRRow.Count = sizeof(SGRLine) - 3;
+    source_buffer_range ComplexRow = {0};
+    ComplexRow.Data = OpeningMessage;
+    ComplexRow.Count = sizeof(OpeningMessage) - 1;
+    source_buffer_range LogRow = AsciiCorpus;
+    LogRow.Count = 70;
+
+    uint32_t CellCount = Terminal->ScreenBuffer.DimX*Terminal->ScreenBuffer.DimY;
+    bench_case Cases[] =
+    {
+        {"ComputeGlyphHash/2", "byte", 4096*2, PrepareNothing, BenchComputeGlyphHash, Terminal, HashInput, 2},
+        {"ComputeGlyphHash/16", "byte", 4096*16, PrepareNothing, BenchComputeGlyphHash, Terminal, HashInput, 16},
+        {"ComputeGlyphHash/64", "byte", 4096*64, PrepareNothing, BenchComputeGlyphHash, Terminal, HashInput, 64},
+        {"ComputeGlyphHash/256", "byte", 4096*256, PrepareNothing, BenchComputeGlyphHash, Terminal, HashInput, 256},
+        {"FindGlyphEntryByHash/hit", "lookup", 4*BENCH_LOOKUP_COUNT, PrepareWarmTable, BenchFindGlyphHit, Terminal},
+        {"FindGlyphEntryByHash/miss", "lookup", BENCH_LOOKUP_COUNT, PrepareEmptyTable, BenchFindGlyphMiss, Terminal},
+        {"FindGlyphEntryByHash/recycle", "lookup", BenchTableParams.EntryCount, PrepareFullTable, BenchFindGlyphRecycle, Terminal},
+        {"ParseLines/ascii", "byte", AsciiCorpus.Count, PrepareParseLines, BenchParseLines, Terminal, AsciiCorpus},
+        {"ParseLines/sgr", "byte", SGRCorpus.Count, PrepareParseLines, BenchParseLines, Terminal, SGRCorpus},
+        {"ParseLines/utf8", "byte", UTF8Corpus.Count, PrepareParseLines, BenchParseLines, Terminal, UTF8Corpus},
+        {"ParseLines/longlines", "byte", LongLineCorpus.Count, PrepareParseLines, BenchParseLines, Terminal, LongLineCorpus},
+        {"Reflow/100widths", "resize", 100, PrepareReflow, BenchReflow, Terminal, ReflowCorpus},
+        {"ParseEscape/reset", "sequence", 4096, PrepareNothing, BenchParseEscape, Terminal, ResetInput},
+        {"ParseEscape/bold", "sequence", 4096, PrepareNothing, BenchParseEscape, Terminal, BoldInput},
+        {"ParseEscape/truecolor", "sequence", 4096, PrepareNothing, BenchParseEscape, Terminal, ColorInput},
+        {"ParseEscape/move", "sequence", 4096, PrepareNothing, BenchParseEscape, Terminal, MoveInput},
+        {"ParseLineIntoGlyphs/ascii", "byte", BENCH_ROW_COUNT*AsciiRow.Count, PrepareNothing, BenchParseLineIntoGlyphs, Terminal, AsciiRow, 0, 0},
+        {"ParseLineIntoGlyphs/complex", "byte", BENCH_ROW_COUNT*ComplexRow.Count, PrepareNothing, BenchParseLineIntoGlyphs, Terminal, ComplexRow, 0, 1},
+        {"SetCellDirect", "cell", CellCount, PrepareNothing, BenchSetCellDirect, Terminal},
+        {"ClearCellCount", "cell", CellCount, PrepareNothing, BenchClearCellCount, Terminal},
+        {"CopyCellsForUpload", "cell", CellCount, PrepareFullRows, BenchCopyCellsForUpload, Terminal},
+        {"PackCompactCells", "cell", CellCount, PrepareColoredScreen, BenchPackCompactCells, Terminal, SGRRow},
+        {"ResizeScreenBuffer/storm", "resize", 100, PrepareNothing, BenchResizeStorm, Terminal},
+        {"UpdateDamage/typing", "frame", 64, PrepareTypingDamage, BenchTypingDamage, Terminal, SGRRow},
+        {"AddBlinkDamage/cursor", "frame", 64, PrepareBlinkDamage, BenchBlinkDamage, Terminal, SGRRow},
+        {"Layout/logtail480", "cell", 480*BENCH_ROW_COUNT, PrepareLogTail, BenchLayoutLogTail, Terminal, LogRow},
+        {"CopyCellsForUpload/logtail480", "cell", 480*BENCH_ROW_COUNT, PrepareLogTail, BenchCopyCellsForUpload, Terminal, LogRow},
+        {"PackCompactCells/logtail480", "cell", 480*BENCH_ROW_COUNT, PrepareLogTail, BenchPackCompactCells, Terminal, LogRow},
+        {"UpdateDamage/logtail480", "frame", 64, PrepareLogTailDamage, BenchLogTailDamage, Terminal, LogRow},
+    };
+
+    printf("refterm v%u benchmarks, %u samples each, TSC cycles per unit\n\n", REFTERM_VERSION, SampleCount);
+    printf("%-32s %12s %12s %8s\n", "case", "min", "median", "stddev");
+    for(uint32_t CaseIndex = 0; CaseIndex < ArrayCount(Cases); ++CaseIndex)
+    {
+        bench_case *Case = Cases + CaseIndex;
+        if(strstr(Case->Name, Filter))
+        {
+            bench_result Result = RunBenchCase(Case, SampleCount);
+            printf("%-32s %12.2f %12.2f %7.1f%%  per %s\n", Case->Name, Result.Min, Result.Median,
+                   Result.DeviationPercent, Case->UnitName);
+        }
+    }
+
+    return 0;
+}
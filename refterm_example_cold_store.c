@@ -0,0 +1,354 @@
+/* NOTE: This is a small LZ4-style block codec - a token byte with the literal count in the high
+   nibble and the match length in the low nibble, 255-run length extensions, literals, then a
+   16-bit match offset.  Segments are never bigger than 64k, so offsets always fit.  It is not
+   byte-for-byte compatible with LZ4 and doesn't need to be, since nothing outside refterm ever
+   reads it.
+*/
+
+#define COLD_MIN_MATCH 4
+#define COLD_HASH_BITS 12
+#define COLD_TAIL_LITERALS 5
+#define COLD_MATCH_SEARCH_LIMIT 12
+
+static uint32_t ColdLoad32(char unsigned *At)
+{
+    uint32_t Result = *(uint32_t *)At;
+    return Result;
+}
+
+static char unsigned *ColdWriteLength(char unsigned *Out, size_t Length)
+{
+    while(Length >= 255)
+    {
+        *Out++ = 255;
+        Length -= 255;
+    }
+    *Out++ = (char unsigned)Length;
+
+    return Out;
+}
+
+static char unsigned *ColdWriteSequence(char unsigned *Out, char unsigned *OutEnd,
+                                        char unsigned *Literals, size_t LiteralCount,
+                                        size_t Offset, size_t MatchLength)
+{
+    // NOTE: Worst case size of this sequence, so the checks below never have to happen per byte
+    size_t MaxSize = 1 + (LiteralCount/255 + 1) + LiteralCount + 2 + (MatchLength/255 + 1);
+    if((size_t)(OutEnd - Out) < MaxSize)
+    {
+        return 0;
+    }
+
+    char unsigned *Token = Out++;
+    *Token = (char unsigned)(((LiteralCount < 15) ? LiteralCount : 15) << 4);
+    if(LiteralCount >= 15)
+    {
+        Out = ColdWriteLength(Out, LiteralCount - 15);
+    }
+
+    __movsb(Out, Literals, LiteralCount);
+    Out += LiteralCount;
+
+    if(MatchLength)
+    {
+        Assert((Offset > 0) && (Offset <= 0xffff));
+        *Out++ = (char unsigned)(Offset & 0xff);
+        *Out++ = (char unsigned)(Offset >> 8);
+
+        size_t MatchCode = MatchLength - COLD_MIN_MATCH;
+        *Token |= (char unsigned)((MatchCode < 15) ? MatchCode : 15);
+        if(MatchCode >= 15)
+        {
+            Out = ColdWriteLength(Out, MatchCode - 15);
+        }
+    }
+
+    return Out;
+}
+
+static size_t ColdCompress(char unsigned *Source, size_t SourceSize,
+                           char unsigned *Dest, size_t DestSize, uint16_t *HashTable)
+{
+    // NOTE: Returns zero if the result wouldn't fit in DestSize
+    Assert(SourceSize <= 0x10000);
+
+    __stosb((unsigned char *)HashTable, 0, sizeof(uint16_t) << COLD_HASH_BITS);
+
+    char unsigned *At = Source;
+    char unsigned *Anchor = Source;
+    char unsigned *End = Source + SourceSize;
+    char unsigned *Out = Dest;
+    char unsigned *OutEnd = Dest + DestSize;
+
+    if(SourceSize > COLD_MATCH_SEARCH_LIMIT)
+    {
+        char unsigned *MatchLimit = End - COLD_MATCH_SEARCH_LIMIT;
+        char unsigned *MatchEnd = End - COLD_TAIL_LITERALS;
+        while(Out && (At < MatchLimit))
+        {
+            uint32_t Sequence = ColdLoad32(At);
+            uint32_t Hash = (Sequence*2654435761u) >> (32 - COLD_HASH_BITS);
+            char unsigned *Candidate = Source + HashTable[Hash];
+            HashTable[Hash] = (uint16_t)(At - Source);
+
+            if((Candidate < At) && (ColdLoad32(Candidate) == Sequence))
+            {
+                size_t MatchLength = COLD_MIN_MATCH;
+                while(((At + MatchLength) < MatchEnd) &&
+                      (Candidate[MatchLength] == At[MatchLength]))
+                {
+                    ++MatchLength;
+                }
+
+                Out = ColdWriteSequence(Out, OutEnd, Anchor, At - Anchor, At - Candidate, MatchLength);
+                At += MatchLength;
+                Anchor = At;
+            }
+            else
+            {
+                ++At;
+            }
+        }
+    }
+
+    if(Out)
+    {
+        Out = ColdWriteSequence(Out, OutEnd, Anchor, End - Anchor, 0, 0);
+    }
+
+    size_t Result = Out ? (size_t)(Out - Dest) : 0;
+    return Result;
+}
+
+static size_t ColdDecompress(char unsigned *Source, size_t SourceSize,
+                             char unsigned *Dest, size_t DestSize)
+{
+    // NOTE: The arena is only ever written by ColdCompress, but the bounds are checked anyway
+    // so a bad segment can only ever produce a short result, never a stray write.
+    char unsigned *In = Source;
+    char unsigned *InEnd = Source + SourceSize;
+    char unsigned *Out = Dest;
+    char unsigned *OutEnd = Dest + DestSize;
+
+    while(In < InEnd)
+    {
+        uint32_t Token = *In++;
+
+        size_t LiteralCount = Token >> 4;
+        if(LiteralCount == 15)
+        {
+            uint32_t Byte;
+            do
+            {
+                Byte = (In < InEnd) ? *In++ : 0;
+                LiteralCount += Byte;
+            } while(Byte == 255);
+        }
+
+        if((LiteralCount > (size_t)(InEnd - In)) ||
+           (LiteralCount > (size_t)(OutEnd - Out)))
+        {
+            break;
+        }
+
+        __movsb(Out, In, LiteralCount);
+        Out += LiteralCount;
+        In += LiteralCount;
+
+        if((InEnd - In) < 2)
+        {
+            break;
+        }
+
+        size_t Offset = In[0] | (In[1] << 8);
+        In += 2;
+
+        size_t MatchLength = Token & 15;
+        if(MatchLength == 15)
+        {
+            uint32_t Byte;
+            do
+            {
+                Byte = (In < InEnd) ? *In++ : 0;
+                MatchLength += Byte;
+            } while(Byte == 255);
+        }
+        MatchLength += COLD_MIN_MATCH;
+
+        if((Offset == 0) ||
+           (Offset > (size_t)(Out - Dest)) ||
+           (MatchLength > (size_t)(OutEnd - Out)))
+        {
+            break;
+        }
+
+        char unsigned *Match = Out - Offset;
+        if(Offset >= MatchLength)
+        {
+            __movsb(Out, Match, MatchLength);
+            Out += MatchLength;
+        }
+        else
+        {
+            // NOTE: Overlapping matches are how runs get encoded, so they have to go a byte at a time
+            while(MatchLength--)
+            {
+                *Out++ = *Match++;
+            }
+        }
+    }
+
+    size_t Result = Out - Dest;
+    return Result;
+}
+
+static cold_store AllocateColdStore(size_t SegmentSize, size_t ArenaSize, size_t MaxSegmentCount)
+{
+    cold_store Result = {0};
+
+    Assert(IsPowerOfTwo(MaxSegmentCount));
+    Assert(SegmentSize <= 0x10000);
+
+    // NOTE: The arena is only reserved here - it gets committed as segments are archived, so
+    // nothing is paid for until output actually scrolls out of the hot ring.
+    size_t FixedSize = (MaxSegmentCount*sizeof(cold_segment) +
+                        (sizeof(uint16_t) << COLD_HASH_BITS) +
+                        SegmentSize +    // NOTE: Compress buffer
+                        2*SegmentSize);  // NOTE: Decode buffer
+    char unsigned *Fixed = VirtualAlloc(0, FixedSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    char unsigned *Arena = VirtualAlloc(0, ArenaSize, MEM_RESERVE, PAGE_READWRITE);
+    if(Fixed && Arena)
+    {
+        Result.SegmentSize = SegmentSize;
+        Result.SegmentMask = MaxSegmentCount - 1;
+        Result.Segments = (cold_segment *)Fixed;
+        Fixed += MaxSegmentCount*sizeof(cold_segment);
+        Result.HashTable = (uint16_t *)Fixed;
+        Fixed += sizeof(uint16_t) << COLD_HASH_BITS;
+        Result.CompressBuffer = Fixed;
+        Fixed += SegmentSize;
+        Result.DecodeBuffer = Fixed;
+
+        Result.ArenaSize = ArenaSize;
+        Result.Arena = Arena;
+    }
+    else
+    {
+        if(Fixed) VirtualFree(Fixed, 0, MEM_RELEASE);
+        if(Arena) VirtualFree(Arena, 0, MEM_RELEASE);
+    }
+
+    return Result;
+}
+
+static int IsColdSegmentAvailable(cold_store *Store, size_t SegmentIndex)
+{
+    int Result = ((SegmentIndex >= Store->FirstSegment) &&
+                  (SegmentIndex < Store->SegmentCount));
+    return Result;
+}
+
+static void ArchiveColdSegment(cold_store *Store, char unsigned *Data)
+{
+    uint64_t StartClock = __rdtsc();
+
+    size_t SegmentSize = Store->SegmentSize;
+    char unsigned *Source = Data;
+    size_t CompressedSize = ColdCompress(Data, SegmentSize, Store->CompressBuffer, SegmentSize - 1, Store->HashTable);
+    if(CompressedSize)
+    {
+        Source = Store->CompressBuffer;
+    }
+    else
+    {
+        CompressedSize = SegmentSize;
+    }
+
+    // NOTE: Segments never straddle the end of the arena, so if this one doesn't fit, skip the rest
+    size_t RelativeP = Store->AbsoluteArenaP % Store->ArenaSize;
+    if((Store->ArenaSize - RelativeP) < CompressedSize)
+    {
+        Store->AbsoluteArenaP += Store->ArenaSize - RelativeP;
+        RelativeP = 0;
+    }
+
+    size_t OnePastLastP = RelativeP + CompressedSize;
+    if(OnePastLastP > Store->ArenaCommitted)
+    {
+        size_t CommitStep = 1024*1024;
+        size_t NewCommitted = (OnePastLastP + CommitStep - 1) & ~(CommitStep - 1);
+        if(NewCommitted > Store->ArenaSize) NewCommitted = Store->ArenaSize;
+        if(VirtualAlloc(Store->Arena + Store->ArenaCommitted, NewCommitted - Store->ArenaCommitted, MEM_COMMIT, PAGE_READWRITE))
+        {
+            Store->ArenaCommitted = NewCommitted;
+        }
+    }
+
+    if(OnePastLastP <= Store->ArenaCommitted)
+    {
+        // NOTE: Drop whichever old segments this one is about to overwrite
+        size_t NewArenaP = Store->AbsoluteArenaP + CompressedSize;
+        while((Store->FirstSegment < Store->SegmentCount) &&
+              ((Store->Segments[Store->FirstSegment & Store->SegmentMask].CompressedP + Store->ArenaSize) < NewArenaP))
+        {
+            ++Store->FirstSegment;
+        }
+        if((Store->SegmentCount - Store->FirstSegment) > Store->SegmentMask)
+        {
+            ++Store->FirstSegment;
+        }
+
+        if(Store->DecodedSegment &&
+           !IsColdSegmentAvailable(Store, Store->DecodedSegment - 1))
+        {
+            Store->DecodedSegment = 0;
+        }
+
+        __movsb(Store->Arena + RelativeP, Source, CompressedSize);
+
+        cold_segment *Segment = Store->Segments + (Store->SegmentCount & Store->SegmentMask);
+        Segment->CompressedP = Store->AbsoluteArenaP;
+        Segment->CompressedSize = (uint32_t)CompressedSize;
+        Store->AbsoluteArenaP = NewArenaP;
+
+        Store->RawBytes += SegmentSize;
+        Store->CompressedBytes += CompressedSize;
+    }
+    else
+    {
+        // NOTE: Out of memory for the arena, so this segment is just lost, like everything used to be.
+        // Everything before it has to go too, because segment positions are implicit.
+        Store->FirstSegment = Store->SegmentCount + 1;
+        Store->DecodedSegment = 0;
+    }
+
+    ++Store->SegmentCount;
+    Store->CompressCycles += __rdtsc() - StartClock;
+}
+
+static size_t DecodeColdSegment(cold_store *Store, size_t SegmentIndex, char unsigned *Dest)
+{
+    size_t Result = 0;
+
+    if(IsColdSegmentAvailable(Store, SegmentIndex))
+    {
+        uint64_t StartClock = __rdtsc();
+
+        cold_segment *Segment = Store->Segments + (SegmentIndex & Store->SegmentMask);
+        char unsigned *Source = Store->Arena + (Segment->CompressedP % Store->ArenaSize);
+        if(Segment->CompressedSize == Store->SegmentSize)
+        {
+            __movsb(Dest, Source, Store->SegmentSize);
+            Result = Store->SegmentSize;
+        }
+        else
+        {
+            Result = ColdDecompress(Source, Segment->CompressedSize, Dest, Store->SegmentSize);
+        }
+
+        ++Store->DecodeCount;
+        Store->DecodeCycles += __rdtsc() - StartClock;
+    }
+
+    return Result;
+}
@@ -0,0 +1,37 @@
+typedef struct
+{
+    size_t CompressedP;      // NOTE: Absolute position in the arena
+    uint32_t CompressedSize; // NOTE: Equal to SegmentSize when the segment didn't compress and was stored raw
+} cold_segment;
+
+typedef struct
+{
+    // NOTE: Segment N always holds scrollback bytes [N*SegmentSize, (N + 1)*SegmentSize), so
+    // segments are looked up by absolute position directly.  Both the segment descriptors and
+    // the compressed arena are circular, so the oldest segments fall off when either fills up.
+    size_t SegmentSize;
+    size_t SegmentMask;
+    cold_segment *Segments;
+    size_t FirstSegment;
+    size_t SegmentCount;
+
+    size_t ArenaSize;
+    size_t ArenaCommitted;
+    char unsigned *Arena;
+    size_t AbsoluteArenaP;
+
+    uint16_t *HashTable;
+    char unsigned *CompressBuffer;
+
+    // NOTE: Holds the segment being read from and the one after it, so anything that
+    // starts in a cold segment can be returned as one contiguous range.
+    char unsigned *DecodeBuffer;
+    size_t DecodedSegment; // NOTE: One past the segment index, so zero means nothing is decoded
+    size_t DecodedCount;
+
+    size_t RawBytes;
+    size_t CompressedBytes;
+    uint64_t CompressCycles;
+    size_t DecodeCount;
+    uint64_t DecodeCycles;
+} cold_store;
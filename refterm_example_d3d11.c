@@ -69,7 +69,7 @@ static IDXGISwapChain2 *AcquireDXGISwapChain(ID3D11Device *Device, HWND Window,
                 .SampleDesc = {1, 0},
                 .BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT,
                 .BufferCount = 2,
-                .SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD,
+                .SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL, // NOTE: Damage rects need the back buffers kept
                 .Scaling = DXGI_SCALING_NONE,
                 .AlphaMode = DXGI_ALPHA_MODE_IGNORE,
                 .Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT,
@@ -98,50 +98,82 @@ static IDXGISwapChain2 *AcquireDXGISwapChain(ID3D11Device *Device, HWND Window,
     return Result;
 }
 
-static void ReleaseD3DCellBuffer(d3d11_renderer *Renderer)
+static void ReleaseD3DStructuredBuffer(ID3D11Buffer **Buffer, ID3D11ShaderResourceView **View)
 {
-    if(Renderer->CellBuffer)
+    if(*Buffer)
     {
-        ID3D11Buffer_Release(Renderer->CellBuffer);
-        Renderer->CellBuffer = 0;
+        ID3D11Buffer_Release(*Buffer);
+        *Buffer = 0;
     }
 
-    if(Renderer->CellView)
+    if(*View)
     {
-        ID3D11ShaderResourceView_Release(Renderer->CellView);
-        Renderer->CellView = 0;
+        ID3D11ShaderResourceView_Release(*View);
+        *View = 0;
     }
 }
 
-static void SetD3D11MaxCellCount(d3d11_renderer *Renderer, uint32_t Count)
+static void ReleaseD3DCellBuffer(d3d11_renderer *Renderer)
 {
-    ReleaseD3DCellBuffer(Renderer);
+    ReleaseD3DStructuredBuffer(&Renderer->CellBuffer, &Renderer->CellView);
+    ReleaseD3DStructuredBuffer(&Renderer->CompactCellBuffer, &Renderer->CompactCellView);
+}
 
-    if(Renderer->Device)
+static void CreateD3DStructuredBuffer(d3d11_renderer *Renderer, uint32_t Count, uint32_t Stride,
+                                      ID3D11Buffer **Buffer, ID3D11ShaderResourceView **View)
+{
+    D3D11_BUFFER_DESC BufferDesc =
     {
-        D3D11_BUFFER_DESC CellBufferDesc =
+        .ByteWidth = Count * Stride,
+        .Usage = D3D11_USAGE_DYNAMIC,
+        .BindFlags = D3D11_BIND_SHADER_RESOURCE,
+        .CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+        .MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+        .StructureByteStride = Stride,
+    };
+
+    if(SUCCEEDED(ID3D11Device_CreateBuffer(Renderer->Device, &BufferDesc, 0, Buffer)))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC ViewDesc =
         {
-            .ByteWidth = Count * sizeof(renderer_cell),
-            .Usage = D3D11_USAGE_DYNAMIC,
-            .BindFlags = D3D11_BIND_SHADER_RESOURCE,
-            .CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
-            .MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
-            .StructureByteStride = sizeof(renderer_cell),
+            .ViewDimension = D3D11_SRV_DIMENSION_BUFFER,
+            .Buffer.FirstElement = 0,
+            .Buffer.NumElements = Count,
         };
 
-        if(SUCCEEDED(ID3D11Device_CreateBuffer(Renderer->Device, &CellBufferDesc, 0, &Renderer->CellBuffer)))
-        {
-            D3D11_SHADER_RESOURCE_VIEW_DESC CellViewDesc =
-            {
-                .ViewDimension = D3D11_SRV_DIMENSION_BUFFER,
-                .Buffer.FirstElement = 0,
-                .Buffer.NumElements = Count,
-            };
+        ID3D11Device_CreateShaderResourceView(Renderer->Device, (ID3D11Resource *)*Buffer, &ViewDesc, View);
+    }
+}
 
-            ID3D11Device_CreateShaderResourceView(Renderer->Device, (ID3D11Resource *)Renderer->CellBuffer, &CellViewDesc, &Renderer->CellView);
-        }
-        
+static void SetD3D11MaxCellCount(d3d11_renderer *Renderer, uint32_t Count)
+{
+    ReleaseD3DCellBuffer(Renderer);
+
+    if(Renderer->Device)
+    {
+        CreateD3DStructuredBuffer(Renderer, Count, sizeof(renderer_cell), &Renderer->CellBuffer, &Renderer->CellView);
+        CreateD3DStructuredBuffer(Renderer, Count, sizeof(renderer_compact_cell),
+                                  &Renderer->CompactCellBuffer, &Renderer->CompactCellView);
         Renderer->MaxCellCount = Count;
+
+        if(Renderer->Damage.Cells) VirtualFree(Renderer->Damage.Cells, 0, MEM_RELEASE);
+        Renderer->Damage.Cells = VirtualAlloc(0, Count*sizeof(renderer_cell), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+        Renderer->Damage.Valid = 0;
+    }
+}
+
+static void SetD3D11MaxRowCount(d3d11_renderer *Renderer, uint32_t Count)
+{
+    ReleaseD3DStructuredBuffer(&Renderer->RowLengthBuffer, &Renderer->RowLengthView);
+
+    if(Renderer->Device)
+    {
+        CreateD3DStructuredBuffer(Renderer, Count, sizeof(uint32_t), &Renderer->RowLengthBuffer, &Renderer->RowLengthView);
+        Renderer->MaxRowCount = Count;
+
+        if(Renderer->Damage.RowLengths) VirtualFree(Renderer->Damage.RowLengths, 0, MEM_RELEASE);
+        Renderer->Damage.RowLengths = VirtualAlloc(0, Count*sizeof(uint32_t), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+        Renderer->Damage.Valid = 0;
     }
 }
 
@@ -259,6 +291,8 @@ static void ReleaseD3D11Renderer(d3d11_renderer *Renderer)
     // Can you just release the main device and have all the sub-components release themselves?
 
     ReleaseD3DCellBuffer(Renderer);
+    ReleaseD3DStructuredBuffer(&Renderer->PaletteBuffer, &Renderer->PaletteView);
+    ReleaseD3DStructuredBuffer(&Renderer->RowLengthBuffer, &Renderer->RowLengthView);
     ReleaseD3DGlyphCache(Renderer);
     ReleaseD3DGlyphTransfer(Renderer);
     ReleaseD3D11RenderTargets(Renderer);
@@ -268,6 +302,7 @@ static void ReleaseD3D11Renderer(d3d11_renderer *Renderer)
     if(Renderer->VertexShader) ID3D11ComputeShader_Release(Renderer->VertexShader);
 
     if(Renderer->ConstantBuffer) ID3D11Buffer_Release(Renderer->ConstantBuffer);
+    if(Renderer->ScissorState) ID3D11RasterizerState_Release(Renderer->ScissorState);
 
     if(Renderer->RenderView) ID3D11UnorderedAccessView_Release(Renderer->RenderView);
     if(Renderer->SwapChain) IDXGISwapChain2_Release(Renderer->SwapChain);
@@ -276,6 +311,10 @@ static void ReleaseD3D11Renderer(d3d11_renderer *Renderer)
     if(Renderer->DeviceContext1) ID3D11DeviceContext1_Release(Renderer->DeviceContext1);
     if(Renderer->Device) ID3D11Device_Release(Renderer->Device);
 
+    if(Renderer->Palette) VirtualFree(Renderer->Palette, 0, MEM_RELEASE);
+    if(Renderer->Damage.Cells) VirtualFree(Renderer->Damage.Cells, 0, MEM_RELEASE);
+    if(Renderer->Damage.RowLengths) VirtualFree(Renderer->Damage.RowLengths, 0, MEM_RELEASE);
+
     d3d11_renderer ZeroRenderer = {0};
     *Renderer = ZeroRenderer;
 }
@@ -322,9 +361,22 @@ static d3d11_renderer AcquireD3D11Renderer(HWND Window, int EnableDebugging)
                 };
                 ID3D11Device_CreateBuffer(Result.Device, &ConstantBufferDesc, 0, &Result.ConstantBuffer);
 
+                D3D11_RASTERIZER_DESC ScissorDesc =
+                {
+                    .FillMode = D3D11_FILL_SOLID,
+                    .CullMode = D3D11_CULL_NONE,
+                    .DepthClipEnable = TRUE,
+                    .ScissorEnable = TRUE,
+                };
+                ID3D11Device_CreateRasterizerState(Result.Device, &ScissorDesc, &Result.ScissorState);
+
                 ID3D11Device_CreateComputeShader(Result.Device, ReftermCSShaderBytes, sizeof(ReftermCSShaderBytes), 0, &Result.ComputeShader);
                 ID3D11Device_CreatePixelShader(Result.Device, ReftermPSShaderBytes, sizeof(ReftermPSShaderBytes), 0, &Result.PixelShader);
                 ID3D11Device_CreateVertexShader(Result.Device, ReftermVSShaderBytes, sizeof(ReftermVSShaderBytes), 0, &Result.VertexShader);
+
+                CreateD3DStructuredBuffer(&Result, RENDERER_PALETTE_MAX, sizeof(renderer_color_pair),
+                                          &Result.PaletteBuffer, &Result.PaletteView);
+                Result.Palette = VirtualAlloc(0, sizeof(renderer_palette), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
             }
         }
     }
@@ -337,11 +389,323 @@ static d3d11_renderer AcquireD3D11Renderer(HWND Window, int EnableDebugging)
     return Result;
 }
 
-static void RendererDraw(example_terminal *Terminal, uint32_t Width, uint32_t Height, terminal_buffer *Term, uint32_t BlinkModulate)
+static uint32_t CopyRowLengthsForUpload(uint32_t *RowLengths, terminal_buffer *Term)
+{
+    // NOTE: The screen buffer is a ring of rows starting at FirstLineY, but the GPU wants them
+    // top to bottom.  Returns how many cells there are in use.
+    uint32_t Result = 0;
+    for(uint32_t Row = 0; Row < Term->DimY; ++Row)
+    {
+        uint32_t Length = Term->RowLengths[(Term->FirstLineY + Row) % Term->DimY];
+        RowLengths[Row] = Length;
+        Result += Length;
+    }
+
+    return Result;
+}
+
+static void CopyCellsForUpload(renderer_cell *Cells, terminal_buffer *Term, uint32_t BlankColor)
+{
+    // NOTE: Only the used part of each row goes up, at the same place in the row it would be
+    // if every cell did.  Shaders that look at the row lengths never read past them, so the rest
+    // of the row can be left as whatever the mapping had in it.  Older bytecode reads every cell,
+    // so for that the rest gets filled with the same blank the shader would draw.
+    renderer_cell Blank = {0, BlankColor, BlankColor};
+    for(uint32_t Row = 0; Row < Term->DimY; ++Row)
+    {
+        uint32_t Y = (Term->FirstLineY + Row) % Term->DimY;
+        uint32_t Length = Term->RowLengths[Y];
+        renderer_cell *Dest = Cells + Row*Term->DimX;
+        memcpy(Dest, Term->Cells + Y*Term->DimX, Length*sizeof(renderer_cell));
+        if(!RENDERER_SHADER_HEADERS_CURRENT)
+        {
+            for(uint32_t X = Length; X < Term->DimX; ++X)
+            {
+                Dest[X] = Blank;
+            }
+        }
+    }
+}
+
+static uint32_t GetPaletteIndex(renderer_palette *Palette, renderer_color_pair *Colors, uint64_t Key)
+{
+    // NOTE: Returns RENDERER_PALETTE_MAX if the pair is new and the palette is already full
+    uint32_t Result = RENDERER_PALETTE_MAX;
+
+    uint32_t SlotIndex = (uint32_t)((Key*0x9e3779b97f4a7c15ull) >> (64 - RENDERER_PALETTE_SLOT_SHIFT));
+    for(;;)
+    {
+        renderer_palette_slot *Slot = Palette->Slots + SlotIndex;
+        if(!Slot->IndexPlusOne)
+        {
+            if(Palette->Count < RENDERER_PALETTE_MAX)
+            {
+                Result = Palette->Count++;
+                Slot->Key = Key;
+                Slot->IndexPlusOne = Result + 1;
+                Palette->UsedSlots[Result] = SlotIndex;
+
+                renderer_color_pair Pair = {(uint32_t)Key, (uint32_t)(Key >> 32)};
+                Colors[Result] = Pair;
+            }
+            break;
+        }
+        else if(Slot->Key == Key)
+        {
+            Result = Slot->IndexPlusOne - 1;
+            break;
+        }
+
+        SlotIndex = (SlotIndex + 1) & (RENDERER_PALETTE_SLOT_COUNT - 1);
+    }
+
+    return Result;
+}
+
+static int PackCompactCellRun(renderer_palette *Palette, renderer_compact_cell *Dest, renderer_color_pair *Colors,
+                              renderer_cell *Source, uint32_t Count)
+{
+    // NOTE: Runs of cells in the same colors are the common case, so those skip the table
+    int Result = 1;
+
+    for(uint32_t CellIndex = 0; CellIndex < Count; ++CellIndex)
+    {
+        renderer_cell *Cell = Source + CellIndex;
+        uint64_t Key = ((uint64_t)Cell->Background << 32) | (Cell->Foreground & 0xffffff);
+        if(Key != Palette->LastKey)
+        {
+            Palette->LastIndex = GetPaletteIndex(Palette, Colors, Key);
+            Palette->LastKey = Key;
+            if(Palette->LastIndex == RENDERER_PALETTE_MAX)
+            {
+                Result = 0;
+                break;
+            }
+        }
+
+        Dest[CellIndex].GlyphIndex = Cell->GlyphIndex;
+        Dest[CellIndex].PaletteIndexAndFlags = Palette->LastIndex | (Cell->Foreground & 0xff000000);
+    }
+
+    return Result;
+}
+
+static int PackCompactCells(renderer_palette *Palette, renderer_compact_cell *Cells, renderer_color_pair *Colors, terminal_buffer *Term)
+{
+    // NOTE: The compact equivalent of CopyCellsForUpload, which fills in the palette as it goes.
+    // Returns 0 if the screen has too many color pairs for it, and then the frame has to be sent
+    // as full cells.  Blank cells past the end of a row don't need a palette entry.
+    for(uint32_t UsedIndex = 0; UsedIndex < Palette->Count; ++UsedIndex)
+    {
+        Palette->Slots[Palette->UsedSlots[UsedIndex]].IndexPlusOne = 0;
+    }
+    Palette->Count = 0;
+    Palette->LastKey = ~0ull; // NOTE: Can't be a real key, since only 24 bits of the foreground go in
+
+    int Result = 1;
+    for(uint32_t Row = 0; Result && (Row < Term->DimY); ++Row)
+    {
+        uint32_t Y = (Term->FirstLineY + Row) % Term->DimY;
+        Result = PackCompactCellRun(Palette, Cells + Row*Term->DimX, Colors, Term->Cells + Y*Term->DimX, Term->RowLengths[Y]);
+    }
+
+    return Result;
+}
+
+static int CellsDiffer(renderer_cell *A, renderer_cell *B)
+{
+    int Result = ((A->GlyphIndex != B->GlyphIndex) ||
+                  (A->Foreground != B->Foreground) ||
+                  (A->Background != B->Background));
+    return Result;
+}
+
+static void AddDamageRect(renderer_damage *Damage, RECT Rect)
+{
+    // NOTE: A rect for the row right under the last one grows it instead, and once there are no
+    // rects left, everything else goes into the last one
+    int Merged = 0;
+    if(Damage->RectCount)
+    {
+        RECT *Last = Damage->Rects + Damage->RectCount - 1;
+        if((Last->bottom == Rect.top) || (Damage->RectCount == RENDERER_MAX_DAMAGE_RECTS))
+        {
+            if(Last->left > Rect.left) Last->left = Rect.left;
+            if(Last->top > Rect.top) Last->top = Rect.top;
+            if(Last->right < Rect.right) Last->right = Rect.right;
+            if(Last->bottom < Rect.bottom) Last->bottom = Rect.bottom;
+            Merged = 1;
+        }
+    }
+
+    if(!Merged)
+    {
+        Damage->Rects[Damage->RectCount++] = Rect;
+    }
+}
+
+static void BeginDamage(renderer_damage *Damage)
+{
+    Damage->PreviousRectCount = Damage->RectCount;
+    Damage->PreviousFull = Damage->Full;
+    __movsb((unsigned char *)Damage->PreviousRects, (unsigned char *)Damage->Rects, sizeof(Damage->Rects));
+    Damage->RectCount = 0;
+    Damage->Full = 0;
+}
+
+static void AddCellDamage(d3d11_renderer *Renderer, uint32_t MinX, uint32_t MaxX, uint32_t Row)
+{
+    // NOTE: Cells MinX up to MaxX of a screen row, clipped to the window
+    renderer_const_buffer *Constants = &Renderer->Damage.Constants;
+    RECT Rect =
+    {
+        (LONG)(Constants->TopLeftMargin[0] + MinX*Constants->CellSize[0]),
+        (LONG)(Constants->TopLeftMargin[1] + Row*Constants->CellSize[1]),
+        (LONG)(Constants->TopLeftMargin[0] + MaxX*Constants->CellSize[0]),
+        (LONG)(Constants->TopLeftMargin[1] + (Row + 1)*Constants->CellSize[1]),
+    };
+    if(Rect.right > (LONG)Renderer->CurrentWidth) Rect.right = (LONG)Renderer->CurrentWidth;
+    if(Rect.bottom > (LONG)Renderer->CurrentHeight) Rect.bottom = (LONG)Renderer->CurrentHeight;
+    if((Rect.left < Rect.right) && (Rect.top < Rect.bottom))
+    {
+        AddDamageRect(&Renderer->Damage, Rect);
+    }
+}
+
+static void UpdateDamage(d3d11_renderer *Renderer, terminal_buffer *Term, renderer_const_buffer *Constants,
+                         uint32_t FontGeneration)
+{
+    // NOTE: Works out this frame's damage, and brings the copy of the screen up to date as it goes
+    renderer_damage *Damage = &Renderer->Damage;
+    BeginDamage(Damage);
+
+    // NOTE: Blinking is the only constant that changes on its own, and it only changes blinking cells
+    renderer_const_buffer Compare = *Constants;
+    Compare.BlinkModulate = Damage->Constants.BlinkModulate;
+    Compare.CompactCells = Damage->Constants.CompactCells;
+    int BlinkChanged = (Constants->BlinkModulate != Damage->Constants.BlinkModulate);
+
+    int Tracking = (Damage->Cells && Damage->RowLengths);
+    if(!Tracking || !Damage->Valid || Renderer->DisableDamageRects ||
+       (Damage->FontGeneration != FontGeneration) ||
+       memcmp(&Compare, &Damage->Constants, sizeof(Compare)))
+    {
+        Damage->Full = 1;
+        for(uint32_t Row = 0; Tracking && (Row < Term->DimY); ++Row)
+        {
+            Damage->RowLengths[Row] = 0;
+        }
+    }
+
+    Damage->Constants = *Constants;
+    Damage->FontGeneration = FontGeneration;
+    Damage->Valid = Tracking;
+
+    for(uint32_t Row = 0; Tracking && (Row < Term->DimY); ++Row)
+    {
+        uint32_t Y = (Term->FirstLineY + Row) % Term->DimY;
+        renderer_cell *Source = Term->Cells + Y*Term->DimX;
+        renderer_cell *Drawn = Damage->Cells + Row*Term->DimX;
+        uint32_t NewLength = Term->RowLengths[Y];
+        uint32_t OldLength = Damage->RowLengths[Row];
+        uint32_t SameLength = (NewLength < OldLength) ? NewLength : OldLength;
+
+        uint32_t MinX = SameLength;
+        uint32_t ChangedEnd = 0;
+        for(uint32_t X = 0; X < SameLength; ++X)
+        {
+            if(CellsDiffer(Source + X, Drawn + X) ||
+               (BlinkChanged && (Source[X].Foreground & RENDERER_FOREGROUND_BLINK)))
+            {
+                if(MinX > X) MinX = X;
+                ChangedEnd = X + 1;
+                Drawn[X] = Source[X];
+            }
+        }
+        __movsb((unsigned char *)(Drawn + SameLength), (unsigned char *)(Source + SameLength),
+                (NewLength - SameLength)*sizeof(renderer_cell));
+        Damage->RowLengths[Row] = NewLength;
+
+        // NOTE: Cells only one of the two lengths covers are damaged, since the other has a blank there
+        uint32_t MaxX = ChangedEnd;
+        if(NewLength != OldLength)
+        {
+            MaxX = (NewLength > OldLength) ? NewLength : OldLength;
+        }
+
+        if(!Damage->Full && (MinX < MaxX))
+        {
+            AddCellDamage(Renderer, MinX, MaxX, Row);
+        }
+    }
+}
+
+static int CanRecomposeBlinkOnly(d3d11_renderer *Renderer, terminal_buffer *Term)
+{
+    // NOTE: Whether what was uploaded last frame is still on the GPU and still matches the screen,
+    // and the blinking cells are all accounted for
+    renderer_damage *Damage = &Renderer->Damage;
+    int Result = (Damage->Valid && !Renderer->DisableDamageRects && !Term->BlinkOverflow &&
+                  (Damage->Constants.TermSize[0] == Term->DimX) &&
+                  (Damage->Constants.TermSize[1] == Term->DimY));
+    return Result;
+}
+
+static void AddBlinkDamage(d3d11_renderer *Renderer, terminal_buffer *Term, uint32_t BlinkModulate)
+{
+    // NOTE: The damage for a frame where only the blink phase changed, which is just the blinking cells
+    renderer_damage *Damage = &Renderer->Damage;
+    BeginDamage(Damage);
+
+    for(uint32_t RunIndex = 0; RunIndex < Term->BlinkRunCount; ++RunIndex)
+    {
+        blink_run *Run = Term->BlinkRuns + RunIndex;
+        uint32_t Row = (Run->Y + Term->DimY - Term->FirstLineY) % Term->DimY;
+        AddCellDamage(Renderer, Run->X, Run->X + Run->Count, Row);
+    }
+
+    Damage->Constants.BlinkModulate = BlinkModulate;
+}
+
+static uint32_t GetComposeRects(renderer_damage *Damage, uint32_t Width, uint32_t Height, RECT *Rects)
+{
+    // NOTE: This frame's damage and last frame's, since the back buffer is two frames old.
+    // Rects has to have room for twice RENDERER_MAX_DAMAGE_RECTS.
+    uint32_t Result = 0;
+    if(Damage->Full || Damage->PreviousFull)
+    {
+        RECT Window = {0, 0, (LONG)Width, (LONG)Height};
+        Rects[Result++] = Window;
+    }
+    else
+    {
+        for(uint32_t Index = 0; Index < Damage->RectCount; ++Index)
+        {
+            Rects[Result++] = Damage->Rects[Index];
+        }
+        for(uint32_t Index = 0; Index < Damage->PreviousRectCount; ++Index)
+        {
+            Rects[Result++] = Damage->PreviousRects[Index];
+        }
+    }
+
+    Damage->ComposedPixels = 0;
+    for(uint32_t Index = 0; Index < Result; ++Index)
+    {
+        Damage->ComposedPixels += (Rects[Index].right - Rects[Index].left)*(Rects[Index].bottom - Rects[Index].top);
+    }
+
+    return Result;
+}
+
+static void RendererDraw(example_terminal *Terminal, uint32_t Width, uint32_t Height, terminal_buffer *Term, uint32_t BlinkModulate,
+                         int BlinkOnly)
 {
     // TODO(casey): This should be split into two routines now, since we don't actually
     // need to resubmit anything if the terminal hasn't updated.
 
+    // NOTE: BlinkOnly means nothing has changed since the last frame but the blink phase
+
     glyph_table *Table = Terminal->GlyphTable;
     d3d11_renderer *Renderer = &Terminal->Renderer;
     glyph_generator *GlyphGen = &Terminal->GlyphGen;
@@ -391,6 +755,7 @@ static void RendererDraw(example_terminal *Terminal, uint32_t Width, uint32_t He
 
         Renderer->CurrentWidth = Width;
         Renderer->CurrentHeight = Height;
+        Renderer->Damage.Valid = 0;
     }
 
     uint32_t CellCount = Term->DimX*Term->DimY;
@@ -398,70 +763,172 @@ static void RendererDraw(example_terminal *Terminal, uint32_t Width, uint32_t He
     {
         SetD3D11MaxCellCount(Renderer, CellCount);
     }
+    if(Renderer->MaxRowCount < Term->DimY)
+    {
+        SetD3D11MaxRowCount(Renderer, Term->DimY);
+    }
         
+    telemetry_frame *Frame = &Terminal->Telemetry.Current;
+    DXGI_PRESENT_PARAMETERS PresentParams = {0};
     if(Renderer->RenderView || Renderer->RenderTarget)
     {
+        Frame->UploadStartTicks = GetTelemetryTicks();
+
         D3D11_MAPPED_SUBRESOURCE Mapped;
-        hr = ID3D11DeviceContext_Map(Renderer->DeviceContext, (ID3D11Resource*)Renderer->ConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Mapped);
-        AssertHR(hr);
+        renderer_const_buffer ConstData;
+        if(BlinkOnly && CanRecomposeBlinkOnly(Renderer, Term))
         {
-            renderer_const_buffer ConstData =
+            // NOTE: The cells on the GPU are still what is on screen, so only the blink phase goes up
+            AddBlinkDamage(Renderer, Term, BlinkModulate);
+            ConstData = Renderer->Damage.Constants;
+        }
+        else
+        {
+            renderer_const_buffer Constants =
             {
                 .CellSize = { GlyphGen->FontWidth, GlyphGen->FontHeight },
                 .TermSize = { Term->DimX, Term->DimY },
                 .TopLeftMargin = {8, 8},
                 .BlinkModulate = BlinkModulate,
                 .MarginColor = 0x000c0c0c,
-                
+
                 .StrikeMin = GlyphGen->FontHeight/2 - GlyphGen->FontHeight/10,
                 .StrikeMax = GlyphGen->FontHeight/2 + GlyphGen->FontHeight/10,
                 .UnderlineMin = GlyphGen->FontHeight - GlyphGen->FontHeight/5,
                 .UnderlineMax = GlyphGen->FontHeight,
+
+                .BlankColor = Terminal->DefaultBackgroundColor,
             };
-            memcpy(Mapped.pData, &ConstData, sizeof(ConstData));
+
+            ConstData = Constants;
+            UpdateDamage(Renderer, Term, &ConstData, Terminal->FontGeneration);
+
+            hr = ID3D11DeviceContext_Map(Renderer->DeviceContext, (ID3D11Resource*)Renderer->RowLengthBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Mapped);
+            AssertHR(hr);
+            uint32_t UsedCellCount = CopyRowLengthsForUpload(Mapped.pData, Term);
+            ID3D11DeviceContext_Unmap(Renderer->DeviceContext, (ID3D11Resource*)Renderer->RowLengthBuffer, 0);
+
+            // NOTE: Cells go up before the constants, since whether they went up compact is one of them
+            int CompactCells = 0;
+            if(RENDERER_SHADER_HEADERS_CURRENT &&
+               Renderer->UseCompactCells && Renderer->Palette && Renderer->CompactCellBuffer && Renderer->PaletteBuffer)
+            {
+                D3D11_MAPPED_SUBRESOURCE MappedColors;
+                hr = ID3D11DeviceContext_Map(Renderer->DeviceContext, (ID3D11Resource*)Renderer->PaletteBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedColors);
+                AssertHR(hr);
+                hr = ID3D11DeviceContext_Map(Renderer->DeviceContext, (ID3D11Resource*)Renderer->CompactCellBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Mapped);
+                AssertHR(hr);
+                {
+                    CompactCells = PackCompactCells(Renderer->Palette, Mapped.pData, MappedColors.pData, Term);
+                }
+                ID3D11DeviceContext_Unmap(Renderer->DeviceContext, (ID3D11Resource*)Renderer->CompactCellBuffer, 0);
+                ID3D11DeviceContext_Unmap(Renderer->DeviceContext, (ID3D11Resource*)Renderer->PaletteBuffer, 0);
+
+                Frame->UploadBytes = (Term->DimY*sizeof(uint32_t) + UsedCellCount*sizeof(renderer_compact_cell) +
+                                      Renderer->Palette->Count*sizeof(renderer_color_pair));
+            }
+
+            if(!CompactCells)
+            {
+                hr = ID3D11DeviceContext_Map(Renderer->DeviceContext, (ID3D11Resource*)Renderer->CellBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Mapped);
+                AssertHR(hr);
+                {
+                    CopyCellsForUpload(Mapped.pData, Term, ConstData.BlankColor);
+                }
+                ID3D11DeviceContext_Unmap(Renderer->DeviceContext, (ID3D11Resource*)Renderer->CellBuffer, 0);
+
+                uint32_t UploadedCellCount = RENDERER_SHADER_HEADERS_CURRENT ? UsedCellCount : CellCount;
+                Frame->UploadBytes = Term->DimY*sizeof(uint32_t) + UploadedCellCount*sizeof(renderer_cell);
+            }
+
+            ConstData.CompactCells = CompactCells;
+            Renderer->Damage.Constants.CompactCells = CompactCells;
         }
-        ID3D11DeviceContext_Unmap(Renderer->DeviceContext, (ID3D11Resource*)Renderer->ConstantBuffer, 0);
 
-        hr = ID3D11DeviceContext_Map(Renderer->DeviceContext, (ID3D11Resource*)Renderer->CellBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Mapped);
+        hr = ID3D11DeviceContext_Map(Renderer->DeviceContext, (ID3D11Resource*)Renderer->ConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Mapped);
         AssertHR(hr);
         {
-            renderer_cell *Cells = Mapped.pData;
-
-            uint32_t TopCellCount = Term->DimX * (Term->DimY - Term->FirstLineY);
-            uint32_t BotCellCount = Term->DimX * (Term->FirstLineY);
-            Assert((TopCellCount + BotCellCount) == (Term->DimX * Term->DimY));
-            memcpy(Cells, Term->Cells + Term->FirstLineY*Term->DimX, TopCellCount*sizeof(renderer_cell));
-            memcpy(Cells + TopCellCount, Term->Cells, BotCellCount*sizeof(renderer_cell));
+            memcpy(Mapped.pData, &ConstData, sizeof(ConstData));
         }
-        ID3D11DeviceContext_Unmap(Renderer->DeviceContext, (ID3D11Resource*)Renderer->CellBuffer, 0);
+        ID3D11DeviceContext_Unmap(Renderer->DeviceContext, (ID3D11Resource*)Renderer->ConstantBuffer, 0);
+
+        Frame->DrawStartTicks = GetTelemetryTicks();
+        Frame->UploadTicks = Frame->DrawStartTicks - Frame->UploadStartTicks;
 
-        // this should match t0/t1 order in hlsl shader
-        ID3D11ShaderResourceView* Resources[] = { Renderer->CellView, Renderer->GlyphTextureView };
+        // this should match t0-t4 order in hlsl shader
+        ID3D11ShaderResourceView* Resources[] = { Renderer->CellView, Renderer->GlyphTextureView,
+                                                  Renderer->CompactCellView, Renderer->PaletteView,
+                                                  Renderer->RowLengthView };
+
+        RECT ComposeRects[2*RENDERER_MAX_DAMAGE_RECTS];
+        uint32_t ComposeRectCount = GetComposeRects(&Renderer->Damage, Renderer->CurrentWidth, Renderer->CurrentHeight, ComposeRects);
+        Frame->ComposedPixels = Renderer->Damage.ComposedPixels;
 
         if(Renderer->UseComputeShader)
         {
-            // this issues compute shader for window size, which in real terminal should match its size
+            // NOTE: One dispatch per rect, each starting its thread IDs at the rect's corner.  The
+            // groups round the rect up to 8 pixels, which is fine, since anything they spill onto is
+            // composed from this frame's cells like everything else.
             ID3D11DeviceContext_CSSetConstantBuffers(Renderer->DeviceContext, 0, 1, &Renderer->ConstantBuffer);
             ID3D11DeviceContext_CSSetShaderResources(Renderer->DeviceContext, 0, ARRAYSIZE(Resources), Resources);
             ID3D11DeviceContext_CSSetUnorderedAccessViews(Renderer->DeviceContext, 0, 1, &Renderer->RenderView, NULL);
             ID3D11DeviceContext_CSSetShader(Renderer->DeviceContext, Renderer->ComputeShader, 0, 0);
-            ID3D11DeviceContext_Dispatch(Renderer->DeviceContext, (Renderer->CurrentWidth + 7) / 8, (Renderer->CurrentHeight + 7) / 8, 1);
+            if(!RENDERER_SHADER_HEADERS_CURRENT)
+            {
+                // NOTE: Older bytecode ignores DispatchOrigin, so it can only compose the whole window
+                ComposeRects[0].left = ComposeRects[0].top = 0;
+                ComposeRects[0].right = (LONG)Renderer->CurrentWidth;
+                ComposeRects[0].bottom = (LONG)Renderer->CurrentHeight;
+                ComposeRectCount = 1;
+                Frame->ComposedPixels = Renderer->CurrentWidth*Renderer->CurrentHeight;
+            }
+            for(uint32_t RectIndex = 0; RectIndex < ComposeRectCount; ++RectIndex)
+            {
+                RECT Rect = ComposeRects[RectIndex];
+                ConstData.DispatchOrigin[0] = Rect.left;
+                ConstData.DispatchOrigin[1] = Rect.top;
+                hr = ID3D11DeviceContext_Map(Renderer->DeviceContext, (ID3D11Resource*)Renderer->ConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Mapped);
+                AssertHR(hr);
+                {
+                    memcpy(Mapped.pData, &ConstData, sizeof(ConstData));
+                }
+                ID3D11DeviceContext_Unmap(Renderer->DeviceContext, (ID3D11Resource*)Renderer->ConstantBuffer, 0);
+
+                ID3D11DeviceContext_Dispatch(Renderer->DeviceContext, (Rect.right - Rect.left + 7) / 8, (Rect.bottom - Rect.top + 7) / 8, 1);
+            }
         }
         else
         {
             // NOTE(casey): This MUST be set every frame, because PAGE FLIPPING, I guess :/
             ID3D11DeviceContext_OMSetRenderTargets(Renderer->DeviceContext, 1, &Renderer->RenderTarget, 0);
 
+            ID3D11DeviceContext_RSSetState(Renderer->DeviceContext, Renderer->ScissorState);
             ID3D11DeviceContext_PSSetConstantBuffers(Renderer->DeviceContext, 0, 1, &Renderer->ConstantBuffer);
             ID3D11DeviceContext_PSSetShaderResources(Renderer->DeviceContext, 0, ARRAYSIZE(Resources), Resources);
             ID3D11DeviceContext_VSSetShader(Renderer->DeviceContext, Renderer->VertexShader, 0, 0);
             ID3D11DeviceContext_PSSetShader(Renderer->DeviceContext, Renderer->PixelShader, 0, 0);
-            ID3D11DeviceContext_Draw(Renderer->DeviceContext, 4, 0);
+            for(uint32_t RectIndex = 0; RectIndex < ComposeRectCount; ++RectIndex)
+            {
+                ID3D11DeviceContext_RSSetScissorRects(Renderer->DeviceContext, 1, ComposeRects + RectIndex);
+                ID3D11DeviceContext_Draw(Renderer->DeviceContext, 4, 0);
+            }
+        }
+
+        // NOTE: No dirty rects means the whole window, which is also what a frame where nothing
+        // changed gets, since it still has to present to keep the frame latency wait ticking
+        if(!Renderer->Damage.Full && Renderer->Damage.RectCount)
+        {
+            PresentParams.DirtyRectsCount = Renderer->Damage.RectCount;
+            PresentParams.pDirtyRects = Renderer->Damage.Rects;
         }
     }
 
     BOOL Vsync = FALSE;
-    hr = IDXGISwapChain1_Present(Renderer->SwapChain, Vsync ? 1 : 0, 0);
+    hr = IDXGISwapChain2_Present1(Renderer->SwapChain, Vsync ? 1 : 0, 0, &PresentParams);
+    if(Frame->DrawStartTicks)
+    {
+        Frame->DrawTicks = GetTelemetryTicks() - Frame->DrawStartTicks;
+    }
     if((hr == DXGI_ERROR_DEVICE_RESET) || (hr == DXGI_ERROR_DEVICE_REMOVED))
     {
         Assert(!"Device lost!");
@@ -472,8 +939,9 @@ static void RendererDraw(example_terminal *Terminal, uint32_t Width, uint32_t He
         AssertHR(hr);
     }
 
-    if(Renderer->RenderView)
+    if(Renderer->RenderView && Renderer->DisableDamageRects)
     {
+        // NOTE: Only when every frame is composed from scratch, since damage rects build on what is there
         ID3D11DeviceContext1_DiscardView(Renderer->DeviceContext1, (ID3D11View*)Renderer->RenderView);
     }
 }
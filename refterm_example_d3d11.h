@@ -1,3 +1,13 @@
+/* NOTE:
+
+   refterm_cs.h, refterm_ps.h and refterm_vs.h are compiled from refterm.hlsl by the fxc lines in
+   build.bat, but the checked-in ones predate compact cells (t2/t3), row lengths (t4) and
+   DispatchOrigin.  Until they are regenerated and checked in with this set to 1, the renderer
+   only feeds the shaders what that older bytecode reads, which the current refterm.hlsl
+   draws the same way.
+*/
+#define RENDERER_SHADER_HEADERS_CURRENT 0
+
 typedef struct
 {
     uint32_t CellSize[2];
@@ -9,9 +19,14 @@ typedef struct
     uint32_t StrikeMax;
     uint32_t UnderlineMin;
     uint32_t UnderlineMax;
+
+    uint32_t CompactCells;
+    uint32_t BlankColor; // NOTE: What cells past the end of their row show as
+    uint32_t DispatchOrigin[2]; // NOTE: Where the compute shader's thread IDs start on screen
 } renderer_const_buffer;
 
 #define RENDERER_CELL_BLINK 0x80000000
+#define RENDERER_FOREGROUND_BLINK 0x10000000 // NOTE: TerminalCell_Blinking, where SetCellDirect puts the flags
 typedef struct
 {
     uint32_t GlyphIndex;
@@ -19,6 +34,81 @@ typedef struct
     uint32_t Background; // NOTE(casey): The top bit of the background flag indicates blinking
 } renderer_cell;
 
+/* NOTE:
+
+   Compact cells are the optional 8-byte upload format.  Instead of the two colors, each cell
+   has an index into a palette of color pairs built fresh every frame, which is almost always
+   short, since most screens only use a handful of colors.  The flags from the top byte of
+   the foreground ride along on top of the palette index, so the shader can put the full
+   cell back together exactly.  A frame with more pairs than RENDERER_PALETTE_MAX just goes
+   up as full cells instead.
+*/
+#define RENDERER_PALETTE_SLOT_SHIFT 13
+#define RENDERER_PALETTE_SLOT_COUNT (1 << RENDERER_PALETTE_SLOT_SHIFT)
+#define RENDERER_PALETTE_MAX (RENDERER_PALETTE_SLOT_COUNT / 2)
+typedef struct
+{
+    uint32_t GlyphIndex;
+    uint32_t PaletteIndexAndFlags; // NOTE: Palette index in the low 24 bits, the foreground's flags in the top 8
+} renderer_compact_cell;
+
+typedef struct
+{
+    uint32_t Foreground; // NOTE: Without the flags
+    uint32_t Background;
+} renderer_color_pair;
+
+typedef struct
+{
+    uint64_t Key;
+    uint32_t IndexPlusOne; // NOTE: Zero for empty slots
+    uint32_t Reserved;
+} renderer_palette_slot;
+
+typedef struct
+{
+    // NOTE: Open-addressed, and never more than half full.  Only the slots that were used
+    // get cleared for the next frame.
+    renderer_palette_slot Slots[RENDERER_PALETTE_SLOT_COUNT];
+    uint32_t UsedSlots[RENDERER_PALETTE_MAX];
+    uint32_t Count;
+
+    uint64_t LastKey;
+    uint32_t LastIndex;
+} renderer_palette;
+
+/* NOTE:
+
+   Damage is the part of the window that changed since the last frame.  It is found by comparing
+   the screen against a copy of what was last drawn, row by row, so typing one character damages
+   one cell instead of the whole window.  Only the damaged rectangles get composed, and they are
+   what Present1 is told changed, so DWM doesn't recompose the whole window either.
+
+   The swap chain flips between two buffers, so the one being drawn into still has the frame
+   before last in it.  Bringing it up to date means composing last frame's damage as well as
+   this frame's.  Anything the comparison can't see - a new size, new constants, a new font -
+   damages everything.
+*/
+#define RENDERER_MAX_DAMAGE_RECTS 8
+typedef struct
+{
+    renderer_cell *Cells; // NOTE: Top to bottom, like the upload, and only each row's used prefix
+    uint32_t *RowLengths;
+    renderer_const_buffer Constants;
+    uint32_t FontGeneration;
+    int Valid;
+
+    uint32_t RectCount;
+    RECT Rects[RENDERER_MAX_DAMAGE_RECTS]; // NOTE: In pixels
+    int Full;
+
+    uint32_t PreviousRectCount;
+    RECT PreviousRects[RENDERER_MAX_DAMAGE_RECTS];
+    int PreviousFull;
+
+    uint32_t ComposedPixels;
+} renderer_damage;
+
 typedef struct
 {
     ID3D11Device *Device;
@@ -33,12 +123,24 @@ typedef struct
     ID3D11VertexShader *VertexShader;
 
     ID3D11Buffer *ConstantBuffer;
+    ID3D11RasterizerState *ScissorState;
     ID3D11RenderTargetView *RenderTarget;
     ID3D11UnorderedAccessView *RenderView;
 
     ID3D11Buffer *CellBuffer;
     ID3D11ShaderResourceView *CellView;
 
+    ID3D11Buffer *CompactCellBuffer;
+    ID3D11ShaderResourceView *CompactCellView;
+    ID3D11Buffer *PaletteBuffer;
+    ID3D11ShaderResourceView *PaletteView;
+    renderer_palette *Palette;
+
+    ID3D11Buffer *RowLengthBuffer;
+    ID3D11ShaderResourceView *RowLengthView;
+
+    renderer_damage Damage;
+
     ID3D11Texture2D *GlyphTexture;
     ID3D11ShaderResourceView *GlyphTextureView;
 
@@ -53,8 +155,11 @@ typedef struct
     uint32_t CurrentWidth;
     uint32_t CurrentHeight;
     uint32_t MaxCellCount;
+    uint32_t MaxRowCount;
 
     int UseComputeShader;
+    int UseCompactCells;
+    int DisableDamageRects;
 } d3d11_renderer;
 
 static d3d11_renderer AcquireD3D11Renderer(HWND Window, int EnableDebugging);
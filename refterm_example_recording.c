@@ -0,0 +1,317 @@
+static char *PutVarint(char *At, uint64_t Value)
+{
+    while(Value >= 0x80)
+    {
+        *At++ = (char)(Value | 0x80);
+        Value >>= 7;
+    }
+    *At++ = (char)Value;
+
+    return At;
+}
+
+static int GetVarint(recording_reader *Reader, uint64_t *Value)
+{
+    int Result = 0;
+    *Value = 0;
+
+    for(uint32_t Shift = 0; (Shift < 64) && (Reader->At < Reader->End); Shift += 7)
+    {
+        uint8_t Byte = (uint8_t)*Reader->At++;
+        *Value |= (uint64_t)(Byte & 0x7f) << Shift;
+        if(!(Byte & 0x80))
+        {
+            Result = 1;
+            break;
+        }
+    }
+
+    return Result;
+}
+
+static void FlushRecorder(recorder *Recorder)
+{
+    if(Recorder->BufferUsed)
+    {
+        DWORD Written = 0;
+        if(!WriteFile(Recorder->File, Recorder->Buffer, (DWORD)Recorder->BufferUsed, &Written, 0) ||
+           (Written != Recorder->BufferUsed))
+        {
+            Recorder->Failed = 1;
+        }
+        Recorder->BufferUsed = 0;
+    }
+}
+
+static char *BeginRecord(recorder *Recorder, uint32_t Type)
+{
+    // NOTE: Everything but the bytes of a data record fits in 32
+    if((Recorder->BufferSize - Recorder->BufferUsed) < 32)
+    {
+        FlushRecorder(Recorder);
+    }
+
+    LARGE_INTEGER Now;
+    QueryPerformanceCounter(&Now);
+
+    char *At = Recorder->Buffer + Recorder->BufferUsed;
+    *At++ = (char)Type;
+    At = PutVarint(At, (uint64_t)(Now.QuadPart - Recorder->LastTicks));
+    Recorder->LastTicks = Now.QuadPart;
+    ++Recorder->RecordCount;
+
+    return At;
+}
+
+static void EndRecord(recorder *Recorder, char *At)
+{
+    Recorder->BufferUsed = At - Recorder->Buffer;
+}
+
+static void RecordData(recorder *Recorder, char *Data, size_t Count)
+{
+    if(Recorder->Active && Count)
+    {
+        EnterCriticalSection(&Recorder->Lock);
+        if(Recorder->Active)
+        {
+            EndRecord(Recorder, PutVarint(BeginRecord(Recorder, RecordType_Data), Count));
+
+            // NOTE: Big reads skip the buffer rather than being copied through it
+            if(Count <= (Recorder->BufferSize - Recorder->BufferUsed))
+            {
+                __movsb((unsigned char *)Recorder->Buffer + Recorder->BufferUsed, (unsigned char *)Data, Count);
+                Recorder->BufferUsed += Count;
+            }
+            else
+            {
+                FlushRecorder(Recorder);
+
+                DWORD Written = 0;
+                if(!WriteFile(Recorder->File, Data, (DWORD)Count, &Written, 0) || (Written != Count))
+                {
+                    Recorder->Failed = 1;
+                }
+            }
+
+            Recorder->DataBytes += Count;
+        }
+        LeaveCriticalSection(&Recorder->Lock);
+    }
+}
+
+static void RecordEvent(recorder *Recorder, uint32_t Type, uint32_t A, uint32_t B)
+{
+    if(Recorder->Active)
+    {
+        EnterCriticalSection(&Recorder->Lock);
+        if(Recorder->Active)
+        {
+            char *At = BeginRecord(Recorder, Type);
+            if(Type != RecordType_Frame)
+            {
+                At = PutVarint(At, A);
+            }
+            if(Type == RecordType_Resize)
+            {
+                At = PutVarint(At, B);
+            }
+            EndRecord(Recorder, At);
+        }
+        LeaveCriticalSection(&Recorder->Lock);
+    }
+}
+
+static int StartRecorder(recorder *Recorder, char *FileName, recording_header Header)
+{
+    int Result = 0;
+
+    EnterCriticalSection(&Recorder->Lock);
+    if(!Recorder->Active)
+    {
+        if(!Recorder->Buffer)
+        {
+            Recorder->BufferSize = 1024*1024;
+            Recorder->Buffer = VirtualAlloc(0, Recorder->BufferSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+        }
+
+        HANDLE File = CreateFileA(FileName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if(Recorder->Buffer && (File != INVALID_HANDLE_VALUE))
+        {
+            LARGE_INTEGER Now;
+            QueryPerformanceCounter(&Now);
+
+            Header.Magic = RECORDING_MAGIC;
+            Header.Version = RECORDING_VERSION;
+            __movsb((unsigned char *)Recorder->Buffer, (unsigned char *)&Header, sizeof(Header));
+
+            Recorder->File = File;
+            Recorder->BufferUsed = sizeof(Header);
+            Recorder->Failed = 0;
+            Recorder->LastTicks = Now.QuadPart;
+            Recorder->RecordCount = 0;
+            Recorder->DataBytes = 0;
+            Recorder->Active = 1;
+
+            Result = 1;
+        }
+        else if(File != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(File);
+        }
+    }
+    LeaveCriticalSection(&Recorder->Lock);
+
+    return Result;
+}
+
+static int StopRecorder(recorder *Recorder, uint64_t GridHash)
+{
+    int Result = 0;
+
+    EnterCriticalSection(&Recorder->Lock);
+    if(Recorder->Active)
+    {
+        char *At = BeginRecord(Recorder, RecordType_End);
+        __movsb((unsigned char *)At, (unsigned char *)&GridHash, sizeof(GridHash));
+        EndRecord(Recorder, At + sizeof(GridHash));
+
+        FlushRecorder(Recorder);
+        CloseHandle(Recorder->File);
+        Recorder->File = 0;
+        Recorder->Active = 0;
+
+        Result = !Recorder->Failed;
+    }
+    LeaveCriticalSection(&Recorder->Lock);
+
+    return Result;
+}
+
+static int OpenRecording(recording_reader *Reader, char *FileName)
+{
+    int Result = 0;
+
+    recording_reader ZeroReader = {0};
+    *Reader = ZeroReader;
+
+    HANDLE File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(File != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER FileSize;
+        if(GetFileSizeEx(File, &FileSize) && (FileSize.QuadPart >= (LONGLONG)sizeof(recording_header)))
+        {
+            size_t Size = (size_t)FileSize.QuadPart;
+            Reader->Memory = VirtualAlloc(0, Size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+            if(Reader->Memory)
+            {
+                size_t ReadTotal = 0;
+                while(ReadTotal < Size)
+                {
+                    DWORD Chunk = (DWORD)(((Size - ReadTotal) > (1u << 30)) ? (1u << 30) : (Size - ReadTotal));
+                    DWORD ReadCount = 0;
+                    if(!ReadFile(File, Reader->Memory + ReadTotal, Chunk, &ReadCount, 0) || !ReadCount)
+                    {
+                        break;
+                    }
+                    ReadTotal += ReadCount;
+                }
+
+                __movsb((unsigned char *)&Reader->Header, (unsigned char *)Reader->Memory, sizeof(Reader->Header));
+                if((ReadTotal == Size) &&
+                   (Reader->Header.Magic == RECORDING_MAGIC) &&
+                   (Reader->Header.Version == RECORDING_VERSION) &&
+                   (Reader->Header.TicksPerSecond > 0))
+                {
+                    Reader->At = Reader->Memory + sizeof(Reader->Header);
+                    Reader->End = Reader->Memory + Size;
+                    Result = 1;
+                }
+                else
+                {
+                    VirtualFree(Reader->Memory, 0, MEM_RELEASE);
+                    Reader->Memory = 0;
+                }
+            }
+        }
+
+        CloseHandle(File);
+    }
+
+    return Result;
+}
+
+static void CloseRecording(recording_reader *Reader)
+{
+    if(Reader->Memory)
+    {
+        VirtualFree(Reader->Memory, 0, MEM_RELEASE);
+    }
+
+    recording_reader ZeroReader = {0};
+    *Reader = ZeroReader;
+}
+
+static int ReadRecordingEntry(recording_reader *Reader, recording_entry *Entry)
+{
+    // NOTE: Returns 0 at the end of the file, and also at anything malformed, which the caller
+    // can tell apart by whether it has seen RecordType_End
+    int Result = 0;
+
+    recording_entry ZeroEntry = {0};
+    *Entry = ZeroEntry;
+
+    if(Reader->At < Reader->End)
+    {
+        uint64_t DeltaTicks, A = 0, B = 0;
+        Entry->Type = (uint8_t)*Reader->At++;
+        if((Entry->Type < RecordType_Count) && GetVarint(Reader, &DeltaTicks))
+        {
+            Entry->DeltaTicks = (int64_t)DeltaTicks;
+            switch(Entry->Type)
+            {
+                case RecordType_Data:
+                {
+                    Result = (GetVarint(Reader, &A) && (A <= (uint64_t)(Reader->End - Reader->At)));
+                    if(Result)
+                    {
+                        Entry->Data = Reader->At;
+                        Entry->Count = (size_t)A;
+                        Reader->At += A;
+                    }
+                } break;
+
+                case RecordType_KeyDown:
+                case RecordType_Char:
+                {
+                    Result = GetVarint(Reader, &A);
+                } break;
+
+                case RecordType_Resize:
+                {
+                    Result = (GetVarint(Reader, &A) && GetVarint(Reader, &B));
+                } break;
+
+                case RecordType_Frame:
+                {
+                    Result = 1;
+                } break;
+
+                case RecordType_End:
+                {
+                    Result = ((Reader->End - Reader->At) >= (ptrdiff_t)sizeof(Entry->GridHash));
+                    if(Result)
+                    {
+                        __movsb((unsigned char *)&Entry->GridHash, (unsigned char *)Reader->At, sizeof(Entry->GridHash));
+                        Reader->At += sizeof(Entry->GridHash);
+                    }
+                } break;
+            }
+
+            Entry->A = (uint32_t)A;
+            Entry->B = (uint32_t)B;
+        }
+    }
+
+    return Result;
+}
@@ -0,0 +1,79 @@
+/* NOTE:
+
+   A recording is everything that went into the scrollback, plus the keys, resizes and frames
+   that decide what the screen shows, with the time each one happened, so a session can be
+   fed back through the parser and layout later and come out the same.
+
+   The file is a recording_header followed by records.  Each record is a type byte, then the
+   ticks since the previous record as a varint, then whatever the type carries:
+
+   RecordType_Data: varint byte count, then the bytes
+   RecordType_KeyDown, RecordType_Char: varint key code / UTF-16 code unit
+   RecordType_Resize: varint DimX, varint DimY
+   RecordType_Frame: nothing
+   RecordType_End: the grid hash at the end of recording, as 8 raw bytes
+*/
+
+#define RECORDING_MAGIC 0x43525452 // NOTE: "RTRC"
+#define RECORDING_VERSION 1
+
+enum
+{
+    RecordType_Data,
+    RecordType_KeyDown,
+    RecordType_Char,
+    RecordType_Resize,
+    RecordType_Frame,
+    RecordType_End,
+
+    RecordType_Count,
+};
+
+typedef struct
+{
+    uint32_t Magic;
+    uint32_t Version;
+    int64_t TicksPerSecond;
+    uint32_t DimX;
+    uint32_t DimY;
+    uint32_t LineWrap;
+    uint32_t Reserved;
+} recording_header;
+
+typedef struct
+{
+    // NOTE: The ingest thread records data under the terminal lock, but keys and frames come
+    // from the render thread without it, so the recorder has its own.  Active can be checked
+    // without the lock to skip it entirely when nothing is being recorded.
+    CRITICAL_SECTION Lock;
+    volatile int Active;
+
+    HANDLE File;
+    char *Buffer;
+    size_t BufferSize;
+    size_t BufferUsed;
+    int Failed;
+
+    int64_t LastTicks;
+    uint64_t RecordCount;
+    uint64_t DataBytes;
+} recorder;
+
+typedef struct
+{
+    uint32_t Type;
+    int64_t DeltaTicks;
+    uint32_t A; // NOTE: Key code, code unit, or DimX
+    uint32_t B; // NOTE: DimY
+    uint64_t GridHash;
+    char *Data;
+    size_t Count;
+} recording_entry;
+
+typedef struct
+{
+    char *Memory;
+    char *At;
+    char *End;
+    recording_header Header;
+} recording_reader;
@@ -0,0 +1,379 @@
+static int IsInsideEscape(source_buffer_range Range, size_t Offset, size_t Length)
+{
+    // NOTE: Looks back a little way from the match for an escape sequence that runs into it.
+    // Only the range itself is checked, so a sequence that started before the chunk the
+    // match was found in won't be noticed.
+    int Result = 0;
+
+    size_t LookBack = (Offset < 32) ? Offset : 32;
+    for(size_t EscapeAt = Offset - LookBack;
+        !Result && (EscapeAt < (Offset + Length));
+        ++EscapeAt)
+    {
+        if(Range.Data[EscapeAt] == '\x1b')
+        {
+            size_t End = EscapeAt + 2;
+            if(((EscapeAt + 1) < Range.Count) && (Range.Data[EscapeAt + 1] == '['))
+            {
+                while((End < Range.Count) &&
+                      ((Range.Data[End] < 0x40) || (Range.Data[End] > 0x7e)))
+                {
+                    ++End;
+                }
+                ++End;
+            }
+
+            Result = (End > Offset);
+        }
+    }
+
+    return Result;
+}
+
+static int MatchesAt(char *A, char *B, size_t Count)
+{
+    int Result = 1;
+    while(Result && Count--)
+    {
+        Result = (*A++ == *B++);
+    }
+
+    return Result;
+}
+
+static int FindLiteral(source_buffer_range Range, char *Pattern, size_t Length, size_t *MatchOffset)
+{
+    // NOTE: Compares the first and last bytes of the pattern against sixteen candidate positions
+    // at once, and only checks the middle of the pattern where both of those hit.  MatchOffset
+    // gets where the match starts.
+    size_t Result = Range.Count;
+
+    if(Length && (Length <= Range.Count))
+    {
+        char *Data = Range.Data;
+        size_t LastStart = Range.Count - Length;
+
+        __m128i FirstByte = _mm_set1_epi8(Pattern[0]);
+        __m128i LastByte = _mm_set1_epi8(Pattern[Length - 1]);
+
+        size_t At = 0;
+        while((Result == Range.Count) && ((At + 15) <= LastStart))
+        {
+            __m128i First = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + At)), FirstByte);
+            __m128i Last = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + At + Length - 1)), LastByte);
+            uint32_t Mask = _mm_movemask_epi8(_mm_and_si128(First, Last));
+            while(Mask)
+            {
+                size_t Candidate = At + _tzcnt_u32(Mask);
+                if(MatchesAt(Data + Candidate + 1, Pattern + 1, (Length > 2) ? (Length - 2) : 0) &&
+                   !IsInsideEscape(Range, Candidate, Length))
+                {
+                    Result = Candidate;
+                    break;
+                }
+
+                Mask &= Mask - 1;
+            }
+
+            At += 16;
+        }
+
+        while((Result == Range.Count) && (At <= LastStart))
+        {
+            if(MatchesAt(Data + At, Pattern, Length) &&
+               !IsInsideEscape(Range, At, Length))
+            {
+                Result = At;
+            }
+
+            ++At;
+        }
+    }
+
+    *MatchOffset = Result;
+    return (Result < Range.Count);
+}
+
+static void ResetSearchDFA(search_dfa *DFA)
+{
+    DFA->StateCount = 1;
+    DFA->StateSets[0] = 0;
+    DFA->StateAccepts[0] = 0;
+    __stosb((unsigned char *)DFA->Next[0], 0xff, sizeof(DFA->Next[0]));
+}
+
+static int CompileSearchRegex(search_dfa *DFA, char *Pattern, size_t Length)
+{
+    /* NOTE: Supports literals, '.', '[...]' and '[^...]' with ranges, '\' escapes (plus \d, \w
+       and \s), and '?', '*', '+' after any of those.  There is no alternation or grouping.
+       Matches never span lines.
+    */
+
+    int Result = 1;
+
+    __stosb((unsigned char *)DFA->ClassMask, 0, sizeof(DFA->ClassMask));
+
+    uint32_t AtomCount = 0;
+    uint64_t Optional = 0;
+    uint64_t Repeats = 0;
+
+    size_t At = 0;
+    while(Result && (At < Length))
+    {
+        if(AtomCount == SEARCH_MAX_ATOMS)
+        {
+            Result = 0;
+            break;
+        }
+
+        uint8_t Class[256] = {0};
+        char unsigned C = Pattern[At++];
+        if(C == '.')
+        {
+            __stosb(Class, 1, sizeof(Class));
+            Class['\n'] = 0;
+        }
+        else if(C == '[')
+        {
+            int Negate = ((At < Length) && (Pattern[At] == '^'));
+            if(Negate) ++At;
+
+            int Closed = 0;
+            int First = 1;
+            while(At < Length)
+            {
+                char unsigned Low = Pattern[At++];
+                if((Low == ']') && !First)
+                {
+                    Closed = 1;
+                    break;
+                }
+                if((Low == '\\') && (At < Length))
+                {
+                    Low = Pattern[At++];
+                }
+
+                char unsigned High = Low;
+                if(((At + 1) < Length) && (Pattern[At] == '-') && (Pattern[At + 1] != ']'))
+                {
+                    High = Pattern[At + 1];
+                    At += 2;
+                }
+
+                for(uint32_t Byte = Low; Byte <= High; ++Byte)
+                {
+                    Class[Byte] = 1;
+                }
+
+                First = 0;
+            }
+
+            if(Negate)
+            {
+                for(uint32_t Byte = 0; Byte < 256; ++Byte)
+                {
+                    Class[Byte] = !Class[Byte];
+                }
+                Class['\n'] = 0;
+            }
+
+            Result = Closed;
+        }
+        else if(C == '\\')
+        {
+            if(At < Length)
+            {
+                C = Pattern[At++];
+                if((C == 'd') || (C == 'w'))
+                {
+                    for(uint32_t Byte = '0'; Byte <= '9'; ++Byte) Class[Byte] = 1;
+                    if(C == 'w')
+                    {
+                        for(uint32_t Byte = 'a'; Byte <= 'z'; ++Byte) Class[Byte] = 1;
+                        for(uint32_t Byte = 'A'; Byte <= 'Z'; ++Byte) Class[Byte] = 1;
+                        Class['_'] = 1;
+                    }
+                }
+                else if(C == 's')
+                {
+                    Class[' '] = Class['\t'] = Class['\r'] = 1;
+                }
+                else
+                {
+                    Class[C] = 1;
+                }
+            }
+            else
+            {
+                Result = 0;
+            }
+        }
+        else if((C == '?') || (C == '*') || (C == '+'))
+        {
+            // NOTE: Nothing to repeat
+            Result = 0;
+        }
+        else
+        {
+            Class[C] = 1;
+        }
+
+        uint64_t Bit = (uint64_t)1 << AtomCount;
+        for(uint32_t Byte = 0; Byte < 256; ++Byte)
+        {
+            if(Class[Byte]) DFA->ClassMask[Byte] |= Bit;
+        }
+
+        if(At < Length)
+        {
+            char Quantifier = Pattern[At];
+            if((Quantifier == '?') || (Quantifier == '*')) Optional |= Bit;
+            if((Quantifier == '*') || (Quantifier == '+')) Repeats |= Bit;
+            if((Quantifier == '?') || (Quantifier == '*') || (Quantifier == '+')) ++At;
+        }
+
+        ++AtomCount;
+    }
+
+    if(Result && AtomCount)
+    {
+        DFA->First = 0;
+        DFA->Accept = 0;
+        for(uint32_t AtomIndex = 0; AtomIndex < AtomCount; ++AtomIndex)
+        {
+            uint64_t Follow = Repeats & ((uint64_t)1 << AtomIndex);
+            for(uint32_t NextIndex = AtomIndex + 1; NextIndex < AtomCount; ++NextIndex)
+            {
+                Follow |= (uint64_t)1 << NextIndex;
+                if(!(Optional & ((uint64_t)1 << NextIndex))) break;
+            }
+            DFA->Follow[AtomIndex] = Follow;
+        }
+
+        for(uint32_t AtomIndex = 0; AtomIndex < AtomCount; ++AtomIndex)
+        {
+            DFA->First |= (uint64_t)1 << AtomIndex;
+            if(!(Optional & ((uint64_t)1 << AtomIndex))) break;
+        }
+
+        for(uint32_t AtomIndex = AtomCount; AtomIndex-- > 0;)
+        {
+            DFA->Accept |= (uint64_t)1 << AtomIndex;
+            if(!(Optional & ((uint64_t)1 << AtomIndex))) break;
+        }
+
+        // NOTE: A pattern that matches the empty string would match every line
+        Result = ((DFA->First & ~Optional) != 0);
+
+        ResetSearchDFA(DFA);
+    }
+    else
+    {
+        Result = 0;
+    }
+
+    return Result;
+}
+
+static uint32_t GetSearchDFAState(search_dfa *DFA, uint64_t Set)
+{
+    uint32_t Result = 0;
+    while((Result < DFA->StateCount) && (DFA->StateSets[Result] != Set))
+    {
+        ++Result;
+    }
+
+    if(Result == DFA->StateCount)
+    {
+        if(DFA->StateCount == SEARCH_MAX_DFA_STATES)
+        {
+            // NOTE: Out of room, so throw the whole DFA away and start building it again
+            ResetSearchDFA(DFA);
+        }
+
+        Result = DFA->StateCount++;
+        DFA->StateSets[Result] = Set;
+        DFA->StateAccepts[Result] = ((Set & DFA->Accept) != 0);
+        __stosb((unsigned char *)DFA->Next[Result], 0xff, sizeof(DFA->Next[Result]));
+    }
+
+    return Result;
+}
+
+static uint32_t GetNextSearchDFAState(search_dfa *DFA, uint32_t State, char unsigned Byte)
+{
+    uint32_t Result = DFA->Next[State][Byte];
+    if(Result == SEARCH_DFA_UNKNOWN)
+    {
+        uint64_t From = DFA->StateSets[State];
+        uint64_t To = DFA->First;
+        while(From)
+        {
+            To |= DFA->Follow[_tzcnt_u64(From)];
+            From &= From - 1;
+        }
+        To &= DFA->ClassMask[Byte];
+
+        uint32_t StateCount = DFA->StateCount;
+        Result = GetSearchDFAState(DFA, To);
+        if(DFA->StateCount >= StateCount)
+        {
+            // NOTE: Only remember the transition if the DFA wasn't just reset out from under State
+            DFA->Next[State][Byte] = (uint16_t)Result;
+        }
+    }
+
+    return Result;
+}
+
+static int FindRegex(scrollback_search *Search, source_buffer_range Range, size_t *MatchOffset)
+{
+    // NOTE: Escape sequences are stepped over rather than matched, so text that is broken up by
+    // color changes still matches.  The DFA and escape state carry over from the previous call,
+    // so the scrollback can be fed in any size chunks.  MatchOffset gets where the match ends,
+    // since a DFA doesn't know where it started.
+    int Result = 0;
+
+    search_dfa *DFA = Search->DFA;
+    uint32_t State = Search->DFAState;
+    uint32_t EscapeState = Search->EscapeState;
+    for(size_t At = 0; At < Range.Count; ++At)
+    {
+        char unsigned Byte = Range.Data[At];
+        if(EscapeState)
+        {
+            if(EscapeState == 1)
+            {
+                EscapeState = (Byte == '[') ? 2 : 0;
+            }
+            else if((Byte >= 0x40) && (Byte <= 0x7e))
+            {
+                EscapeState = 0;
+            }
+        }
+        else if(Byte == '\x1b')
+        {
+            EscapeState = 1;
+        }
+        else if(Byte == '\n')
+        {
+            State = 0;
+        }
+        else
+        {
+            State = GetNextSearchDFAState(DFA, State, Byte);
+            if(DFA->StateAccepts[State])
+            {
+                *MatchOffset = At;
+                Result = 1;
+                State = 0;
+                break;
+            }
+        }
+    }
+
+    Search->DFAState = State;
+    Search->EscapeState = EscapeState;
+
+    return Result;
+}
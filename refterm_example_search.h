@@ -0,0 +1,48 @@
+enum
+{
+    SearchMode_None,
+    SearchMode_Literal,
+    SearchMode_Regex,
+};
+
+#define SEARCH_MAX_ATOMS 64
+#define SEARCH_MAX_DFA_STATES 256
+#define SEARCH_DFA_UNKNOWN 0xffff
+typedef struct
+{
+    // NOTE: The regex is compiled to one NFA state per atom (Glushkov-style, so there are no
+    // epsilon transitions), and the DFA is built lazily from sets of those states as bytes
+    // are seen.  State 0 is always the empty set.
+    uint64_t First;
+    uint64_t Accept;
+    uint64_t Follow[SEARCH_MAX_ATOMS];
+    uint64_t ClassMask[256];
+
+    uint32_t StateCount;
+    uint64_t StateSets[SEARCH_MAX_DFA_STATES];
+    uint8_t StateAccepts[SEARCH_MAX_DFA_STATES];
+    uint16_t Next[SEARCH_MAX_DFA_STATES][256];
+} search_dfa;
+
+typedef struct
+{
+    int Mode;
+    size_t PatternLength;
+    char Pattern[256];
+
+    // NOTE: Literal searches of three or more bytes skip blocks the trigram index rules out
+    uint32_t TrigramCount;
+    uint16_t TrigramHashes[256];
+
+    search_dfa *DFA;
+    uint32_t DFAState;
+    uint32_t EscapeState;
+
+    size_t AtP;
+    size_t EndP;
+
+    size_t HitCount;
+    size_t ScannedBytes;
+    size_t SkippedBytes;
+    int64_t ScanTicks;
+} scrollback_search;
@@ -1,6 +1,7 @@
 static source_buffer AllocateSourceBuffer(size_t DataSize)
 {
     source_buffer Result = {0};
+    Result.PinnedP = SOURCE_NOT_PINNED;
 
     SYSTEM_INFO Info;
     GetSystemInfo(&Info);
@@ -97,6 +98,65 @@ static source_buffer_range ConsumeCount(source_buffer_range Source, size_t Count
     return Result;
 }
 
+static char *GetHotData(source_buffer *Buffer, size_t AbsoluteP)
+{
+    Assert((AbsoluteP <= Buffer->AbsoluteFilledSize) && ((Buffer->AbsoluteFilledSize - AbsoluteP) <= Buffer->DataSize));
+    char *Result = Buffer->Data + Buffer->DataSize + Buffer->RelativePoint - (Buffer->AbsoluteFilledSize - AbsoluteP);
+    return Result;
+}
+
+static source_buffer_range ReadColdSourceAt(source_buffer *Buffer, size_t AbsoluteP, size_t Count)
+{
+    source_buffer_range Result = {0};
+
+    cold_store *Store = &Buffer->ColdStore;
+    if(Store->Arena)
+    {
+        size_t SegmentSize = Store->SegmentSize;
+        size_t SegmentIndex = AbsoluteP / SegmentSize;
+        if(Store->DecodedSegment != (SegmentIndex + 1))
+        {
+            Store->DecodedSegment = 0;
+            Store->DecodedCount = 0;
+            if(DecodeColdSegment(Store, SegmentIndex, Store->DecodeBuffer) == SegmentSize)
+            {
+                Store->DecodedSegment = SegmentIndex + 1;
+                Store->DecodedCount = SegmentSize;
+                Store->DecodedCount += DecodeColdSegment(Store, SegmentIndex + 1, Store->DecodeBuffer + SegmentSize);
+            }
+        }
+
+        if(Store->DecodedSegment && (Store->DecodedCount < 2*SegmentSize))
+        {
+            // NOTE: The following segment hasn't been archived yet, so it is still in the hot ring,
+            // and may have grown since last time.
+            size_t NextP = (SegmentIndex + 1)*SegmentSize;
+            if(IsInBuffer(Buffer, NextP))
+            {
+                size_t NextCount = Buffer->AbsoluteFilledSize - NextP;
+                if(NextCount > SegmentSize) NextCount = SegmentSize;
+                __movsb(Store->DecodeBuffer + SegmentSize, (unsigned char *)GetHotData(Buffer, NextP), NextCount);
+                Store->DecodedCount = SegmentSize + NextCount;
+            }
+        }
+
+        if(Store->DecodedSegment)
+        {
+            size_t Offset = AbsoluteP - SegmentIndex*SegmentSize;
+            Result.AbsoluteP = AbsoluteP;
+            Result.Data = (char *)Store->DecodeBuffer + Offset;
+            Result.Count = Store->DecodedCount - Offset;
+
+            if(Result.Count > Count)
+            {
+                Result.Count = Count;
+            }
+        }
+    }
+
+    return Result;
+}
+
 static source_buffer_range ReadSourceAt(source_buffer *Buffer, size_t AbsoluteP, size_t Count)
 {
     source_buffer_range Result = {0};
@@ -104,13 +164,63 @@ static source_buffer_range ReadSourceAt(source_buffer *Buffer, size_t AbsoluteP,
     {
         Result.AbsoluteP = AbsoluteP;
         Result.Count = (Buffer->AbsoluteFilledSize - AbsoluteP);
-        Result.Data = Buffer->Data + Buffer->DataSize + Buffer->RelativePoint - Result.Count;
+        Result.Data = GetHotData(Buffer, AbsoluteP);
 
         if(Result.Count > Count)
         {
             Result.Count = Count;
         }
     }
+    else if(AbsoluteP < Buffer->AbsoluteFilledSize)
+    {
+        // NOTE: The returned range points into the cold store's decode buffer, so it is only good
+        // until the next cold read, and may come back shorter than it would have from the hot ring.
+        Result = ReadColdSourceAt(Buffer, AbsoluteP, Count);
+    }
+
+    return Result;
+}
+
+static source_buffer_range ReadPinnedSourceAt(source_buffer *Buffer, size_t FilledSize, size_t AbsoluteP, size_t Count)
+{
+    // NOTE: For readers on other threads.  FilledSize is wherever the reader last saw the writer
+    // get to, and the live fill position is never looked at, since the writer may be moving it.
+    // The result is only good if AbsoluteP is at or after a successful PinSource.
+    source_buffer_range Result = {0};
+    if((AbsoluteP < FilledSize) && ((FilledSize - AbsoluteP) <= Buffer->DataSize))
+    {
+        Result.AbsoluteP = AbsoluteP;
+        Result.Count = (FilledSize - AbsoluteP);
+        Result.Data = Buffer->Data + (AbsoluteP % Buffer->DataSize);
+
+        if(Result.Count > Count)
+        {
+            Result.Count = Count;
+        }
+    }
+
+    return Result;
+}
+
+static void UnpinSource(source_buffer *Buffer)
+{
+    _ReadWriteBarrier();
+    Buffer->PinnedP = SOURCE_NOT_PINNED;
+}
+
+static int PinSource(source_buffer *Buffer, size_t AbsoluteP)
+{
+    // NOTE: Pins first and checks the horizon second, which is the opposite order from
+    // GetNextWritableRange, so at least one side always sees the other.  Fails if the writer
+    // may already be overwriting AbsoluteP.  Only one reader can have a pin at a time.
+    Buffer->PinnedP = AbsoluteP;
+    MemoryBarrier();
+
+    int Result = (AbsoluteP >= Buffer->OverwriteHorizonP);
+    if(!Result)
+    {
+        UnpinSource(Buffer);
+    }
 
     return Result;
 }
@@ -121,6 +231,17 @@ static size_t GetCurrentAbsoluteP(source_buffer *Buffer)
     return Result;
 }
 
+static void ArchiveBefore(source_buffer *Buffer, size_t AbsoluteP)
+{
+    cold_store *Store = &Buffer->ColdStore;
+    while((Store->SegmentCount*Store->SegmentSize) < AbsoluteP)
+    {
+        size_t SegmentP = Store->SegmentCount*Store->SegmentSize;
+        Assert((SegmentP + Store->SegmentSize) <= Buffer->AbsoluteFilledSize);
+        ArchiveColdSegment(Store, (char unsigned *)GetHotData(Buffer, SegmentP));
+    }
+}
+
 #define LARGEST_AVAILABLE ((size_t)-1)
 static source_buffer_range GetNextWritableRange(source_buffer *Buffer, size_t MaxCount)
 {
@@ -136,6 +257,44 @@ static source_buffer_range GetNextWritableRange(source_buffer *Buffer, size_t Ma
         Result.Count = MaxCount;
     }
 
+    if(Buffer->ColdStore.Arena)
+    {
+        // NOTE: The range is kept a segment short of the whole ring so the segment currently
+        // being filled is never one that needs archiving.
+        size_t MaxWritable = Buffer->DataSize - Buffer->ColdStore.SegmentSize;
+        if(Result.Count > MaxWritable)
+        {
+            Result.Count = MaxWritable;
+        }
+    }
+
+    if((Buffer->AbsoluteFilledSize + Result.Count) > Buffer->DataSize)
+    {
+        size_t HorizonP = Buffer->AbsoluteFilledSize + Result.Count - Buffer->DataSize;
+        size_t PreviousHorizonP = Buffer->OverwriteHorizonP;
+        if(PreviousHorizonP < HorizonP)
+        {
+            Buffer->OverwriteHorizonP = HorizonP;
+            MemoryBarrier();
+
+            size_t PinnedP = Buffer->PinnedP;
+            if(PinnedP < HorizonP)
+            {
+                // NOTE: Shorten the range so it stops right where the pinned data starts
+                HorizonP = (PinnedP > PreviousHorizonP) ? PinnedP : PreviousHorizonP;
+                Result.Count = HorizonP + Buffer->DataSize - Buffer->AbsoluteFilledSize;
+                Buffer->OverwriteHorizonP = HorizonP;
+            }
+        }
+
+        if(Buffer->ColdStore.Arena)
+        {
+            // NOTE: Whatever gets written here overwrites the oldest part of the ring, so it has
+            // to be archived first.
+            ArchiveBefore(Buffer, Buffer->AbsoluteFilledSize + Result.Count - Buffer->DataSize);
+        }
+    }
+
     return Result;
 }
 
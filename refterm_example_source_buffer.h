@@ -5,6 +5,7 @@ typedef struct
     char *Data;
 } source_buffer_range;
 
+#define SOURCE_NOT_PINNED ((size_t)-1)
 typedef struct 
 {
     size_t DataSize;
@@ -15,5 +16,18 @@ typedef struct
     
     // NOTE(casey): For cache checking
     size_t AbsoluteFilledSize;
+
+    // NOTE: Everything before this position may be getting overwritten by a pending write, so
+    // other threads reading the ring directly must stay at or past it.
+    volatile size_t OverwriteHorizonP;
+
+    // NOTE: A reader on another thread can pin a position, and the writer won't hand out
+    // anything that would overwrite it until it is unpinned.
+    volatile size_t PinnedP;
+
+    // NOTE: Everything before ColdStore.SegmentCount*SegmentSize has been archived, and that
+    // is always at or past where the ring's oldest data starts.  Optional - if it has no
+    // arena, old data is simply overwritten.
+    cold_store ColdStore;
 } source_buffer;
 
@@ -0,0 +1,179 @@
+static int64_t GetTelemetryTicks(void)
+{
+    LARGE_INTEGER Now;
+    QueryPerformanceCounter(&Now);
+    return Now.QuadPart;
+}
+
+static uint32_t TelemetryMicroseconds(telemetry *Telemetry, int64_t Ticks)
+{
+    uint32_t Result = (uint32_t)(Ticks * 1000000 / Telemetry->TicksPerSecond);
+    return Result;
+}
+
+static void BeginTelemetryFrame(telemetry *Telemetry, int64_t StartTicks)
+{
+    telemetry_frame ZeroFrame = {0};
+    Telemetry->Current = ZeroFrame;
+    Telemetry->Current.StartTicks = StartTicks;
+}
+
+static void EndTelemetryFrame(telemetry *Telemetry, int64_t EndTicks, int64_t IngestedBytes,
+                              glyph_table_stats GlyphStats, uint32_t CellCount)
+{
+    telemetry_frame *Frame = &Telemetry->Current;
+    Frame->EndTicks = EndTicks;
+
+    int64_t IngestTicks = Telemetry->IngestTicks;
+    int64_t ParseTicks = Telemetry->ParseTicks;
+    Frame->IngestTicks = IngestTicks - Telemetry->LastIngestTicks;
+    Frame->ParseTicks = ParseTicks - Telemetry->LastParseTicks;
+    Frame->IngestedBytes = IngestedBytes - Telemetry->LastIngestedBytes;
+    Telemetry->LastIngestTicks = IngestTicks;
+    Telemetry->LastParseTicks = ParseTicks;
+    Telemetry->LastIngestedBytes = IngestedBytes;
+
+    Frame->CellCount = CellCount;
+    Frame->GlyphHitCount = (uint32_t)GlyphStats.HitCount;
+    Frame->GlyphMissCount = (uint32_t)GlyphStats.MissCount;
+    Frame->GlyphRecycleCount = (uint32_t)GlyphStats.RecycleCount;
+    Frame->GlyphProbeCount = (uint32_t)GlyphStats.ProbeCount;
+
+    uint64_t FrameIndex = Telemetry->FrameCount;
+    Telemetry->Frames[FrameIndex % TELEMETRY_FRAME_COUNT] = *Frame;
+    _WriteBarrier();
+    Telemetry->FrameCount = FrameIndex + 1;
+}
+
+static uint32_t CopyTelemetryFrames(telemetry *Telemetry, telemetry_frame *Dest, uint32_t MaxCount)
+{
+    // NOTE: Never copies the slot after the newest frame, since that is the one the writer fills
+    // next.  Anything the writer laps during the copy is dropped off the front afterwards.
+    uint64_t EndIndex = Telemetry->FrameCount;
+    _ReadBarrier();
+
+    uint64_t Count = EndIndex;
+    if(Count > (TELEMETRY_FRAME_COUNT - 1)) Count = TELEMETRY_FRAME_COUNT - 1;
+    if(Count > MaxCount) Count = MaxCount;
+
+    uint64_t FirstIndex = EndIndex - Count;
+    for(uint64_t Index = FirstIndex; Index < EndIndex; ++Index)
+    {
+        Dest[Index - FirstIndex] = Telemetry->Frames[Index % TELEMETRY_FRAME_COUNT];
+    }
+
+    // NOTE: Each frame written since overwrote one copied slot, and the one after those may be
+    // mid-write as well
+    _ReadBarrier();
+    uint64_t Lapped = Telemetry->FrameCount - EndIndex;
+    if(Lapped) ++Lapped;
+    if(Lapped > Count) Lapped = Count;
+    if(Lapped)
+    {
+        __movsb((unsigned char *)Dest, (unsigned char *)(Dest + Lapped), (Count - Lapped)*sizeof(telemetry_frame));
+    }
+
+    uint32_t Result = (uint32_t)(Count - Lapped);
+    return Result;
+}
+
+static char *FormatTelemetryFrame(telemetry *Telemetry, telemetry_frame *Frame, int64_t BaseTicks,
+                                  uint32_t FrameIndex, int Format, char *At)
+{
+    uint32_t StartUS = TelemetryMicroseconds(Telemetry, Frame->StartTicks - BaseTicks);
+    if(Format == TelemetryFormat_CSV)
+    {
+        At += wsprintfA(At, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\r\n",
+                        FrameIndex, StartUS,
+                        TelemetryMicroseconds(Telemetry, Frame->EndTicks - Frame->StartTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->LayoutTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->RasterTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->UploadTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->DrawTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->IngestTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->ParseTicks),
+                        (uint32_t)Frame->IngestedBytes, Frame->CellCount, Frame->UploadBytes, Frame->ComposedPixels,
+                        Frame->GlyphHitCount, Frame->GlyphMissCount, Frame->GlyphRecycleCount,
+                        Frame->GlyphProbeCount, Frame->AtlasUploadCount);
+    }
+    else
+    {
+        // NOTE: Raster is a total for the whole layout, so it is shown starting where layout does
+        char *Separator = FrameIndex ? ",\n" : "";
+        At += wsprintfA(At, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%u,\"dur\":%u,\"args\":{\"frame\":%u}}",
+                        Separator, StartUS, TelemetryMicroseconds(Telemetry, Frame->EndTicks - Frame->StartTicks), FrameIndex);
+        At += wsprintfA(At, ",\n{\"name\":\"layout\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%u,\"dur\":%u}",
+                        StartUS, TelemetryMicroseconds(Telemetry, Frame->LayoutTicks));
+        At += wsprintfA(At, ",\n{\"name\":\"raster\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%u,\"dur\":%u}",
+                        StartUS, TelemetryMicroseconds(Telemetry, Frame->RasterTicks));
+        At += wsprintfA(At, ",\n{\"name\":\"upload\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%u,\"dur\":%u,\"args\":{\"cells\":%u,\"bytes\":%u}}",
+                        TelemetryMicroseconds(Telemetry, Frame->UploadStartTicks - BaseTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->UploadTicks), Frame->CellCount, Frame->UploadBytes);
+        At += wsprintfA(At, ",\n{\"name\":\"draw\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%u,\"dur\":%u,\"args\":{\"pixels\":%u}}",
+                        TelemetryMicroseconds(Telemetry, Frame->DrawStartTicks - BaseTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->DrawTicks), Frame->ComposedPixels);
+        At += wsprintfA(At, ",\n{\"name\":\"ingest\",\"ph\":\"C\",\"pid\":1,\"ts\":%u,\"args\":{\"ingest_us\":%u,\"parse_us\":%u,\"bytes\":%u}}",
+                        StartUS, TelemetryMicroseconds(Telemetry, Frame->IngestTicks),
+                        TelemetryMicroseconds(Telemetry, Frame->ParseTicks), (uint32_t)Frame->IngestedBytes);
+        At += wsprintfA(At, ",\n{\"name\":\"glyphs\",\"ph\":\"C\",\"pid\":1,\"ts\":%u,\"args\":{\"hits\":%u,\"misses\":%u,\"recycles\":%u,\"probes\":%u,\"atlas_uploads\":%u}}",
+                        StartUS, Frame->GlyphHitCount, Frame->GlyphMissCount, Frame->GlyphRecycleCount,
+                        Frame->GlyphProbeCount, Frame->AtlasUploadCount);
+    }
+
+    return At;
+}
+
+static int WriteTelemetryFile(telemetry *Telemetry, char *FileName, int Format, uint32_t *FrameCountWritten)
+{
+    int Result = 0;
+    *FrameCountWritten = 0;
+
+    size_t MaxTextPerFrame = 2048;
+    size_t FramesSize = TELEMETRY_FRAME_COUNT*sizeof(telemetry_frame);
+    size_t TextSize = 1024 + TELEMETRY_FRAME_COUNT*MaxTextPerFrame;
+    telemetry_frame *Frames = VirtualAlloc(0, FramesSize + TextSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    if(Frames)
+    {
+        uint32_t FrameCount = CopyTelemetryFrames(Telemetry, Frames, TELEMETRY_FRAME_COUNT);
+        int64_t BaseTicks = FrameCount ? Frames[0].StartTicks : 0;
+
+        char *Text = (char *)Frames + FramesSize;
+        char *At = Text;
+        if(Format == TelemetryFormat_CSV)
+        {
+            At += wsprintfA(At, "frame,start_us,frame_us,layout_us,raster_us,upload_us,draw_us,ingest_us,parse_us,"
+                            "ingested_bytes,cells,upload_bytes,composed_pixels,glyph_hits,glyph_misses,glyph_recycles,glyph_probes,atlas_uploads\r\n");
+        }
+        else
+        {
+            At += wsprintfA(At, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        }
+
+        for(uint32_t FrameIndex = 0; FrameIndex < FrameCount; ++FrameIndex)
+        {
+            At = FormatTelemetryFrame(Telemetry, Frames + FrameIndex, BaseTicks, FrameIndex, Format, At);
+        }
+
+        if(Format == TelemetryFormat_Trace)
+        {
+            At += wsprintfA(At, "\n]}\n");
+        }
+
+        HANDLE File = CreateFileA(FileName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if(File != INVALID_HANDLE_VALUE)
+        {
+            DWORD Written = 0;
+            if(WriteFile(File, Text, (DWORD)(At - Text), &Written, 0) &&
+               (Written == (DWORD)(At - Text)))
+            {
+                *FrameCountWritten = FrameCount;
+                Result = 1;
+            }
+            CloseHandle(File);
+        }
+
+        VirtualFree(Frames, 0, MEM_RELEASE);
+    }
+
+    return Result;
+}
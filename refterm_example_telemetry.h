@@ -0,0 +1,55 @@
+#define TELEMETRY_FRAME_COUNT 1024
+typedef struct
+{
+    // NOTE: All times are in QueryPerformanceCounter ticks.  Ingest and parse happen on the
+    // ingest thread, so they are totals since the previous frame rather than spans within
+    // this one, and ingest includes parse.  Raster is part of layout.
+    int64_t StartTicks;
+    int64_t EndTicks;
+    int64_t UploadStartTicks;
+    int64_t DrawStartTicks;
+
+    int64_t IngestTicks;
+    int64_t ParseTicks;
+    int64_t LayoutTicks;
+    int64_t RasterTicks;
+    int64_t UploadTicks;
+    int64_t DrawTicks;
+
+    uint64_t IngestedBytes;
+    uint32_t CellCount;
+    uint32_t UploadBytes;
+    uint32_t ComposedPixels;
+    uint32_t GlyphHitCount;
+    uint32_t GlyphMissCount;
+    uint32_t GlyphRecycleCount;
+    uint32_t GlyphProbeCount;
+    uint32_t AtlasUploadCount;
+} telemetry_frame;
+
+typedef struct
+{
+    int64_t TicksPerSecond;
+
+    // NOTE: Only the render thread writes frames, and FrameCount only moves once a frame is
+    // complete, so any thread can read the ring without a lock, as long as it checks afterwards
+    // that the writer didn't lap what it copied.
+    volatile uint64_t FrameCount;
+    telemetry_frame Frames[TELEMETRY_FRAME_COUNT];
+
+    // NOTE: Added to by the ingest thread (and by anything else that parses, under the lock)
+    volatile int64_t IngestTicks;
+    volatile int64_t ParseTicks;
+
+    // NOTE: The frame the render thread is in the middle of
+    telemetry_frame Current;
+    int64_t LastIngestTicks;
+    int64_t LastParseTicks;
+    int64_t LastIngestedBytes;
+} telemetry;
+
+enum
+{
+    TelemetryFormat_CSV,
+    TelemetryFormat_Trace,
+};
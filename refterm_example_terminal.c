@@ -1,13 +1,16 @@
-static terminal_buffer AllocateTerminalBuffer(int DimX, int DimY)
+static terminal_buffer AllocateTerminalBuffer(uint32_t MaxDimX, uint32_t MaxDimY)
 {
+    // NOTE: Only reserves the address space for the largest buffer there can be - it starts out
+    // 0 x 0, and ResizeTerminalBuffer commits memory as it grows
     terminal_buffer Result = {0};
 
-    size_t TotalSize = sizeof(renderer_cell)*DimX*DimY;
-    Result.Cells = VirtualAlloc(0, TotalSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
-    if(Result.Cells)
+    size_t TotalSize = sizeof(renderer_cell)*MaxDimX*MaxDimY;
+    Result.Cells = VirtualAlloc(0, TotalSize, MEM_RESERVE, PAGE_READWRITE);
+    Result.RowLengths = VirtualAlloc(0, MaxDimY*sizeof(uint32_t), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    if(Result.Cells && Result.RowLengths)
     {
-        Result.DimX = DimX;
-        Result.DimY = DimY;
+        Result.MaxCellCount = MaxDimX*MaxDimY;
+        Result.MaxDimY = MaxDimY;
     }
 
     return Result;
@@ -19,8 +22,15 @@ static void DeallocateTerminalBuffer(terminal_buffer *Buffer)
     {
         VirtualFree(Buffer->Cells, 0, MEM_RELEASE);
         Buffer->DimX = Buffer->DimY = 0;
+        Buffer->MaxCellCount = Buffer->CommittedCellCount = Buffer->MaxDimY = 0;
         Buffer->Cells = 0;
     }
+
+    if(Buffer && Buffer->RowLengths)
+    {
+        VirtualFree(Buffer->RowLengths, 0, MEM_RELEASE);
+        Buffer->RowLengths = 0;
+    }
 }
 
 static DWORD GetPipePendingDataCount(HANDLE Pipe)
@@ -31,30 +41,262 @@ static DWORD GetPipePendingDataCount(HANDLE Pipe)
     return Result;
 }
 
-static void UpdateLineEnd(example_terminal *Terminal, size_t ToP)
+static line_index AllocateLineIndex(size_t LineCapacity)
+{
+    line_index Result = {0};
+
+    Assert(IsPowerOfTwo(LineCapacity));
+    Assert(LineCapacity > LINE_BLOCK_SIZE);
+
+    // NOTE: At most one props change is pushed per line, so the props ring can never
+    // wrap over props that a kept line still refers to.
+    size_t LineSize = LineCapacity*sizeof(compact_line);
+    size_t BlockSize = (LineCapacity >> LINE_BLOCK_SHIFT)*sizeof(line_block);
+    size_t PropsSize = LineCapacity*sizeof(glyph_props);
+    char *Memory = VirtualAlloc(0, LineSize + BlockSize + PropsSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    if(Memory)
+    {
+        Result.LineMask = LineCapacity - 1;
+        Result.Lines = (compact_line *)Memory;
+        Result.Blocks = (line_block *)(Memory + LineSize);
+        Result.Props = (glyph_props *)(Memory + LineSize + BlockSize);
+    }
+
+    return Result;
+}
+
+static size_t GetKeptLineCountAt(line_index *Index, size_t LineCount)
 {
-    Terminal->Lines[Terminal->CurrentLineIndex].OnePastLastP = ToP;
+    // NOTE: One block's worth of lines is held back, so the block the oldest kept line
+    // counts from is never the one that got overwritten by the newest block.
+    size_t MaxLineCount = Index->LineMask + 1 - LINE_BLOCK_SIZE;
+    size_t Result = (LineCount < MaxLineCount) ? LineCount : MaxLineCount;
+    return Result;
 }
 
-static void LineFeed(example_terminal *Terminal, size_t AtP, size_t NextLineStart, glyph_props AtProps)
+static size_t GetKeptLineCount(line_index *Index)
 {
-    UpdateLineEnd(Terminal, AtP);
-    ++Terminal->CurrentLineIndex;
-    if(Terminal->CurrentLineIndex >= Terminal->MaxLineCount)
+    size_t Result = GetKeptLineCountAt(Index, Index->LineCount);
+    return Result;
+}
+
+static size_t GetOldestLineNumber(line_index *Index)
+{
+    size_t Result = Index->LineCount - GetKeptLineCount(Index);
+    return Result;
+}
+
+static int IsLineStillKept(line_index *Index, size_t LineNumber)
+{
+    // NOTE: For readers on other threads, which have to check this after reading a line, since
+    // the ingest thread may have appended enough lines to reuse its slot in the meantime.
+    _ReadWriteBarrier();
+    size_t LineCount = *(volatile size_t *)&Index->LineCount;
+    int Result = ((LineNumber < LineCount) &&
+                  (LineNumber >= (LineCount - GetKeptLineCountAt(Index, LineCount))));
+    return Result;
+}
+
+static size_t GetLineIndexFootprint(line_index *Index)
+{
+    size_t KeptLineCount = GetKeptLineCount(Index);
+    size_t KeptPropsCount = (Index->PropsCount < KeptLineCount) ? Index->PropsCount : KeptLineCount;
+    size_t Result = (KeptLineCount*sizeof(compact_line) +
+                     ((KeptLineCount + LINE_BLOCK_SIZE - 1) >> LINE_BLOCK_SHIFT)*sizeof(line_block) +
+                     KeptPropsCount*sizeof(glyph_props));
+    return Result;
+}
+
+static compact_line *GetCompactLine(line_index *Index, size_t LineNumber)
+{
+    compact_line *Result = Index->Lines + (LineNumber & Index->LineMask);
+    return Result;
+}
+
+static int PropsAreEqual(glyph_props A, glyph_props B)
+{
+    int Result = ((A.Foreground == B.Foreground) &&
+                  (A.Background == B.Background) &&
+                  (A.Flags == B.Flags));
+    return Result;
+}
+
+static void AppendLine(line_index *Index, size_t FirstP, glyph_props Props)
+{
+    // NOTE: The new count has to be visible before the reused slot is cleared, pairing with the
+    // fence in SetLineRowCount, so a row count written by layout for the line that used to be in
+    // this slot either sees the lap or gets cleared here.
+    size_t LineNumber = Index->LineCount;
+    *(volatile size_t *)&Index->LineCount = LineNumber + 1;
+    _WriteBarrier();
+
+    compact_line *Line = GetCompactLine(Index, LineNumber);
+    Line->LengthAndFlags = 0;
+    Line->RowCount = 0;
+    Line->RowCountKey = 0;
+    Line->ColumnCount = 0;
+
+    if(!Index->PropsCount ||
+       !PropsAreEqual(Index->Props[(Index->PropsCount - 1) & Index->LineMask], Props))
+    {
+        Index->Props[Index->PropsCount++ & Index->LineMask] = Props;
+        Line->LengthAndFlags |= LineFlag_PropsChanged;
+    }
+
+    if((LineNumber & (LINE_BLOCK_SIZE - 1)) == 0)
+    {
+        line_block *Block = Index->Blocks + ((LineNumber & Index->LineMask) >> LINE_BLOCK_SHIFT);
+        Block->FirstP = FirstP;
+        Block->PropsIndex = Index->PropsCount - 1;
+    }
+
+    Index->CurrentFirstP = FirstP;
+}
+
+static void ResetLineIndex(line_index *Index, size_t FirstP, glyph_props Props)
+{
+    Index->LineCount = 0;
+    Index->PropsCount = 0;
+    Index->PendingReturn = 0;
+    AppendLine(Index, FirstP, Props);
+}
+
+static size_t GetCurrentLineLength(line_index *Index)
+{
+    size_t Result = GetCompactLine(Index, Index->LineCount - 1)->LengthAndFlags & LineLength_Mask;
+    return Result;
+}
+
+static void MarkCurrentLineComplex(line_index *Index)
+{
+    GetCompactLine(Index, Index->LineCount - 1)->LengthAndFlags |= LineFlag_ContainsComplexChars;
+}
+
+static void MarkCurrentLineNewline(line_index *Index)
+{
+    GetCompactLine(Index, Index->LineCount - 1)->LengthAndFlags |= LineFlag_EndsWithNewline;
+}
+
+static void AddCurrentLineColumns(line_index *Index, uint32_t ColumnCount, int Unknown)
+{
+    compact_line *Line = GetCompactLine(Index, Index->LineCount - 1);
+    if(Unknown)
+    {
+        Line->ColumnCount = LINE_COLUMNS_UNKNOWN;
+    }
+    else if(Line->ColumnCount != LINE_COLUMNS_UNKNOWN)
+    {
+        Line->ColumnCount += ColumnCount;
+    }
+}
+
+static example_line DecodeLine(line_index *Index, compact_line *Line, size_t FirstP, size_t PropsIndex)
+{
+    example_line Result;
+
+    Result.FirstP = FirstP;
+    Result.OnePastLastP = FirstP + (Line->LengthAndFlags & LineLength_Mask);
+    Result.ContainsComplexChars = (Line->LengthAndFlags & LineFlag_ContainsComplexChars);
+    Result.StartingProps = Index->Props[PropsIndex & Index->LineMask];
+    Result.PropsIndex = PropsIndex;
+
+    return Result;
+}
+
+static example_line WalkToLine(line_index *Index, size_t LineNumber)
+{
+    size_t At = LineNumber & ~(size_t)(LINE_BLOCK_SIZE - 1);
+    line_block *Block = Index->Blocks + ((At & Index->LineMask) >> LINE_BLOCK_SHIFT);
+    size_t FirstP = Block->FirstP;
+    size_t PropsIndex = Block->PropsIndex;
+
+    compact_line *Line = GetCompactLine(Index, At);
+    while(At < LineNumber)
+    {
+        FirstP += (Line->LengthAndFlags & LineLength_Mask);
+        Line = GetCompactLine(Index, ++At);
+        if(Line->LengthAndFlags & LineFlag_PropsChanged)
+        {
+            ++PropsIndex;
+        }
+    }
+
+    example_line Result = DecodeLine(Index, Line, FirstP, PropsIndex);
+    return Result;
+}
+
+static example_line GetLine(line_index *Index, size_t LineNumber)
+{
+    // NOTE: Costs at most LINE_BLOCK_SIZE - 1 steps from the block checkpoint.  When walking
+    // forward through consecutive lines, use GetNextLine instead.
+    Assert((LineNumber >= GetOldestLineNumber(Index)) && (LineNumber < Index->LineCount));
+
+    example_line Result = WalkToLine(Index, LineNumber);
+    return Result;
+}
+
+static example_line GetNextLine(line_index *Index, example_line *Prev, size_t LineNumber)
+{
+    compact_line *Line = GetCompactLine(Index, LineNumber);
+    size_t PropsIndex = Prev->PropsIndex + ((Line->LengthAndFlags & LineFlag_PropsChanged) ? 1 : 0);
+
+    example_line Result = DecodeLine(Index, Line, Prev->OnePastLastP, PropsIndex);
+    return Result;
+}
+
+static size_t FindLineNumber(line_index *Index, size_t AbsoluteP)
+{
+    // NOTE: Binary search on the block checkpoints, then walk the block.  Positions before the
+    // oldest kept line come back as the oldest kept line.
+    size_t OldestLineNumber = GetOldestLineNumber(Index);
+    size_t CurrentLineNumber = Index->LineCount - 1;
+    size_t BlockMask = Index->LineMask >> LINE_BLOCK_SHIFT;
+
+    size_t LowBlock = OldestLineNumber >> LINE_BLOCK_SHIFT;
+    size_t HighBlock = CurrentLineNumber >> LINE_BLOCK_SHIFT;
+    while(LowBlock < HighBlock)
     {
-        Terminal->CurrentLineIndex = 0;
+        size_t MidBlock = (LowBlock + HighBlock + 1) / 2;
+        if(Index->Blocks[MidBlock & BlockMask].FirstP <= AbsoluteP)
+        {
+            LowBlock = MidBlock;
+        }
+        else
+        {
+            HighBlock = MidBlock - 1;
+        }
     }
 
-    example_line *Line = Terminal->Lines + Terminal->CurrentLineIndex;
-    Line->FirstP = NextLineStart;
-    Line->OnePastLastP = NextLineStart;
-    Line->ContainsComplexChars = 0;
-    Line->StartingProps = AtProps;
+    size_t Result = LowBlock << LINE_BLOCK_SHIFT;
+    if(Result < OldestLineNumber) Result = OldestLineNumber;
 
-    if(Terminal->LineCount <= Terminal->CurrentLineIndex)
+    example_line Line = GetLine(Index, Result);
+    while((Result < CurrentLineNumber) && (Line.OnePastLastP <= AbsoluteP))
     {
-        Terminal->LineCount = Terminal->CurrentLineIndex + 1;
+        Line = GetNextLine(Index, &Line, ++Result);
     }
+
+    return Result;
+}
+
+static void UpdateLineEnd(example_terminal *Terminal, size_t ToP)
+{
+    line_index *Index = &Terminal->Lines;
+    compact_line *Line = GetCompactLine(Index, Index->LineCount - 1);
+
+    Assert(ToP >= Index->CurrentFirstP);
+    size_t Length = ToP - Index->CurrentFirstP;
+    Assert(Length <= LineLength_Mask);
+
+    Line->LengthAndFlags = (Line->LengthAndFlags & ~LineLength_Mask) | (uint32_t)Length;
+}
+
+static void LineFeed(example_terminal *Terminal, size_t AtP, glyph_props AtProps)
+{
+    // NOTE: Lines have to stay contiguous for the line index's position deltas to work, so
+    // the next line always starts exactly where this one ends.
+    UpdateLineEnd(Terminal, AtP);
+    AppendLine(&Terminal->Lines, AtP, AtProps);
 }
 
 static int IsInBounds(terminal_buffer *Buffer, terminal_point Point)
@@ -129,6 +371,12 @@ static int IsDirectCodepoint(wchar_t CodePoint)
     return Result;
 }
 
+static int IsUTF8Extension(char A)
+{
+    int Result = ((A & 0xc0) == 0x80);
+    return Result;
+}
+
 static renderer_cell *GetCell(terminal_buffer *Buffer, terminal_point Point)
 {
     renderer_cell *Result = IsInBounds(Buffer, Point) ? (Buffer->Cells + Point.Y*Buffer->DimX + Point.X) : 0;
@@ -147,22 +395,237 @@ static void ClearCellCount(example_terminal *Terminal, int32_t Count, renderer_c
     }
 }
 
+static void ReverseCells(renderer_cell *First, renderer_cell *Last)
+{
+    while(First < Last)
+    {
+        renderer_cell Temp = *First;
+        *First++ = *--Last;
+        *Last = Temp;
+    }
+}
+
+static void ReverseRowLengths(uint32_t *First, uint32_t *Last)
+{
+    while(First < Last)
+    {
+        uint32_t Temp = *First;
+        *First++ = *--Last;
+        *Last = Temp;
+    }
+}
+
+static int ResizeTerminalBuffer(example_terminal *Terminal, terminal_buffer *Buffer, uint32_t DimX, uint32_t DimY)
+{
+    /* NOTE: Resizes without moving the buffer, so a resize only costs page faults the first time
+       the buffer gets that big.  Whatever was on screen stays where it was, cropped to the new
+       size, and anything newly exposed is past the end of its row, so it is blank.  When there
+       are fewer rows, the top ones are the ones dropped, since the bottom is where the cursor and
+       the newest output are.
+
+       The rows are a ring starting at FirstLineY, so first they are rotated to start at zero
+       (by reversing the two parts and then the whole thing), the rows being kept are moved up
+       to the top if any are dropped, and then they are moved to the new row stride -
+       bottom up when rows get longer, top down when they get shorter, so no row is overwritten
+       before it has been moved.
+    */
+    int Result = 0;
+
+    uint32_t CellCount = DimX*DimY;
+    if(Buffer->Cells && (CellCount <= Buffer->MaxCellCount) && (DimY <= Buffer->MaxDimY))
+    {
+        Result = 1;
+        if(CellCount > Buffer->CommittedCellCount)
+        {
+            Result = (VirtualAlloc(Buffer->Cells, CellCount*sizeof(renderer_cell), MEM_COMMIT, PAGE_READWRITE) != 0);
+            if(Result)
+            {
+                Buffer->CommittedCellCount = CellCount;
+            }
+        }
+    }
+
+    if(Result)
+    {
+        renderer_cell *Cells = Buffer->Cells;
+        uint32_t *RowLengths = Buffer->RowLengths;
+        uint32_t OldDimX = Buffer->DimX;
+        uint32_t OldDimY = Buffer->DimY;
+        if(Buffer->FirstLineY && (Buffer->FirstLineY < OldDimY))
+        {
+            renderer_cell *Split = Cells + Buffer->FirstLineY*OldDimX;
+            renderer_cell *End = Cells + OldDimX*OldDimY;
+            ReverseCells(Cells, Split);
+            ReverseCells(Split, End);
+            ReverseCells(Cells, End);
+
+            ReverseRowLengths(RowLengths, RowLengths + Buffer->FirstLineY);
+            ReverseRowLengths(RowLengths + Buffer->FirstLineY, RowLengths + OldDimY);
+            ReverseRowLengths(RowLengths, RowLengths + OldDimY);
+        }
+
+        uint32_t CopyY = (OldDimY < DimY) ? OldDimY : DimY;
+        uint32_t DropY = OldDimY - CopyY;
+        if(DropY)
+        {
+            for(uint32_t Row = 0; Row < CopyY; ++Row)
+            {
+                RowLengths[Row] = RowLengths[Row + DropY];
+                for(uint32_t X = 0; X < RowLengths[Row]; ++X)
+                {
+                    Cells[Row*OldDimX + X] = Cells[(Row + DropY)*OldDimX + X];
+                }
+            }
+        }
+
+        if(DimX > OldDimX)
+        {
+            for(uint32_t Row = CopyY; Row--;)
+            {
+                for(uint32_t X = RowLengths[Row]; X--;)
+                {
+                    Cells[Row*DimX + X] = Cells[Row*OldDimX + X];
+                }
+            }
+        }
+        else if(DimX < OldDimX)
+        {
+            for(uint32_t Row = 0; Row < CopyY; ++Row)
+            {
+                if(RowLengths[Row] > DimX) RowLengths[Row] = DimX;
+                for(uint32_t X = 0; X < RowLengths[Row]; ++X)
+                {
+                    Cells[Row*DimX + X] = Cells[Row*OldDimX + X];
+                }
+            }
+        }
+
+        for(uint32_t Row = CopyY; Row < DimY; ++Row)
+        {
+            RowLengths[Row] = 0;
+        }
+
+        Buffer->DimX = DimX;
+        Buffer->DimY = DimY;
+        Buffer->FirstLineY = 0;
+
+        // NOTE: The rows moved, so the blink runs no longer say where anything is until the next Clear
+        Buffer->BlinkRunCount = 0;
+        Buffer->BlinkOverflow = 1;
+    }
+
+    return Result;
+}
+
+static void AddBlinkRun(terminal_buffer *Buffer, uint32_t X, uint32_t Y, uint32_t Count)
+{
+    blink_run *Last = Buffer->BlinkRuns + Buffer->BlinkRunCount - 1;
+    if(Buffer->BlinkRunCount && (Last->Y == Y) && ((uint32_t)(Last->X + Last->Count) == X))
+    {
+        Last->Count += (uint16_t)Count;
+    }
+    else if(Buffer->BlinkRunCount < MAX_BLINK_RUN_COUNT)
+    {
+        blink_run *Run = Buffer->BlinkRuns + Buffer->BlinkRunCount++;
+        Run->X = (uint16_t)X;
+        Run->Y = (uint16_t)Y;
+        Run->Count = (uint16_t)Count;
+        Run->Reserved = 0;
+    }
+    else
+    {
+        Buffer->BlinkOverflow = 1;
+    }
+}
+
+static void RemoveBlinkRuns(terminal_buffer *Buffer, uint32_t Y)
+{
+    uint32_t KeptCount = 0;
+    for(uint32_t RunIndex = 0; RunIndex < Buffer->BlinkRunCount; ++RunIndex)
+    {
+        if(Buffer->BlinkRuns[RunIndex].Y != Y)
+        {
+            Buffer->BlinkRuns[KeptCount++] = Buffer->BlinkRuns[RunIndex];
+        }
+    }
+    Buffer->BlinkRunCount = KeptCount;
+}
+
+static int HasBlinkRuns(terminal_buffer *Buffer, uint32_t FirstY, uint32_t RowCount)
+{
+    int Result = Buffer->BlinkOverflow;
+    for(uint32_t RunIndex = 0; !Result && (RunIndex < Buffer->BlinkRunCount); ++RunIndex)
+    {
+        Result = (((Buffer->BlinkRuns[RunIndex].Y - FirstY + Buffer->DimY) % Buffer->DimY) < RowCount);
+    }
+
+    return Result;
+}
+
+static void AddBlinkRunsFromRow(terminal_buffer *Buffer, uint32_t Y)
+{
+    // NOTE: For rows that were copied in whole rather than written a cell at a time
+    renderer_cell *Row = Buffer->Cells + Y*Buffer->DimX;
+    for(uint32_t X = 0; X < Buffer->RowLengths[Y]; ++X)
+    {
+        if(Row[X].Foreground & (TerminalCell_Blinking << 24))
+        {
+            AddBlinkRun(Buffer, X, Y, 1);
+        }
+    }
+}
+
+static renderer_cell *GetCellsForWrite(example_terminal *Terminal, terminal_point Point, uint32_t Count, uint32_t Flags)
+{
+    // NOTE: For writing Count cells from Point on, which have to fit in the row.  The row's length
+    // is extended over them, and any cells it skips over to get there are cleared, since they
+    // could hold anything.  Flags are the props the cells are written with.
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    renderer_cell *Result = GetCell(Buffer, Point);
+    if(Result)
+    {
+        if(Flags & TerminalCell_Blinking)
+        {
+            AddBlinkRun(Buffer, Point.X, Point.Y, Count);
+        }
+
+        uint32_t *Length = Buffer->RowLengths + Point.Y;
+        if(*Length < (uint32_t)Point.X)
+        {
+            ClearCellCount(Terminal, Point.X - *Length, Buffer->Cells + Point.Y*Buffer->DimX + *Length);
+        }
+        if(*Length < (Point.X + Count))
+        {
+            *Length = Point.X + Count;
+        }
+    }
+
+    return Result;
+}
+
 static void ClearLine(example_terminal *Terminal, terminal_buffer *Buffer, int32_t Y)
 {
     terminal_point Point = {0, Y};
     if(IsInBounds(Buffer, Point))
     {
-        ClearCellCount(Terminal, Buffer->DimX, GetCell(Buffer, Point));
+        Buffer->RowLengths[Y] = 0;
+        RemoveBlinkRuns(Buffer, Y);
     }
 }
 
 static void Clear(example_terminal *Terminal, terminal_buffer *Buffer)
 {
-    ClearCellCount(Terminal, Buffer->DimX*Buffer->DimY, Buffer->Cells);
+    for(uint32_t Y = 0; Y < Buffer->DimY; ++Y)
+    {
+        Buffer->RowLengths[Y] = 0;
+    }
+    Buffer->BlinkRunCount = 0;
+    Buffer->BlinkOverflow = 0;
 }
 
 static void AdvanceRowNoClear(example_terminal *Terminal, terminal_point *Point)
 {
+    ++Terminal->RowAdvanceCount;
     Point->X = 0;
     ++Point->Y;
     if(Point->Y >= (int32_t)Terminal->ScreenBuffer.DimY)
@@ -206,6 +669,68 @@ static void SetCellDirect(gpu_glyph_index GPUIndex, glyph_props Props, renderer_
     Dest->Background = Background;
 }
 
+static size_t GetDirectRunLength(char *Data, size_t Count)
+{
+    // NOTE: Returns how many leading bytes are direct-mapped codepoints, checking 16 bytes at a time.
+    // Bytes >= 0x80 are negative as signed chars, so they fail the lower bound along with the control codes.
+    __m128i BelowDirect = _mm_set1_epi8(MinDirectCodepoint - 1);
+    __m128i AboveDirect = _mm_set1_epi8(MaxDirectCodepoint + 1);
+
+    size_t Result = 0;
+    int Stopped = 0;
+    while(!Stopped && ((Count - Result) >= 16))
+    {
+        __m128i Batch = _mm_loadu_si128((__m128i *)(Data + Result));
+        __m128i Direct = _mm_and_si128(_mm_cmpgt_epi8(Batch, BelowDirect),
+                                       _mm_cmplt_epi8(Batch, AboveDirect));
+        int Check = ~_mm_movemask_epi8(Direct) & 0xffff;
+        if(Check)
+        {
+            Result += _tzcnt_u32(Check);
+            Stopped = 1;
+        }
+        else
+        {
+            Result += 16;
+        }
+    }
+
+    if(!Stopped)
+    {
+        while((Result < Count) && IsDirectCodepoint(Data[Result]))
+        {
+            ++Result;
+        }
+    }
+
+    return Result;
+}
+
+static void SetCellDirectRun(gpu_glyph_index *DirectTable, glyph_props Props, size_t Count, char *Data, renderer_cell *Dest)
+{
+    // NOTE: This is SetCellDirect for a whole run of direct codepoints - the colors and flags
+    // are resolved once, and then each cell is just a table lookup for its glyph.
+    renderer_cell Template;
+    gpu_glyph_index ZeroIndex = {0};
+    SetCellDirect(ZeroIndex, Props, &Template);
+
+    if(Props.Flags & TerminalCell_Invisible)
+    {
+        while(Count--)
+        {
+            *Dest++ = Template;
+        }
+    }
+    else
+    {
+        while(Count--)
+        {
+            Template.GlyphIndex = DirectTable[*Data++ - MinDirectCodepoint].Value;
+            *Dest++ = Template;
+        }
+    }
+}
+
 static void ClearProps(example_terminal *Terminal, glyph_props *Props)
 {
     Props->Foreground = Terminal->DefaultForegroundColor;
@@ -301,15 +826,28 @@ static void ParseLines(example_terminal *Terminal, source_buffer_range Range, cu
        past that point.
     */
 
+    int64_t ParseStartTicks = GetTelemetryTicks();
+
     __m128i Carriage = _mm_set1_epi8('\n');
     __m128i Escape = _mm_set1_epi8('\x1b');
     __m128i Complex = _mm_set1_epi8(0x80);
+    __m128i Return = _mm_set1_epi8('\r');
+    __m128i ExtensionMask = _mm_set1_epi8((char)0xc0);
+
+    // NOTE: Alongside finding the line ends, this counts the columns each line takes up, which
+    // is every byte that isn't a UTF-8 extension byte or a carriage return.  A carriage return
+    // followed by a newline is harmless, but one followed by anything else sends the rest of the
+    // line back over the start of it, so those lines are left for layout to measure.
+    line_index *Index = &Terminal->Lines;
+    int PendingReturn = Index->PendingReturn;
 
     size_t SplitLineAtCount = 4096;
     size_t LastP = Range.AbsoluteP;
     while(Range.Count)
     {
         __m128i ContainsComplex = _mm_setzero_si128();
+        uint32_t ColumnCount = 0;
+        int StrayReturn = 0;
         size_t Count = Range.Count;
         if(Count > SplitLineAtCount) Count = SplitLineAtCount;
         char *Data = Range.Data;
@@ -319,11 +857,23 @@ static void ParseLines(example_terminal *Terminal, source_buffer_range Range, cu
             __m128i TestC = _mm_cmpeq_epi8(Batch, Carriage);
             __m128i TestE = _mm_cmpeq_epi8(Batch, Escape);
             __m128i TestX = _mm_and_si128(Batch, Complex);
+            __m128i TestR = _mm_cmpeq_epi8(Batch, Return);
+            __m128i TestU = _mm_cmpeq_epi8(_mm_and_si128(Batch, ExtensionMask), Complex);
             __m128i Test = _mm_or_si128(TestC, TestE);
             int Check = _mm_movemask_epi8(Test);
+            int Newlines = _mm_movemask_epi8(TestC);
+            int Returns = _mm_movemask_epi8(TestR);
+            int NonColumns = _mm_movemask_epi8(_mm_or_si128(TestR, TestU));
+
+            StrayReturn |= (PendingReturn && !(Newlines & 1));
             if(Check)
             {
                 int Advance = _tzcnt_u32(Check);
+                int Used = (1 << Advance) - 1;
+                ColumnCount += (uint32_t)_mm_popcnt_u32(~NonColumns & Used);
+                StrayReturn |= ((Returns & Used & ~(Newlines >> 1)) != 0);
+                PendingReturn = 0;
+
                 __m128i MaskX = _mm_loadu_si128((__m128i *)(OverhangMask + 16 - Advance));
                 TestX = _mm_and_si128(MaskX, TestX);
                 ContainsComplex = _mm_or_si128(ContainsComplex, TestX);
@@ -332,6 +882,10 @@ static void ParseLines(example_terminal *Terminal, source_buffer_range Range, cu
                 break;
             }
 
+            ColumnCount += 16 - (uint32_t)_mm_popcnt_u32(NonColumns);
+            StrayReturn |= ((Returns & 0x7fff & ~(Newlines >> 1)) != 0);
+            PendingReturn = (Returns >> 15) & 1;
+
             ContainsComplex = _mm_or_si128(ContainsComplex, TestX);
             Count -= 16;
             Data += 16;
@@ -339,36 +893,57 @@ static void ParseLines(example_terminal *Terminal, source_buffer_range Range, cu
 
         Range = ConsumeCount(Range, Data - Range.Data);
 
-        Terminal->Lines[Terminal->CurrentLineIndex].ContainsComplexChars |=
-            _mm_movemask_epi8(ContainsComplex);
+        if(_mm_movemask_epi8(ContainsComplex))
+        {
+            MarkCurrentLineComplex(Index);
+        }
+        AddCurrentLineColumns(Index, ColumnCount, StrayReturn);
 
         if(AtEscape(&Range))
         {
             size_t FeedAt = Range.AbsoluteP;
             if(ParseEscape(Terminal, &Range, Cursor))
             {
-                LineFeed(Terminal, FeedAt, FeedAt, Cursor->Props);
+                // NOTE: The new line starts with the jump, so only layout can say where it goes
+                LineFeed(Terminal, FeedAt, Cursor->Props);
+                AddCurrentLineColumns(Index, 0, 1);
             }
-        }
+            else
+            {
+                AddCurrentLineColumns(Index, 0, PendingReturn);
+            }
+            PendingReturn = 0;
+        }
         else
         {
             char Token = GetToken(&Range);
             if(Token == '\n')
             {
-                LineFeed(Terminal, Range.AbsoluteP, Range.AbsoluteP, Cursor->Props);
+                MarkCurrentLineNewline(Index);
+                LineFeed(Terminal, Range.AbsoluteP, Cursor->Props);
             }
-            else if(Token < 0) // TODO(casey): Not sure what is a "combining char" here, really, but this is a rough test
+            else
             {
-                Terminal->Lines[Terminal->CurrentLineIndex].ContainsComplexChars = 1;
+                if(Token < 0) // TODO(casey): Not sure what is a "combining char" here, really, but this is a rough test
+                {
+                    MarkCurrentLineComplex(Index);
+                }
+                AddCurrentLineColumns(Index, ((Token != '\r') && !IsUTF8Extension(Token)), PendingReturn);
             }
+            PendingReturn = (Token == '\r');
         }
 
         UpdateLineEnd(Terminal, Range.AbsoluteP);
-        if(GetLineLength(&Terminal->Lines[Terminal->CurrentLineIndex]) > SplitLineAtCount)
+        if(GetCurrentLineLength(Index) > SplitLineAtCount)
         {
-            LineFeed(Terminal, Range.AbsoluteP, Range.AbsoluteP, Cursor->Props);
+            LineFeed(Terminal, Range.AbsoluteP, Cursor->Props);
+            PendingReturn = 0;
         }
     }
+
+    Index->PendingReturn = PendingReturn;
+
+    Terminal->Telemetry.ParseTicks += GetTelemetryTicks() - ParseStartTicks;
 }
 
 static void ParseWithUniscribe(example_terminal *Terminal, source_buffer_range UTF8Range, cursor_state *Cursor)
@@ -461,7 +1036,7 @@ static void ParseWithUniscribe(example_terminal *Terminal, source_buffer_range U
                 wchar_t CodePoint = Run[0];
                 if((ThisCount == 1) && IsDirectCodepoint(CodePoint))
                 {
-                    renderer_cell *Cell = GetCell(&Terminal->ScreenBuffer, Cursor->At);
+                    renderer_cell *Cell = GetCellsForWrite(Terminal, Cursor->At, 1, Cursor->Props.Flags);
                     if(Cell)
                     {
                         glyph_props Props = Cursor->Props;
@@ -486,7 +1061,7 @@ static void ParseWithUniscribe(example_terminal *Terminal, source_buffer_range U
                         TileIndex < GlyphDim.TileCount;
                         ++TileIndex)
                     {
-                        renderer_cell *Cell = GetCell(&Terminal->ScreenBuffer, Cursor->At);
+                        renderer_cell *Cell = GetCellsForWrite(Terminal, Cursor->At, 1, Cursor->Props.Flags);
                         if(Cell)
                         {
                             glyph_hash TileHash = ComputeHashForTileIndex(RunHash, TileIndex);
@@ -495,11 +1070,14 @@ static void ParseWithUniscribe(example_terminal *Terminal, source_buffer_range U
                             {
                                 if(!Prepped)
                                 {
+                                    int64_t RasterStartTicks = GetTelemetryTicks();
                                     PrepareTilesForTransfer(&Terminal->GlyphGen, &Terminal->Renderer, ThisCount, Run, GlyphDim);
+                                    Terminal->Telemetry.Current.RasterTicks += GetTelemetryTicks() - RasterStartTicks;
                                     Prepped = 1;
                                 }
 
                                 TransferTile(&Terminal->GlyphGen, &Terminal->Renderer, TileIndex, Entry.GPUIndex);
+                                ++Terminal->Telemetry.Current.AtlasUploadCount;
                                 UpdateGlyphCacheEntry(Terminal->GlyphTable, Entry.ID, GlyphState_Rasterized, Entry.DimX, Entry.DimY);
                             }
 
@@ -584,8 +1162,36 @@ static int ParseLineIntoGlyphs(example_terminal *Terminal, source_buffer_range R
         {
             // NOTE(casey): It's not an escape, and we know there are only simple characters on the line.
 
+            // NOTE: Runs of printable ASCII are written in bulk, up to the next control code or the
+            // end of the row, so the bounds check and wrap check happen once per run instead of once per byte.
+            renderer_cell *RunCell = GetCell(&Terminal->ScreenBuffer, Cursor->At);
+            size_t RunCount = GetDirectRunLength(Range.Data, Range.Count);
+            if(RunCount && RunCell)
+            {
+                size_t RowRemaining = Terminal->ScreenBuffer.DimX - Cursor->At.X;
+                if(RunCount > RowRemaining)
+                {
+                    RunCount = RowRemaining;
+                }
+                RunCell = GetCellsForWrite(Terminal, Cursor->At, (uint32_t)RunCount, Cursor->Props.Flags);
+
+                SetCellDirectRun(Terminal->ReservedTileTable, Cursor->Props, RunCount, Range.Data, RunCell);
+                Range = ConsumeCount(Range, RunCount);
+
+                Cursor->At.X += (int32_t)RunCount - 1;
+                AdvanceColumn(Terminal, &Cursor->At);
+                continue;
+            }
+            else if(RunCount && !Terminal->LineWrap && (Cursor->At.X >= (int32_t)Terminal->ScreenBuffer.DimX))
+            {
+                // NOTE: Without line wrap, anything past the right edge is never visible.
+                Range = ConsumeCount(Range, RunCount);
+                Cursor->At.X += (int32_t)RunCount;
+                continue;
+            }
+
             wchar_t CodePoint = GetToken(&Range);
-            renderer_cell *Cell = GetCell(&Terminal->ScreenBuffer, Cursor->At);
+            renderer_cell *Cell = GetCellsForWrite(Terminal, Cursor->At, 1, Cursor->Props.Flags);
             if(Cell)
             {
                 gpu_glyph_index GPUIndex = {0};
@@ -600,8 +1206,11 @@ static int ParseLineIntoGlyphs(example_terminal *Terminal, source_buffer_range R
                     glyph_state Entry = FindGlyphEntryByHash(Terminal->GlyphTable, RunHash);
                     if(Entry.FilledState != GlyphState_Rasterized)
                     {
+                        int64_t RasterStartTicks = GetTelemetryTicks();
                         PrepareTilesForTransfer(&Terminal->GlyphGen, &Terminal->Renderer, 1, &CodePoint, GetSingleTileUnitDim());
+                        Terminal->Telemetry.Current.RasterTicks += GetTelemetryTicks() - RasterStartTicks;
                         TransferTile(&Terminal->GlyphGen, &Terminal->Renderer, 0, Entry.GPUIndex);
+                        ++Terminal->Telemetry.Current.AtlasUploadCount;
                         UpdateGlyphCacheEntry(Terminal->GlyphTable, Entry.ID, GlyphState_Rasterized, Entry.DimX, Entry.DimY);
                     }
                     GPUIndex = Entry.GPUIndex;
@@ -617,8 +1226,254 @@ static int ParseLineIntoGlyphs(example_terminal *Terminal, source_buffer_range R
     return CursorJumped;
 }
 
+static void CommitAndParse(example_terminal *Terminal, source_buffer_range Dest)
+{
+    // NOTE: Everything that goes into the scrollback comes through here, which is what lets a
+    // recording capture it all
+    CommitWrite(&Terminal->ScrollBackBuffer, Dest.Count);
+    RecordData(&Terminal->Recorder, Dest.Data, Dest.Count);
+    ParseLines(Terminal, Dest, &Terminal->RunningCursor);
+}
+
+static void UpdateIngestPolicy(ingest_policy *Policy, size_t IngestedCount, int64_t NowTicks)
+{
+    Policy->SampleBytes += IngestedCount;
+
+    int64_t Elapsed = NowTicks - Policy->SampleStartTicks;
+    if(Elapsed >= (Policy->TicksPerSecond / 100))
+    {
+        int64_t Rate = (int64_t)Policy->SampleBytes * Policy->TicksPerSecond / Elapsed;
+        Policy->BytesPerSecond += (Rate - Policy->BytesPerSecond) / 4;
+        Policy->SampleBytes = 0;
+        Policy->SampleStartTicks = NowTicks;
+    }
+}
+
+static size_t GetIngestReadSize(ingest_policy *Policy)
+{
+    size_t Result = (size_t)(Policy->BytesPerSecond * Policy->LatencyTargetMS / 1000);
+    if(Result < Policy->MinReadSize) Result = Policy->MinReadSize;
+    if(Result > Policy->MaxReadSize) Result = Policy->MaxReadSize;
+    return Result;
+}
+
+static int UpdateFlowControl(example_terminal *Terminal, int64_t NowTicks)
+{
+    // NOTE: Returns whether the producer is being blocked this batch.  With rendering off,
+    // nothing is ever laid out, so there is nothing to hold back for.
+    flow_control *Flow = &Terminal->Flow;
+    source_buffer *Buffer = &Terminal->ScrollBackBuffer;
+    size_t CurrentP = GetCurrentAbsoluteP(Buffer);
+    size_t LaidOutP = Terminal->DisableRendering ? CurrentP : Flow->LaidOutP;
+    size_t Backlog = CurrentP - LaidOutP;
+
+    // NOTE: Dropped bytes are the ones that went out of the ring before any frame was laid out
+    // that far, whichever mode is on - BlockProducer should keep it at zero.
+    size_t HorizonP = (CurrentP > Buffer->DataSize) ? (CurrentP - Buffer->DataSize) : 0;
+    size_t DropFromP = (Flow->DroppedThroughP > LaidOutP) ? Flow->DroppedThroughP : LaidOutP;
+    if(HorizonP > DropFromP)
+    {
+        Flow->DroppedBytes += HorizonP - DropFromP;
+    }
+    if(Flow->DroppedThroughP < HorizonP)
+    {
+        Flow->DroppedThroughP = HorizonP;
+    }
+
+    if(Flow->Engaged)
+    {
+        Flow->Engaged = (Backlog > Flow->LowWatermark);
+    }
+    else if(Backlog >= Flow->HighWatermark)
+    {
+        Flow->Engaged = 1;
+        ++Flow->EngagedCount;
+    }
+
+    int Result = (Flow->Engaged && (Flow->Mode == FlowControl_BlockProducer));
+    if(Result && Flow->Blocked)
+    {
+        Flow->StallTicks += NowTicks - Flow->LastTicks;
+    }
+    Flow->Blocked = Result;
+    Flow->LastTicks = NowTicks;
+
+    Flow->Allowance = LARGEST_AVAILABLE;
+    if(Flow->Mode == FlowControl_BlockProducer)
+    {
+        Flow->Allowance = (!Result && (Backlog < Flow->HighWatermark)) ? (Flow->HighWatermark - Backlog) : 0;
+    }
+
+    return Result;
+}
+
+static int ShouldCoalesce(example_terminal *Terminal, int64_t NowTicks)
+{
+    flow_control *Flow = &Terminal->Flow;
+    int Result = (Flow->Engaged && (Flow->Mode == FlowControl_CoalesceFrames) &&
+                  ((NowTicks - Flow->LastPublishTicks) < (Terminal->IngestPolicy.TicksPerSecond*Flow->CoalesceMS / 1000)));
+    return Result;
+}
+
+static int CompleteFastPipeReads(example_terminal *Terminal, int Wait)
+{
+    // NOTE: Returns zero once a read has come back with the pipe broken.  Cancelled reads
+    // just come back empty, since DrainFastPipeReads cancels them on purpose.
+    int Result = 1;
+
+    read_pipeline *Pipeline = &Terminal->FastPipeReads;
+    source_buffer *Buffer = &Terminal->ScrollBackBuffer;
+
+    while(Pipeline->ReadCount)
+    {
+        pending_read *Read = Pipeline->Reads + (Pipeline->FirstRead % FAST_PIPE_READ_COUNT);
+
+        if(!Read->Completed)
+        {
+            DWORD ReadCount = 0;
+            if(!GetOverlappedResult(Terminal->FastPipe, &Read->Overlapped, &ReadCount, Wait))
+            {
+                DWORD Error = GetLastError();
+                if(Error == ERROR_IO_INCOMPLETE)
+                {
+                    break;
+                }
+                else if(Error != ERROR_OPERATION_ABORTED)
+                {
+                    Result = 0;
+                }
+            }
+
+            Read->Completed = 1;
+            Read->Count = ReadCount;
+        }
+
+        // NOTE: The read is somewhere in the window that was reserved for it, so the commit point
+        // plus the gap is the same memory through the ring's double mapping.  The range can still
+        // come back short if layout has pinned data it would overwrite, and then the rest of the
+        // read stays where it is until the next call.
+        source_buffer_range Dest = GetNextWritableRange(Buffer, Read->Count);
+        size_t Gap = (Read->Data - Dest.Data + Buffer->DataSize) % Buffer->DataSize;
+        if(Gap && Dest.Count)
+        {
+            __movsb((unsigned char *)Dest.Data, (unsigned char *)Dest.Data + Gap, Dest.Count);
+            Pipeline->CompactedBytes += Dest.Count;
+        }
+
+        CommitAndParse(Terminal, Dest);
+
+        Read->Data += Dest.Count;
+        Read->Count -= Dest.Count;
+        Pipeline->TailOffset -= Dest.Count;
+        if(Read->Count)
+        {
+            ++Pipeline->PinStallCount;
+            break;
+        }
+
+        ++Pipeline->FirstRead;
+        if(--Pipeline->ReadCount == 0)
+        {
+            Pipeline->TailOffset = 0;
+        }
+    }
+
+    return Result;
+}
+
+static void IssueFastPipeReads(example_terminal *Terminal)
+{
+    // NOTE: Stops issuing once short reads have left too much gap in the window, and starts
+    // again once the reads in flight have drained it.  A producer fast enough for this to
+    // matter fills every read anyway.  The read size only changes when nothing is in flight.
+    read_pipeline *Pipeline = &Terminal->FastPipeReads;
+    if(!Pipeline->ReadCount)
+    {
+        Pipeline->ChunkSize = GetIngestReadSize(&Terminal->IngestPolicy);
+    }
+    size_t MaxTailOffset = 2*FAST_PIPE_READ_COUNT*Pipeline->ChunkSize;
+    if(MaxTailOffset > Terminal->Flow.Allowance)
+    {
+        MaxTailOffset = Terminal->Flow.Allowance;
+    }
+
+    while((Pipeline->ReadCount < FAST_PIPE_READ_COUNT) &&
+          ((Pipeline->TailOffset + Pipeline->ChunkSize) <= MaxTailOffset))
+    {
+        size_t WindowSize = Pipeline->TailOffset + Pipeline->ChunkSize;
+        source_buffer_range Dest = GetNextWritableRange(&Terminal->ScrollBackBuffer, WindowSize);
+        if(Dest.Count < WindowSize)
+        {
+            break;
+        }
+
+        pending_read *Read = Pipeline->Reads + ((Pipeline->FirstRead + Pipeline->ReadCount) % FAST_PIPE_READ_COUNT);
+        Read->Data = Dest.Data + Pipeline->TailOffset;
+        Read->Completed = 0;
+        Read->Overlapped.Offset = Read->Overlapped.OffsetHigh = 0;
+
+        ++Terminal->IngestSyscallCount;
+        if(!ReadFile(Terminal->FastPipe, Read->Data, (DWORD)Pipeline->ChunkSize, 0, &Read->Overlapped) &&
+           (GetLastError() != ERROR_IO_PENDING))
+        {
+            // NOTE: Usually the child just hasn't connected yet
+            break;
+        }
+
+        Pipeline->TailOffset = WindowSize;
+        ++Pipeline->ReadCount;
+    }
+}
+
+static void DrainFastPipeReads(example_terminal *Terminal)
+{
+    // NOTE: Anything else that writes to the scrollback has to call this first, or wait for
+    // ReadCount to reach zero, since the reads in flight are writing to where its data would go.
+    // Reads that complete anyway are kept, which can mean waiting for layout to unpin the
+    // data they overwrite.  Layout never drains, so that wait always ends.
+    if(Terminal->FastPipeReads.ReadCount)
+    {
+        CancelIoEx(Terminal->FastPipe, 0);
+        CompleteFastPipeReads(Terminal, 1);
+        while(Terminal->FastPipeReads.ReadCount)
+        {
+            Sleep(0);
+            CompleteFastPipeReads(Terminal, 1);
+        }
+    }
+}
+
+static void CloseFastRing(example_terminal *Terminal)
+{
+    if(Terminal->FastRing.Header)
+    {
+        UnmapViewOfFile(Terminal->FastRing.Header);
+        CloseHandle(Terminal->FastRingMapping);
+
+        Terminal->FastRing.Header = 0;
+        Terminal->FastRing.Data = 0;
+        Terminal->FastRingMapping = 0;
+    }
+}
+
+static void CancelPseudoConsoleTrigger(example_terminal *Terminal)
+{
+    // NOTE: The pipe can't be closed with the trigger still pending, since the OVERLAPPED
+    // would be written to whenever the cancel got around to completing
+    if(Terminal->PseudoConsoleTriggerPending)
+    {
+        DWORD Ignored;
+        CancelIoEx(Terminal->Legacy_ReadStdOut, &Terminal->PseudoConsoleTrigger);
+        GetOverlappedResult(Terminal->Legacy_ReadStdOut, &Terminal->PseudoConsoleTrigger, &Ignored, TRUE);
+        Terminal->PseudoConsoleTriggerPending = 0;
+    }
+}
+
 static void CloseProcess(example_terminal *Terminal)
 {
+    DrainFastPipeReads(Terminal);
+    CancelPseudoConsoleTrigger(Terminal);
+
     CloseHandle(Terminal->ChildProcess);
     CloseHandle(Terminal->Legacy_WriteStdIn);
     CloseHandle(Terminal->Legacy_ReadStdOut);
@@ -630,6 +1485,16 @@ static void CloseProcess(example_terminal *Terminal)
     Terminal->Legacy_ReadStdOut = INVALID_HANDLE_VALUE;
     Terminal->Legacy_ReadStdError = INVALID_HANDLE_VALUE;
     Terminal->FastPipe = INVALID_HANDLE_VALUE;
+
+    CloseFastRing(Terminal);
+
+    if(Terminal->PseudoConsole)
+    {
+        // NOTE: Only once the output pipe is closed, since otherwise this can block waiting for
+        // the output to be drained, and the ingest thread can't drain it while this holds the lock.
+        Terminal->ClosePseudoConsole(Terminal->PseudoConsole);
+        Terminal->PseudoConsole = 0;
+    }
 }
 
 static void KillProcess(example_terminal *Terminal)
@@ -641,6 +1506,45 @@ static void KillProcess(example_terminal *Terminal)
     }
 }
 
+static void PublishSnapshot(example_terminal *Terminal, int64_t ArrivalTicks)
+{
+    line_index *Index = &Terminal->Lines;
+    terminal_snapshot *Snapshot = &Terminal->Snapshot;
+
+    ++Terminal->SnapshotSequence;
+    _WriteBarrier();
+
+    Snapshot->ArrivalTicks = ArrivalTicks;
+    Snapshot->LineCount = Index->LineCount;
+    Snapshot->AbsoluteFilledSize = GetCurrentAbsoluteP(&Terminal->ScrollBackBuffer);
+    Snapshot->RunningCursor = Terminal->RunningCursor;
+
+    _WriteBarrier();
+    ++Terminal->SnapshotSequence;
+}
+
+static terminal_snapshot ReadSnapshot(example_terminal *Terminal)
+{
+    terminal_snapshot Result;
+
+    uint32_t Sequence;
+    for(;;)
+    {
+        Sequence = Terminal->SnapshotSequence;
+        _ReadBarrier();
+        Result = Terminal->Snapshot;
+        _ReadBarrier();
+        if(!(Sequence & 1) && (Sequence == Terminal->SnapshotSequence))
+        {
+            break;
+        }
+
+        YieldProcessor();
+    }
+
+    return Result;
+}
+
 static void AppendOutput(example_terminal *Terminal, char *Format, ...)
 {
     // TODO(casey): This is all garbage code.  You need a checked printf here, and of
@@ -648,18 +1552,25 @@ static void AppendOutput(example_terminal *Terminal, char *Format, ...)
     // a real concatenator here, like with a #define system, but this is just
     // a hack for now to do basic printing from the internal code.
 
-    source_buffer_range Dest = GetNextWritableRange(&Terminal->ScrollBackBuffer, LARGEST_AVAILABLE);
+    DrainFastPipeReads(Terminal);
+
+    // NOTE: wvsprintfA never writes more than 1024 characters, and asking for more than that
+    // would make the scrollback archive data it doesn't need to yet.
+    source_buffer_range Dest = GetNextWritableRange(&Terminal->ScrollBackBuffer, 1024);
     va_list ArgList;
     va_start(ArgList, Format);
     int Used = wvsprintfA(Dest.Data, Format, ArgList);
     va_end(ArgList);
 
     Dest.Count = Used;
-    CommitWrite(&Terminal->ScrollBackBuffer, Dest.Count);
-    ParseLines(Terminal, Dest, &Terminal->RunningCursor);
+    CommitAndParse(Terminal, Dest);
+
+    LARGE_INTEGER Now;
+    QueryPerformanceCounter(&Now);
+    PublishSnapshot(Terminal, Now.QuadPart);
 }
 
-static int UpdateTerminalBuffer(example_terminal *Terminal, HANDLE FromPipe)
+static int UpdateTerminalBuffer(example_terminal *Terminal, HANDLE FromPipe, int NoWait, OVERLAPPED *Overlapped)
 {
     int Result = 0;
 
@@ -667,20 +1578,56 @@ static int UpdateTerminalBuffer(example_terminal *Terminal, HANDLE FromPipe)
     {
         Result = 1;
 
-        terminal_buffer *Term = &Terminal->ScreenBuffer;
+        // NOTE: Pipes in no-wait mode come back with ERROR_NO_DATA when they're empty, so they
+        // can be read without peeking first, which halves the syscalls.
+        size_t ReadSize = GetIngestReadSize(&Terminal->IngestPolicy);
+        if(ReadSize > Terminal->Flow.Allowance) ReadSize = Terminal->Flow.Allowance;
+        DWORD PendingCount = (DWORD)ReadSize;
+        if(!NoWait)
+        {
+            PendingCount = GetPipePendingDataCount(FromPipe);
+            ++Terminal->IngestSyscallCount;
+            if(PendingCount > ReadSize) PendingCount = (DWORD)ReadSize;
+        }
 
-        DWORD PendingCount = GetPipePendingDataCount(FromPipe);
         if(PendingCount)
         {
+            // NOTE: Dest can come back empty if layout has pinned the data it would overwrite
             source_buffer_range Dest = GetNextWritableRange(&Terminal->ScrollBackBuffer, PendingCount);
-
-            DWORD ReadCount = 0;
-            if(ReadFile(FromPipe, Dest.Data, (DWORD)Dest.Count, &ReadCount, 0))
+            if(Dest.Count)
             {
-                Assert(ReadCount <= Dest.Count);
-                Dest.Count = ReadCount;
-                CommitWrite(&Terminal->ScrollBackBuffer, Dest.Count);
-                ParseLines(Terminal, Dest, &Terminal->RunningCursor);
+                DWORD ReadCount = 0;
+                ++Terminal->IngestSyscallCount;
+                int Read;
+                if(Overlapped)
+                {
+                    // NOTE: Overlapped handles have to be read with an OVERLAPPED.  Only what was
+                    // already pending gets asked for, so waiting on it doesn't wait on the child.
+                    Overlapped->Offset = Overlapped->OffsetHigh = 0;
+                    Read = (ReadFile(FromPipe, Dest.Data, (DWORD)Dest.Count, 0, Overlapped) ||
+                            (GetLastError() == ERROR_IO_PENDING));
+                    Read = Read && GetOverlappedResult(FromPipe, Overlapped, &ReadCount, TRUE);
+                }
+                else
+                {
+                    Read = ReadFile(FromPipe, Dest.Data, (DWORD)Dest.Count, &ReadCount, 0);
+                }
+
+                if(Read)
+                {
+                    Assert(ReadCount <= Dest.Count);
+                    Dest.Count = ReadCount;
+                    CommitAndParse(Terminal, Dest);
+                }
+                else if(NoWait || Overlapped)
+                {
+                    DWORD Error = GetLastError();
+                    if((Error == ERROR_BROKEN_PIPE) ||
+                       (Error == ERROR_INVALID_HANDLE))
+                    {
+                        Result = 0;
+                    }
+                }
             }
         }
         else
@@ -697,146 +1644,1376 @@ static int UpdateTerminalBuffer(example_terminal *Terminal, HANDLE FromPipe)
     return Result;
 }
 
-static void LayoutLines(example_terminal *Terminal)
+static void UpdateFromFastRing(example_terminal *Terminal)
 {
-    // TODO(casey): Probably want to do something better here - this over-clears, since we clear
-    // the whole thing and then also each line, for no real reason other than to make line wrapping
-    // simpler.
-    Clear(Terminal, &Terminal->ScreenBuffer);
+    fast_ring *Ring = &Terminal->FastRing;
+    fast_ring_header *Header = Ring->Header;
+    if(Header)
+    {
+        Header->ReaderWaiting = 0;
 
-    //
-    // TODO(casey): This code is super bad, and there's no need for it to keep repeating itself.
-    //
+        // NOTE: The child can write anything it wants into the header, so only WriteP is read
+        // back from it, and even that is clamped to the ring.
+        uint64_t Size = Terminal->FastRingSize;
+        uint64_t ReadP = Terminal->FastRingReadP;
+        uint64_t Count = Header->WriteP - ReadP;
+        _ReadBarrier();
+        if(Count > Size) Count = Size;
 
-    // TODO(casey): How do we know how far back to go, for control chars?
-    int32_t LineCount = 2*Terminal->ScreenBuffer.DimY;
-    int32_t LineOffset = Terminal->CurrentLineIndex + Terminal->ViewingLineOffset - LineCount;
+        size_t ReadSize = GetIngestReadSize(&Terminal->IngestPolicy);
+        if(ReadSize > Terminal->Flow.Allowance) ReadSize = Terminal->Flow.Allowance;
+        if(Count > ReadSize) Count = ReadSize;
 
-    int CursorJumped = 0;
+        if(Count)
+        {
+            source_buffer_range Dest = GetNextWritableRange(&Terminal->ScrollBackBuffer, Count);
+            if(Dest.Count)
+            {
+                size_t Offset = ReadP & (Size - 1);
+                size_t FirstCount = Size - Offset;
+                if(FirstCount > Dest.Count) FirstCount = Dest.Count;
+                __movsb((unsigned char *)Dest.Data, (unsigned char *)Ring->Data + Offset, FirstCount);
+                __movsb((unsigned char *)Dest.Data + FirstCount, (unsigned char *)Ring->Data, Dest.Count - FirstCount);
 
-    cursor_state Cursor = {0};
-    ClearCursor(Terminal, &Cursor);
-    for(int32_t LineIndexIndex = 0;
-        LineIndexIndex < LineCount;
-        ++LineIndexIndex)
-    {
-        int32_t LineIndex = (LineOffset + LineIndexIndex) % Terminal->MaxLineCount;
-        if(LineIndex < 0) LineIndex += Terminal->MaxLineCount;
+                CommitAndParse(Terminal, Dest);
 
-        example_line Line = Terminal->Lines[LineIndex];
+                // NOTE: The space can only be handed back once the copy out of it is done
+                _ReadWriteBarrier();
+                Terminal->FastRingReadP = ReadP + Dest.Count;
+                Header->ReadP = Terminal->FastRingReadP;
 
-        source_buffer_range Range = ReadSourceAt(&Terminal->ScrollBackBuffer, Line.FirstP, Line.OnePastLastP - Line.FirstP);
-        Cursor.Props = Line.StartingProps;
-        if(ParseLineIntoGlyphs(Terminal, Range, &Cursor, Line.ContainsComplexChars))
-        {
-            CursorJumped = 1;
+                MemoryBarrier();
+                if(Header->WriterWaiting)
+                {
+                    ++Terminal->IngestSyscallCount;
+                    SetEvent(Ring->SpaceReady);
+                }
+            }
         }
     }
+}
 
-    if(CursorJumped)
+static layout_cache AllocateLayoutCache(uint32_t EntryCount, size_t CellCount)
+{
+    Assert(IsPowerOfTwo(EntryCount));
+
+    layout_cache Result = {0};
+
+    size_t EntrySize = EntryCount*sizeof(layout_cache_entry);
+    size_t CellSize = CellCount*sizeof(renderer_cell);
+    char *Memory = VirtualAlloc(0, EntrySize + CellSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    if(Memory)
     {
-        Cursor.At.X = 0;
-        Cursor.At.Y = Terminal->ScreenBuffer.DimY - 4;
+        Result.EntryMask = EntryCount - 1;
+        Result.Entries = (layout_cache_entry *)Memory;
+        Result.CellCount = CellCount;
+        Result.Cells = (renderer_cell *)(Memory + EntrySize);
     }
 
-    AdvanceRow(Terminal, &Cursor.At);
-    ClearProps(Terminal, &Cursor.Props);
+    return Result;
+}
 
-#if 0
-    uint32_t CLCount = Terminal->CommandLineCount;
+static size_t GetLayoutCacheFootprint(layout_cache *Cache)
+{
+    size_t CellsUsed = (Cache->AbsoluteCellP < Cache->CellCount) ? Cache->AbsoluteCellP : Cache->CellCount;
+    size_t Result = ((Cache->Entries ? (Cache->EntryMask + 1) : 0)*sizeof(layout_cache_entry) +
+                     CellsUsed*sizeof(renderer_cell));
+    return Result;
+}
 
-    source_buffer_range CommandLineRange = {0};
-    CommandLineRange.AbsoluteP = 0;
-    CommandLineRange.Count = CLCount;
-    CommandLineRange.Data = (char *)Terminal->CommandLine;
-#else
-#endif
-    char Prompt[] = {'>', ' '};
-    source_buffer_range PromptRange = {0};
-    PromptRange.Count = ArrayCount(Prompt);
-    PromptRange.Data = Prompt;
-    ParseLineIntoGlyphs(Terminal, PromptRange, &Cursor, 0);
+static size_t GetLayoutCacheLengthCellCount(uint32_t RowCount)
+{
+    // NOTE: Each entry's row lengths are packed into the cells just ahead of its rows
+    size_t Result = (RowCount*sizeof(uint16_t) + sizeof(renderer_cell) - 1) / sizeof(renderer_cell);
+    return Result;
+}
 
-    source_buffer_range CommandLineRange = {0};
-    CommandLineRange.Count = Terminal->CommandLineCount;
-    CommandLineRange.Data = Terminal->CommandLine;
-    ParseLineIntoGlyphs(Terminal, CommandLineRange, &Cursor, 1);
+static uint32_t GetLayoutGeneration(example_terminal *Terminal)
+{
+    // NOTE: Anything that changes how the same bytes lay out has to be folded in here
+    uint32_t Result = (Terminal->FontGeneration << 1) | (Terminal->LineWrap ? 1 : 0);
+    return Result;
+}
 
-    char CursorCode[] = {'\x1b', '[', '5',  'm', 0xe2, 0x96, 0x88};
-    source_buffer_range CursorRange = {0};
-    CursorRange.Count = ArrayCount(CursorCode);
-    CursorRange.Data = CursorCode;
-    ParseLineIntoGlyphs(Terminal, CursorRange, &Cursor, 1);
-    AdvanceRowNoClear(Terminal, &Cursor.At);
+static layout_cache_entry *GetLayoutCacheSlot(layout_cache *Cache, size_t FirstP)
+{
+    uint32_t Slot = (uint32_t)((FirstP * 0x9E3779B97F4A7C15ull) >> 32) & Cache->EntryMask;
+    layout_cache_entry *Result = Cache->Entries + Slot;
+    return Result;
+}
 
-    Terminal->ScreenBuffer.FirstLineY = CursorJumped ? 0 : Cursor.At.Y;
+static int LayoutCacheEntryMatches(layout_cache *Cache, layout_cache_entry *Entry, source_buffer_range Range,
+                                   uint32_t DimX, uint32_t Generation)
+{
+    int Result = (Entry->RowCount &&
+                  (Entry->FirstP == Range.AbsoluteP) &&
+                  (Entry->Count == Range.Count) &&
+                  (Entry->DimX == DimX) &&
+                  (Entry->Generation == Generation) &&
+                  ((Cache->AbsoluteCellP - Entry->CellP) <= Cache->CellCount));
+    return Result;
 }
 
-static int ExecuteSubProcess(example_terminal *Terminal, char *ProcessName, char *ProcessCommandLine)
+static int IsLayoutCacheable(terminal_buffer *Buffer, int LineWrap, source_buffer_range Range)
 {
-    if(Terminal->ChildProcess != INVALID_HANDLE_VALUE)
+    // NOTE: Only lines that lay out purely from the direct glyph table are cached, because anything
+    // that went through the glyph cache could have its tile recycled out from under the cached cells.
+    // The row bound guarantees the line can't wrap all the way around the screen buffer, so the
+    // number of rows it used can be recovered from the cursor.
+    size_t MaxRowCount = (LineWrap ? (Range.Count / Buffer->DimX) : 0) + 2;
+    int Result = (MaxRowCount <= Buffer->DimY);
+
+    for(size_t Index = 0;
+        Result && (Index < Range.Count);
+        ++Index)
     {
-        KillProcess(Terminal);
+        char Token = Range.Data[Index];
+        if(Token == '\x1b')
+        {
+            Result = (((Index + 1) < Range.Count) && (Range.Data[Index + 1] == '['));
+        }
+        else
+        {
+            Result = (IsDirectCodepoint(Token) || (Token == '\r') || (Token == '\n'));
+        }
     }
 
-    PROCESS_INFORMATION ProcessInfo = {0};
-    STARTUPINFOA StartupInfo = {sizeof(StartupInfo)};
-    StartupInfo.dwFlags = STARTF_USESTDHANDLES;
-
-    SECURITY_ATTRIBUTES Inherit = {sizeof(Inherit)};
-    Inherit.bInheritHandle = TRUE;
-
-    CreatePipe(&StartupInfo.hStdInput, &Terminal->Legacy_WriteStdIn, &Inherit, 0);
-    CreatePipe(&Terminal->Legacy_ReadStdOut, &StartupInfo.hStdOutput, &Inherit, 0);
-    CreatePipe(&Terminal->Legacy_ReadStdError, &StartupInfo.hStdError, &Inherit, 0);
+    return Result;
+}
 
-    SetHandleInformation(Terminal->Legacy_WriteStdIn, HANDLE_FLAG_INHERIT, 0);
+static void CopyLayoutCacheRows(terminal_buffer *Buffer, int32_t FirstY, uint32_t RowCount,
+                                renderer_cell *Source, uint16_t *SourceLengths, int ToCache)
+{
+    // NOTE: Only the used part of each row is copied, with its length kept in SourceLengths
+    for(uint32_t RowIndex = 0;
+        RowIndex < RowCount;
+        ++RowIndex)
+    {
+        uint32_t Y = (FirstY + RowIndex) % Buffer->DimY;
+        unsigned char *Screen = (unsigned char *)(Buffer->Cells + Y*Buffer->DimX);
+        unsigned char *Cached = (unsigned char *)(Source + RowIndex*Buffer->DimX);
+        uint16_t *CachedLength = SourceLengths + RowIndex;
+        if(ToCache)
+        {
+            *CachedLength = (uint16_t)Buffer->RowLengths[Y];
+            __movsb(Cached, Screen, *CachedLength*sizeof(renderer_cell));
+        }
+        else
+        {
+            Buffer->RowLengths[Y] = *CachedLength;
+            __movsb(Screen, Cached, *CachedLength*sizeof(renderer_cell));
+        }
+    }
+}
+
+static int LayoutLineFromCache(example_terminal *Terminal, source_buffer_range Range, cursor_state *Cursor)
+{
+    int Result = 0;
+
+    layout_cache *Cache = &Terminal->LayoutCache;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    if(Cache->Entries)
+    {
+        layout_cache_entry *Entry = GetLayoutCacheSlot(Cache, Range.AbsoluteP);
+        if(LayoutCacheEntryMatches(Cache, Entry, Range, Buffer->DimX, GetLayoutGeneration(Terminal)))
+        {
+            renderer_cell *Cells = Cache->Cells + (Entry->CellP % Cache->CellCount);
+            CopyLayoutCacheRows(Buffer, Cursor->At.Y, Entry->RowCount,
+                                Cells + GetLayoutCacheLengthCellCount(Entry->RowCount), (uint16_t *)Cells, 0);
+            for(uint32_t RowIndex = 0; Entry->Blinking && (RowIndex < Entry->RowCount); ++RowIndex)
+            {
+                AddBlinkRunsFromRow(Buffer, (Cursor->At.Y + RowIndex) % Buffer->DimY);
+            }
+
+            Cursor->At.X = Entry->EndCursor.At.X;
+            Cursor->At.Y = (Cursor->At.Y + Entry->EndCursor.At.Y) % Buffer->DimY;
+            Cursor->Props = Entry->EndCursor.Props;
+            Terminal->RowAdvanceCount += Entry->RowCount - 1;
+
+            ++Cache->HitCount;
+            Result = 1;
+        }
+        else
+        {
+            ++Cache->MissCount;
+        }
+    }
+
+    return Result;
+}
+
+static void StoreLayoutLineInCache(example_terminal *Terminal, source_buffer_range Range, int32_t FirstY, cursor_state *Cursor)
+{
+    layout_cache *Cache = &Terminal->LayoutCache;
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    if(Cache->Entries &&
+       IsLayoutCacheable(Buffer, Terminal->LineWrap, Range))
+    {
+        uint32_t RowCount = ((Cursor->At.Y - FirstY + Buffer->DimY) % Buffer->DimY) + 1;
+        size_t CellCount = GetLayoutCacheLengthCellCount(RowCount) + RowCount*Buffer->DimX;
+
+        // NOTE: Don't let one line churn through a large fraction of the cache
+        if(CellCount <= (Cache->CellCount / 8))
+        {
+            // NOTE: Skip the tail of the circular buffer if the rows wouldn't be contiguous
+            size_t Relative = Cache->AbsoluteCellP % Cache->CellCount;
+            if((Relative + CellCount) > Cache->CellCount)
+            {
+                Cache->AbsoluteCellP += Cache->CellCount - Relative;
+            }
+
+            layout_cache_entry *Entry = GetLayoutCacheSlot(Cache, Range.AbsoluteP);
+            Entry->FirstP = Range.AbsoluteP;
+            Entry->Count = Range.Count;
+            Entry->DimX = Buffer->DimX;
+            Entry->Generation = GetLayoutGeneration(Terminal);
+            Entry->CellP = Cache->AbsoluteCellP;
+            Entry->RowCount = RowCount;
+            Entry->Blinking = HasBlinkRuns(Buffer, FirstY, RowCount);
+            Entry->EndCursor.At.X = Cursor->At.X;
+            Entry->EndCursor.At.Y = RowCount - 1;
+            Entry->EndCursor.Props = Cursor->Props;
+
+            renderer_cell *Cells = Cache->Cells + (Entry->CellP % Cache->CellCount);
+            CopyLayoutCacheRows(Buffer, FirstY, RowCount,
+                                Cells + GetLayoutCacheLengthCellCount(RowCount), (uint16_t *)Cells, 1);
+            Cache->AbsoluteCellP += CellCount;
+        }
+    }
+}
+
+static uint32_t MeasureLineRows(example_terminal *Terminal, source_buffer_range Range)
+{
+    // NOTE: Counts the row advances for a line without writing any cells.  This assumes the line
+    // starts at the left edge and that every codepoint is one cell wide, so for lines with complex
+    // characters it is only an estimate - LayoutLines replaces it with the exact count once the
+    // line has actually been laid out.
+    uint32_t Result = 0;
+
+    uint32_t DimX = Terminal->ScreenBuffer.DimX;
+    uint32_t X = 0;
+    cursor_state Scratch = {0};
+    while(Range.Count)
+    {
+        char Peek = PeekToken(&Range, 0);
+        if((Peek == '\x1b') && AtEscape(&Range))
+        {
+            if(ParseEscape(Terminal, &Range, &Scratch))
+            {
+                Result = LINE_ROWS_CURSOR_JUMPED;
+                break;
+            }
+        }
+        else
+        {
+            GetToken(&Range);
+            if(Peek == '\r')
+            {
+                X = 0;
+            }
+            else if(Peek == '\n')
+            {
+                ++Result;
+                X = 0;
+            }
+            else if(!IsUTF8Extension(Peek))
+            {
+                ++X;
+                if(Terminal->LineWrap && (X >= DimX))
+                {
+                    ++Result;
+                    X = 0;
+                }
+            }
+        }
+    }
+
+    return Result;
+}
+
+static uint16_t GetRowCountKey(example_terminal *Terminal)
+{
+    // NOTE: DimX fits in the low 11 bits and is never zero, so a measured line never has a key of zero.
+    // Only 5 bits of the generation fit, so AdvanceFontGeneration forgets every count when they wrap.
+    Assert(Terminal->ScreenBuffer.DimX && (Terminal->ScreenBuffer.DimX < (1 << 11)));
+    uint16_t Result = (uint16_t)((GetLayoutGeneration(Terminal) << 11) ^ Terminal->ScreenBuffer.DimX);
+    return Result;
+}
+
+static void AdvanceFontGeneration(example_terminal *Terminal)
+{
+    // NOTE: The row count key holds the font generation in 4 bits, so once those wrap, counts
+    // from 16 fonts ago would match again.  Those get cleared instead, and a key of zero never matches.
+    ++Terminal->FontGeneration;
+    if((Terminal->FontGeneration & 15) == 0)
+    {
+        line_index *Index = &Terminal->Lines;
+        size_t LineCount = Index->LineCount;
+        for(size_t LineNumber = LineCount - GetKeptLineCountAt(Index, LineCount);
+            LineNumber < LineCount;
+            ++LineNumber)
+        {
+            GetCompactLine(Index, LineNumber)->RowCountKey = 0;
+        }
+    }
+}
+
+static uint32_t SetLineRowCount(example_terminal *Terminal, size_t LineNumber, uint32_t RowCount, int HoldsLock)
+{
+    line_index *Index = &Terminal->Lines;
+    compact_line *Line = GetCompactLine(Index, LineNumber);
+    uint32_t Result = (RowCount < LINE_ROWS_CURSOR_JUMPED) ? RowCount : LINE_ROWS_CURSOR_JUMPED;
+    Line->RowCount = (uint16_t)Result;
+    Line->RowCountKey = GetRowCountKey(Terminal);
+
+    // NOTE: Without the lock, the ingest thread may have lapped the line index and handed this
+    // slot to a new line, so the count just written would belong to the wrong line.  The fence
+    // makes sure that either the check sees the lap, or the ingest thread's AppendLine clears
+    // the key after this did.
+    if(!HoldsLock)
+    {
+        MemoryBarrier();
+        if(!IsLineStillKept(Index, LineNumber))
+        {
+            Line->RowCountKey = 0;
+        }
+    }
+
+    return Result;
+}
+
+static example_line GetSnapshotLine(line_index *Index, example_line *Prev, size_t LineNumber)
+{
+    // NOTE: Layout stops short of the current line, so every line it reads is finished and
+    // its extent in the line index can't change under it.
+    example_line Result = Prev ? GetNextLine(Index, Prev, LineNumber) : WalkToLine(Index, LineNumber);
+    return Result;
+}
+
+static source_buffer_range ReadSnapshotLine(example_terminal *Terminal, terminal_snapshot *Snapshot, example_line *Line, int HoldsLock)
+{
+    // NOTE: Without the lock only pinned data in the hot ring is safe to read.  With it, the
+    // whole scrollback is, including whatever has gone to the cold store.
+    source_buffer *Buffer = &Terminal->ScrollBackBuffer;
+    source_buffer_range Result = (HoldsLock ?
+                                  ReadSourceAt(Buffer, Line->FirstP, GetLineLength(Line)) :
+                                  ReadPinnedSourceAt(Buffer, Snapshot->AbsoluteFilledSize, Line->FirstP, GetLineLength(Line)));
+    return Result;
+}
+
+static uint32_t GetRowCountFromColumns(example_terminal *Terminal, compact_line *Line)
+{
+    // NOTE: The same count MeasureLineRows would come up with, from what the parser already counted
+    uint32_t Result = (Line->LengthAndFlags & LineFlag_EndsWithNewline) ? 1 : 0;
+    if(Terminal->LineWrap)
+    {
+        Result += Line->ColumnCount / Terminal->ScreenBuffer.DimX;
+    }
+
+    return Result;
+}
+
+static uint32_t GetLineRowCount(example_terminal *Terminal, terminal_snapshot *Snapshot, size_t LineNumber, int HoldsLock)
+{
+    // NOTE: Every count goes stale when the width changes, so this is what reflows the lines
+    // after a resize.  Only the lines layout walks over get reflowed, and unless a line has to be
+    // measured, that costs nothing but a divide.
+    compact_line *Compact = GetCompactLine(&Terminal->Lines, LineNumber);
+    uint32_t Result = Compact->RowCount;
+    if(Compact->RowCountKey != GetRowCountKey(Terminal))
+    {
+        uint32_t RowCount;
+        if(Compact->ColumnCount != LINE_COLUMNS_UNKNOWN)
+        {
+            RowCount = GetRowCountFromColumns(Terminal, Compact);
+        }
+        else
+        {
+            example_line Line = GetSnapshotLine(&Terminal->Lines, 0, LineNumber);
+            source_buffer_range Range = ReadSnapshotLine(Terminal, Snapshot, &Line, HoldsLock);
+            RowCount = MeasureLineRows(Terminal, Range);
+        }
+        Result = SetLineRowCount(Terminal, LineNumber, RowCount, HoldsLock);
+    }
+
+    return Result;
+}
+
+static size_t FindFirstVisibleLine(example_terminal *Terminal, terminal_snapshot *Snapshot, int64_t LastLineNumber,
+                                   size_t FloorLineNumber, int HoldsLock, int *ShortOfRows)
+{
+    // NOTE: Walk back from the last visible line until there are enough rows to fill the screen,
+    // so the only lines that get laid out are the ones that can actually be seen.  If the floor
+    // is reached first, ShortOfRows says so, since the screen may then not be full.
+    uint32_t RowsNeeded = Terminal->ScreenBuffer.DimY;
+    uint32_t RowsFound = 0;
+    int64_t LineNumber = LastLineNumber;
+    while((RowsFound < RowsNeeded) && (LineNumber >= (int64_t)FloorLineNumber))
+    {
+        uint32_t RowCount = GetLineRowCount(Terminal, Snapshot, (size_t)LineNumber, HoldsLock);
+        RowsFound = (RowCount == LINE_ROWS_CURSOR_JUMPED) ? RowsNeeded : (RowsFound + RowCount);
+        --LineNumber;
+    }
+
+    *ShortOfRows = (RowsFound < RowsNeeded);
+
+    size_t Result = (size_t)(LineNumber + 1);
+    return Result;
+}
+
+static int LayoutSnapshot(example_terminal *Terminal, terminal_snapshot *Snapshot, size_t FloorLineNumber, int HoldsLock)
+{
+    // NOTE: Returns 0 if the screen may not be full because the floor was above the oldest kept
+    // line, so the caller knows to lay out again from further back.
+    // TODO(casey): Probably want to do something better here - this over-clears, since we clear
+    // the whole thing and then also each line, for no real reason other than to make line wrapping
+    // simpler.
+    Clear(Terminal, &Terminal->ScreenBuffer);
+
+    //
+    // TODO(casey): This code is super bad, and there's no need for it to keep repeating itself.
+    //
+
+    // NOTE: The props for each line were captured when it was parsed, so nothing before the
+    // first visible line matters.
+    line_index *Index = &Terminal->Lines;
+    int64_t LastLineNumber = (int64_t)Snapshot->LineCount - 1 + Terminal->ViewingLineOffset - 1;
+    int ShortOfRows = 0;
+    size_t FirstLineNumber = FindFirstVisibleLine(Terminal, Snapshot, LastLineNumber, FloorLineNumber, HoldsLock, &ShortOfRows);
+    size_t OldestLineNumber = Snapshot->LineCount - GetKeptLineCountAt(Index, Snapshot->LineCount);
+    int Result = !(ShortOfRows && (FloorLineNumber > OldestLineNumber));
+    int64_t LineCount = LastLineNumber - (int64_t)FirstLineNumber + 1;
+
+    int CursorJumped = 0;
+
+    // NOTE: A line can only be replayed from the layout cache if it starts at the left edge
+    // of a row that nothing has been written to yet, which is true after every newline.
+    int RowIsClear = 1;
+
+    cursor_state Cursor = {0};
+    ClearCursor(Terminal, &Cursor);
+    example_line Line = {0};
+    for(int64_t LineIndexIndex = 0;
+        LineIndexIndex < LineCount;
+        ++LineIndexIndex)
+    {
+        size_t LineNumber = FirstLineNumber + LineIndexIndex;
+        Line = GetSnapshotLine(Index, LineIndexIndex ? &Line : 0, LineNumber);
+
+        source_buffer_range Range = ReadSnapshotLine(Terminal, Snapshot, &Line, HoldsLock);
+        Cursor.Props = Line.StartingProps;
+
+        uint32_t RowAdvanceStart = Terminal->RowAdvanceCount;
+        int LineJumped = 0;
+
+        int Cacheable = (RowIsClear && Range.Count && (Cursor.At.X == 0) && !Line.ContainsComplexChars);
+        if(!Cacheable || !LayoutLineFromCache(Terminal, Range, &Cursor))
+        {
+            int32_t FirstY = Cursor.At.Y;
+            if(ParseLineIntoGlyphs(Terminal, Range, &Cursor, Line.ContainsComplexChars))
+            {
+                CursorJumped = 1;
+                LineJumped = 1;
+            }
+            else if(Cacheable)
+            {
+                StoreLayoutLineInCache(Terminal, Range, FirstY, &Cursor);
+            }
+        }
+
+        // NOTE: Now that the line has actually been laid out, replace the estimated row count with the real one
+        SetLineRowCount(Terminal, LineNumber, LineJumped ? LINE_ROWS_CURSOR_JUMPED : (Terminal->RowAdvanceCount - RowAdvanceStart), HoldsLock);
+
+        if(Range.Count)
+        {
+            RowIsClear = (Range.Data[Range.Count - 1] == '\n');
+        }
+    }
+
+    if(CursorJumped)
+    {
+        Cursor.At.X = 0;
+        Cursor.At.Y = Terminal->ScreenBuffer.DimY - 4;
+    }
+
+    AdvanceRow(Terminal, &Cursor.At);
+    ClearProps(Terminal, &Cursor.Props);
+
+#if 0
+    uint32_t CLCount = Terminal->CommandLineCount;
+
+    source_buffer_range CommandLineRange = {0};
+    CommandLineRange.AbsoluteP = 0;
+    CommandLineRange.Count = CLCount;
+    CommandLineRange.Data = (char *)Terminal->CommandLine;
+#else
+#endif
+    char Prompt[] = {'>', ' '};
+    source_buffer_range PromptRange = {0};
+    PromptRange.Count = ArrayCount(Prompt);
+    PromptRange.Data = Prompt;
+    ParseLineIntoGlyphs(Terminal, PromptRange, &Cursor, 0);
+
+    source_buffer_range CommandLineRange = {0};
+    CommandLineRange.Count = Terminal->CommandLineCount;
+    CommandLineRange.Data = Terminal->CommandLine;
+    ParseLineIntoGlyphs(Terminal, CommandLineRange, &Cursor, 1);
+
+    char CursorCode[] = {'\x1b', '[', '5',  'm', 0xe2, 0x96, 0x88};
+    source_buffer_range CursorRange = {0};
+    CursorRange.Count = ArrayCount(CursorCode);
+    CursorRange.Data = CursorCode;
+    ParseLineIntoGlyphs(Terminal, CursorRange, &Cursor, 1);
+    AdvanceRowNoClear(Terminal, &Cursor.At);
+
+    Terminal->ScreenBuffer.FirstLineY = CursorJumped ? 0 : Cursor.At.Y;
+
+    return Result;
+}
+
+static size_t GetLayoutFloorLineNumber(example_terminal *Terminal, terminal_snapshot *Snapshot, int Deep)
+{
+    // NOTE: The furthest back layout will look for rows to fill the screen, and so the start of
+    // what gets pinned.  Most lines take at least one row, so twice the screen height is usually
+    // enough, but lines that add no row (split chunks with wrapping off, cursor jumps) can use
+    // that up, in which case layout comes back short and asks for a Deep floor at the oldest
+    // kept line instead.
+    line_index *Index = &Terminal->Lines;
+    int64_t LastLineNumber = (int64_t)Snapshot->LineCount - 1 + Terminal->ViewingLineOffset - 1;
+    int64_t OldestLineNumber = (int64_t)(Snapshot->LineCount - GetKeptLineCountAt(Index, Snapshot->LineCount));
+
+    int64_t Result = LastLineNumber - 2*(int64_t)Terminal->ScreenBuffer.DimY;
+    if(Deep || (Result < OldestLineNumber)) Result = OldestLineNumber;
+
+    return (size_t)Result;
+}
+
+static void LayoutLines(example_terminal *Terminal)
+{
+    /* NOTE: Lays out the last published snapshot without taking the lock, so the ingest thread
+       never waits on layout.  The scrollback from the floor line on is pinned so it can't be
+       overwritten, and once layout is done the floor line is checked to make sure the ingest
+       thread didn't lap the line index under it.  If the floor turns out to be too shallow to fill
+       the screen, the next attempt pins from the oldest kept line.  If that fails twice in a row,
+       or the view is scrolled back to data that is already being overwritten, layout takes the
+       lock instead.
+    */
+
+    line_index *Index = &Terminal->Lines;
+    source_buffer *Buffer = &Terminal->ScrollBackBuffer;
+
+    int LaidOut = 0;
+    int DeepFloor = 0;
+    for(uint32_t Attempt = 0; !LaidOut && (Attempt < 2); ++Attempt)
+    {
+        terminal_snapshot Snapshot = ReadSnapshot(Terminal);
+        size_t FloorLineNumber = GetLayoutFloorLineNumber(Terminal, &Snapshot, DeepFloor);
+        example_line FloorLine = WalkToLine(Index, FloorLineNumber);
+        if(IsLineStillKept(Index, FloorLineNumber) &&
+           PinSource(Buffer, FloorLine.FirstP))
+        {
+            int Complete = LayoutSnapshot(Terminal, &Snapshot, FloorLineNumber, 0);
+            LaidOut = IsLineStillKept(Index, FloorLineNumber) && Complete;
+            DeepFloor = !Complete;
+            UnpinSource(Buffer);
+
+            Terminal->LaidOutArrivalTicks = Snapshot.ArrivalTicks;
+            Terminal->Flow.LaidOutP = Snapshot.AbsoluteFilledSize;
+        }
+
+        if(!LaidOut)
+        {
+            ++Terminal->LayoutRetryCount;
+        }
+    }
+
+    if(!LaidOut)
+    {
+        EnterCriticalSection(&Terminal->Lock);
+        terminal_snapshot Snapshot = Terminal->Snapshot;
+        LayoutSnapshot(Terminal, &Snapshot, GetOldestLineNumber(Index), 1);
+        LeaveCriticalSection(&Terminal->Lock);
+
+        Terminal->LaidOutArrivalTicks = Snapshot.ArrivalTicks;
+        Terminal->Flow.LaidOutP = Snapshot.AbsoluteFilledSize;
+
+        ++Terminal->LockedLayoutCount;
+    }
+}
+
+static int CreatePipedProcess(example_terminal *Terminal, char *ProcessName, char *ProcessCommandLine,
+                              PROCESS_INFORMATION *ProcessInfo)
+{
+    STARTUPINFOA StartupInfo = {sizeof(StartupInfo)};
+    StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+
+    SECURITY_ATTRIBUTES Inherit = {sizeof(Inherit)};
+    Inherit.bInheritHandle = TRUE;
+
+    CreatePipe(&StartupInfo.hStdInput, &Terminal->Legacy_WriteStdIn, &Inherit, 0);
+    CreatePipe(&Terminal->Legacy_ReadStdOut, &StartupInfo.hStdOutput, &Inherit, 0);
+    CreatePipe(&Terminal->Legacy_ReadStdError, &StartupInfo.hStdError, &Inherit, 0);
+
+    SetHandleInformation(Terminal->Legacy_WriteStdIn, HANDLE_FLAG_INHERIT, 0);
     SetHandleInformation(Terminal->Legacy_ReadStdOut, HANDLE_FLAG_INHERIT, 0);
     SetHandleInformation(Terminal->Legacy_ReadStdError, HANDLE_FLAG_INHERIT, 0);
 
-    int Result = 0;
+    char *ProcessDir = ".\\";
+    int Result = CreateProcessA(
+        ProcessName,
+        ProcessCommandLine,
+        0,
+        0,
+        TRUE,
+        CREATE_NO_WINDOW|CREATE_SUSPENDED,
+        0,
+        ProcessDir,
+        &StartupInfo,
+        ProcessInfo);
+
+    CloseHandle(StartupInfo.hStdInput);
+    CloseHandle(StartupInfo.hStdOutput);
+    CloseHandle(StartupInfo.hStdError);
+
+    DWORD Mode = PIPE_READMODE_BYTE|PIPE_NOWAIT;
+    Terminal->LegacyPipesNoWait = (SetNamedPipeHandleState(Terminal->Legacy_ReadStdOut, &Mode, 0, 0) &&
+                                   SetNamedPipeHandleState(Terminal->Legacy_ReadStdError, &Mode, 0, 0));
+
+    return Result;
+}
+
+#ifndef PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE
+#define PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE 0x00020016
+#endif
+static int CreatePseudoConsoleProcess(example_terminal *Terminal, char *ProcessName, char *ProcessCommandLine,
+                                      PROCESS_INFORMATION *ProcessInfo)
+{
+    // NOTE: conhost sits between the child and here, and turns whatever the child does to its
+    // console into VT, so this is the path for programs that don't write VT themselves.  The
+    // output is still read straight into the scrollback, same as the legacy pipes.
+    int Result = 0;
+
+    wchar_t PipeName[64];
+    wsprintfW(PipeName, L"\\\\.\\pipe\\refterm%x_%x", GetCurrentProcessId(), ++Terminal->PseudoConsoleCount);
+    HANDLE ReadOutput = CreateNamedPipeW(PipeName, PIPE_ACCESS_INBOUND|FILE_FLAG_OVERLAPPED, 0, 1,
+                                         Terminal->PipeSize, Terminal->PipeSize, 0, 0);
+    HANDLE WriteOutput = CreateFileW(PipeName, GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+
+    HANDLE ReadInput = INVALID_HANDLE_VALUE;
+    HANDLE WriteInput = INVALID_HANDLE_VALUE;
+    CreatePipe(&ReadInput, &WriteInput, 0, 0);
+
+    COORD Size = {80, 25};
+    if(Terminal->ScreenBuffer.DimX && Terminal->ScreenBuffer.DimY)
+    {
+        Size.X = (SHORT)Terminal->ScreenBuffer.DimX;
+        Size.Y = (SHORT)Terminal->ScreenBuffer.DimY;
+    }
+
+    void *Console = 0;
+    if((ReadOutput != INVALID_HANDLE_VALUE) &&
+       (WriteOutput != INVALID_HANDLE_VALUE) &&
+       SUCCEEDED(Terminal->CreatePseudoConsole(Size, ReadInput, WriteOutput, 0, &Console)))
+    {
+        STARTUPINFOEXA StartupInfo = {0};
+        StartupInfo.StartupInfo.cb = sizeof(StartupInfo);
+
+        SIZE_T AttributeSize = 0;
+        InitializeProcThreadAttributeList(0, 1, 0, &AttributeSize);
+        StartupInfo.lpAttributeList = VirtualAlloc(0, AttributeSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+        if(StartupInfo.lpAttributeList &&
+           InitializeProcThreadAttributeList(StartupInfo.lpAttributeList, 1, 0, &AttributeSize))
+        {
+            if(UpdateProcThreadAttribute(StartupInfo.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE,
+                                         Console, sizeof(Console), 0, 0))
+            {
+                char *ProcessDir = ".\\";
+                Result = CreateProcessA(
+                    ProcessName,
+                    ProcessCommandLine,
+                    0,
+                    0,
+                    FALSE,
+                    EXTENDED_STARTUPINFO_PRESENT|CREATE_SUSPENDED,
+                    0,
+                    ProcessDir,
+                    &StartupInfo.StartupInfo,
+                    ProcessInfo);
+            }
+
+            DeleteProcThreadAttributeList(StartupInfo.lpAttributeList);
+        }
+
+        if(StartupInfo.lpAttributeList)
+        {
+            VirtualFree(StartupInfo.lpAttributeList, 0, MEM_RELEASE);
+        }
+    }
+
+    // NOTE: conhost has its own copies of these
+    CloseHandle(ReadInput);
+    CloseHandle(WriteOutput);
+
+    if(Result)
+    {
+        Terminal->LegacyPipesNoWait = 0;
+        Terminal->PseudoConsole = Console;
+        Terminal->Legacy_ReadStdOut = ReadOutput;
+        Terminal->Legacy_WriteStdIn = WriteInput;
+    }
+    else
+    {
+        if(Console) Terminal->ClosePseudoConsole(Console);
+        CloseHandle(ReadOutput);
+        CloseHandle(WriteInput);
+    }
+
+    return Result;
+}
+
+static void CreateFastRing(example_terminal *Terminal, DWORD ProcessID)
+{
+    // NOTE: Positions in the ring are only ever masked, never divided, so it has to be a power of two
+    size_t Size = Terminal->PipeSize;
+    Assert(IsPowerOfTwo(Size));
+
+    wchar_t MappingName[64];
+    wsprintfW(MappingName, L"fastring%x", ProcessID);
+    HANDLE Mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, 0,
+                                        (DWORD)(FAST_RING_HEADER_SIZE + Size), MappingName);
+    fast_ring_header *Header = Mapping ? (fast_ring_header *)MapViewOfFile(Mapping, FILE_MAP_READ|FILE_MAP_WRITE, 0, 0, 0) : 0;
+    if(Header)
+    {
+        Header->Size = (uint32_t)Size;
+        Header->EventID = GetCurrentProcessId();
+        Header->Version = FAST_RING_VERSION;
+
+        Terminal->FastRingMapping = Mapping;
+        Terminal->FastRing.Header = Header;
+        Terminal->FastRing.Data = (char *)Header + FAST_RING_HEADER_SIZE;
+        Terminal->FastRingSize = Size;
+        Terminal->FastRingReadP = 0;
+    }
+    else if(Mapping)
+    {
+        CloseHandle(Mapping);
+    }
+}
+
+static int ExecuteSubProcess(example_terminal *Terminal, char *ProcessName, char *ProcessCommandLine)
+{
+    if(Terminal->ChildProcess != INVALID_HANDLE_VALUE)
+    {
+        KillProcess(Terminal);
+    }
+
+    PROCESS_INFORMATION ProcessInfo = {0};
+    int Result = ((Terminal->EnablePseudoConsole && Terminal->CreatePseudoConsole) ?
+                  CreatePseudoConsoleProcess(Terminal, ProcessName, ProcessCommandLine, &ProcessInfo) :
+                  CreatePipedProcess(Terminal, ProcessName, ProcessCommandLine, &ProcessInfo));
+    if(Result)
+    {
+        if(Terminal->EnableFastPipe)
+        {
+            wchar_t PipeName[64];
+            wsprintfW(PipeName, L"\\\\.\\pipe\\fastpipe%x", ProcessInfo.dwProcessId);
+            Terminal->FastPipe = CreateNamedPipeW(PipeName, PIPE_ACCESS_DUPLEX|FILE_FLAG_OVERLAPPED, 0, 1,
+                                                      Terminal->PipeSize, Terminal->PipeSize, 0, 0);
+
+            // TODO(casey): Should give this its own event / overlapped
+            ConnectNamedPipe(Terminal->FastPipe, &Terminal->FastPipeTrigger);
+
+            DWORD Error = GetLastError();
+            Assert(Error == ERROR_IO_PENDING);
+        }
+
+        if(Terminal->EnableFastRing)
+        {
+            CreateFastRing(Terminal, ProcessInfo.dwProcessId);
+        }
+
+        ResumeThread(ProcessInfo.hThread);
+        CloseHandle(ProcessInfo.hThread);
+        Terminal->ChildProcess = ProcessInfo.hProcess;
+    }
+
+    return Result;
+}
+
+static size_t MeasureLineLookupCycles(line_index *Index)
+{
+    // NOTE: Random line numbers, so this is the cost of jumping somewhere in the scrollback,
+    // not of walking it (which is what GetNextLine is for).
+    size_t OldestLineNumber = GetOldestLineNumber(Index);
+    size_t KeptLineCount = GetKeptLineCount(Index);
+    uint32_t LookupCount = 4096;
+    uint32_t Entropy = 0x9e3779b9;
+    volatile size_t Checksum = 0; // NOTE: Keeps the compiler from throwing away the lookups
+
+    uint64_t StartClock = __rdtsc();
+    for(uint32_t LookupIndex = 0;
+        LookupIndex < LookupCount;
+        ++LookupIndex)
+    {
+        Entropy ^= Entropy << 13;
+        Entropy ^= Entropy >> 17;
+        Entropy ^= Entropy << 5;
+
+        example_line Line = GetLine(Index, OldestLineNumber + (Entropy % KeptLineCount));
+        Checksum += Line.FirstP;
+    }
+    uint64_t EndClock = __rdtsc();
+
+    size_t Result = (size_t)((EndClock - StartClock) / LookupCount);
+    return Result;
+}
+
+static size_t MeasureColdReadCycles(source_buffer *Buffer)
+{
+    // NOTE: Random positions across the whole cold store, so nearly every read has to decode
+    size_t Result = 0;
+
+    cold_store *Store = &Buffer->ColdStore;
+    size_t SegmentCount = Store->SegmentCount - Store->FirstSegment;
+    if(SegmentCount)
+    {
+        uint32_t ReadCount = 256;
+        uint32_t Entropy = 0x9e3779b9;
+        volatile size_t Checksum = 0; // NOTE: Keeps the compiler from throwing away the reads
+
+        uint64_t StartClock = __rdtsc();
+        for(uint32_t ReadIndex = 0;
+            ReadIndex < ReadCount;
+            ++ReadIndex)
+        {
+            Entropy ^= Entropy << 13;
+            Entropy ^= Entropy >> 17;
+            Entropy ^= Entropy << 5;
+
+            size_t SegmentIndex = Store->FirstSegment + (Entropy % SegmentCount);
+            size_t AbsoluteP = SegmentIndex*Store->SegmentSize + (Entropy % Store->SegmentSize);
+            source_buffer_range Range = ReadSourceAt(Buffer, AbsoluteP, 128);
+            Checksum += Range.Count;
+        }
+        uint64_t EndClock = __rdtsc();
+
+        Result = (size_t)((EndClock - StartClock) / ReadCount);
+    }
+
+    return Result;
+}
+
+static void StartSearch(example_terminal *Terminal, int Mode, source_buffer_range Pattern)
+{
+    scrollback_search *Search = &Terminal->Search;
+    Search->Mode = SearchMode_None;
+
+    if(!Pattern.Count || (Pattern.Count > sizeof(Search->Pattern)))
+    {
+        AppendOutput(Terminal, "Usage: %s <pattern>\n", (Mode == SearchMode_Regex) ? "findre" : "find");
+    }
+    else if((Mode == SearchMode_Regex) &&
+            (!Search->DFA || !CompileSearchRegex(Search->DFA, Pattern.Data, Pattern.Count)))
+    {
+        AppendOutput(Terminal, "Unsupported regex (literals, . [] \\d \\w \\s ? * + only, and it can't match nothing)\n");
+    }
+    else
+    {
+        __movsb((unsigned char *)Search->Pattern, (unsigned char *)Pattern.Data, Pattern.Count);
+        Search->PatternLength = Pattern.Count;
+
+        Search->TrigramCount = 0;
+        if((Mode == SearchMode_Literal) && (Pattern.Count >= 3))
+        {
+            for(size_t At = 0; At <= (Pattern.Count - 3); ++At)
+            {
+                Search->TrigramHashes[Search->TrigramCount++] = (uint16_t)HashTrigram((char unsigned *)Search->Pattern + At);
+            }
+        }
+
+        // NOTE: The end is fixed now, so the hits printed while searching never get searched themselves
+        line_index *Index = &Terminal->Lines;
+        Search->AtP = GetLine(Index, GetOldestLineNumber(Index)).FirstP;
+        Search->EndP = GetCurrentAbsoluteP(&Terminal->ScrollBackBuffer);
+        Search->DFAState = 0;
+        Search->EscapeState = 0;
+        Search->HitCount = 0;
+        Search->ScannedBytes = 0;
+        Search->SkippedBytes = 0;
+        Search->ScanTicks = 0;
+        Search->Mode = Mode;
+    }
+}
+
+static void ReportSearchHit(example_terminal *Terminal, size_t LineNumber)
+{
+    // NOTE: Print the start of the line with escape sequences and control codes taken out
+    example_line Line = GetLine(&Terminal->Lines, LineNumber);
+    source_buffer_range Range = ReadSourceAt(&Terminal->ScrollBackBuffer, Line.FirstP, GetLineLength(&Line));
+
+    char Text[96];
+    uint32_t TextCount = 0;
+    while(Range.Count && (TextCount < 72))
+    {
+        if(AtEscape(&Range))
+        {
+            cursor_state Ignored = {0};
+            ParseEscape(Terminal, &Range, &Ignored);
+        }
+        else
+        {
+            char Token = GetToken(&Range);
+            if((Token >= ' ') || (Token < 0))
+            {
+                Text[TextCount++] = Token;
+            }
+        }
+    }
+    Text[TextCount] = 0;
+
+    AppendOutput(Terminal, "%8u: %s\n", (uint32_t)LineNumber, Text);
+}
 
-    char *ProcessDir = ".\\";
-    if(CreateProcessA(
-        ProcessName,
-        ProcessCommandLine,
-        0,
-        0,
-        TRUE,
-        CREATE_NO_WINDOW|CREATE_SUSPENDED,
-        0,
-        ProcessDir,
-        &StartupInfo,
-        &ProcessInfo))
+static void ContinueSearch(example_terminal *Terminal, size_t ByteBudget)
+{
+    scrollback_search *Search = &Terminal->Search;
+    line_index *Index = &Terminal->Lines;
+
+    LARGE_INTEGER StartTime;
+    QueryPerformanceCounter(&StartTime);
+
+    size_t MaxReportedHits = 100;
+    size_t ChunkSize = 256*1024;
+    size_t Scanned = 0;
+    while((Search->AtP < Search->EndP) && (Scanned < ByteBudget))
     {
-        if(Terminal->EnableFastPipe)
+        size_t Count = Search->EndP - Search->AtP;
+        if(Count > ChunkSize) Count = ChunkSize;
+
+        if(Search->TrigramCount)
         {
-            wchar_t PipeName[64];
-            wsprintfW(PipeName, L"\\\\.\\pipe\\fastpipe%x", ProcessInfo.dwProcessId);
-            Terminal->FastPipe = CreateNamedPipeW(PipeName, PIPE_ACCESS_DUPLEX|FILE_FLAG_OVERLAPPED, 0, 1,
-                                                      Terminal->PipeSize, Terminal->PipeSize, 0, 0);
+            size_t Block = Search->AtP / TRIGRAM_BLOCK_SIZE;
+            if(!IsTrigramCandidate(&Terminal->TrigramIndex, Block, Search->TrigramCount, Search->TrigramHashes))
+            {
+                size_t NextP = (Block + 1)*TRIGRAM_BLOCK_SIZE;
+                if(NextP > Search->EndP) NextP = Search->EndP;
 
-            // TODO(casey): Should give this its own event / overlapped
-            ConnectNamedPipe(Terminal->FastPipe, &Terminal->FastPipeTrigger);
+                Search->SkippedBytes += NextP - Search->AtP;
+                Search->AtP = NextP;
+                continue;
+            }
 
-            DWORD Error = GetLastError();
-            Assert(Error == ERROR_IO_PENDING);
+            // NOTE: Stop where the next block's filter can decide for itself
+            size_t BlockEndP = (Block + 1)*TRIGRAM_BLOCK_SIZE + Search->PatternLength - 1;
+            if(Count > (BlockEndP - Search->AtP)) Count = BlockEndP - Search->AtP;
         }
 
-        ResumeThread(ProcessInfo.hThread);
-        CloseHandle(ProcessInfo.hThread);
-        Terminal->ChildProcess = ProcessInfo.hProcess;
+        source_buffer_range Range = ReadSourceAt(&Terminal->ScrollBackBuffer, Search->AtP, Count);
+        if(Range.Count)
+        {
+            size_t MatchOffset = 0;
+            int Found = (Search->Mode == SearchMode_Literal) ?
+                FindLiteral(Range, Search->Pattern, Search->PatternLength, &MatchOffset) :
+                FindRegex(Search, Range, &MatchOffset);
 
-        Result = 1;
+            if(Found)
+            {
+                // NOTE: Only one hit per line, so skip to the start of the next one
+                size_t HitP = Range.AbsoluteP + MatchOffset;
+                size_t LineNumber = FindLineNumber(Index, HitP);
+                if(++Search->HitCount <= MaxReportedHits)
+                {
+                    ReportSearchHit(Terminal, LineNumber);
+                }
+
+                size_t NextP = GetLine(Index, LineNumber).OnePastLastP;
+                if(NextP <= HitP) NextP = HitP + 1;
+
+                Scanned += NextP - Search->AtP;
+                Search->AtP = NextP;
+                Search->DFAState = 0;
+                Search->EscapeState = 0;
+            }
+            else
+            {
+                // NOTE: The literal matcher has no state, so back up enough to catch a match straddling the chunks
+                size_t Advance = Range.Count;
+                if((Search->Mode == SearchMode_Literal) &&
+                   ((Range.AbsoluteP + Range.Count) < Search->EndP) &&
+                   (Range.Count >= Search->PatternLength))
+                {
+                    Advance -= Search->PatternLength - 1;
+                }
+
+                Scanned += Advance;
+                Search->AtP += Advance;
+            }
+        }
+        else
+        {
+            // NOTE: This part of the scrollback is gone entirely
+            Scanned += Count;
+            Search->AtP += Count;
+            Search->DFAState = 0;
+            Search->EscapeState = 0;
+        }
     }
 
-    CloseHandle(StartupInfo.hStdInput);
-    CloseHandle(StartupInfo.hStdOutput);
-    CloseHandle(StartupInfo.hStdError);
+    LARGE_INTEGER EndTime;
+    QueryPerformanceCounter(&EndTime);
+    Search->ScanTicks += EndTime.QuadPart - StartTime.QuadPart;
+    Search->ScannedBytes += Scanned;
+
+    if(Search->AtP >= Search->EndP)
+    {
+        LARGE_INTEGER Frequency;
+        QueryPerformanceFrequency(&Frequency);
+        size_t Microseconds = (size_t)SafeRatio1(1000000*Search->ScanTicks, Frequency.QuadPart);
+
+        if(Search->HitCount > MaxReportedHits)
+        {
+            AppendOutput(Terminal, "...and %u more\n", (uint32_t)(Search->HitCount - MaxReportedHits));
+        }
+        AppendOutput(Terminal, "%u lines matched, %ukb searched (%ukb skipped by the index) in %u.%03ums (%umb/s)\n",
+                     (uint32_t)Search->HitCount, (uint32_t)(Search->ScannedBytes / 1024), (uint32_t)(Search->SkippedBytes / 1024),
+                     (uint32_t)(Microseconds / 1000), (uint32_t)(Microseconds % 1000),
+                     (uint32_t)SafeRatio1(Search->ScannedBytes, Microseconds));
+        Search->Mode = SearchMode_None;
+    }
+}
+
+static void HandleKeyDown(example_terminal *Terminal, WPARAM Key)
+{
+    switch(Key)
+    {
+        case VK_PRIOR:
+        {
+            Terminal->ViewingLineOffset -= Terminal->ScreenBuffer.DimY/2;
+        } break;
+
+        case VK_NEXT:
+        {
+            Terminal->ViewingLineOffset += Terminal->ScreenBuffer.DimY/2;
+        } break;
+    }
+
+    if(Terminal->ViewingLineOffset > 0)
+    {
+        Terminal->ViewingLineOffset = 0;
+    }
+
+    int32_t KeptLineCount = (int32_t)GetKeptLineCount(&Terminal->Lines);
+    if(Terminal->ViewingLineOffset < -KeptLineCount)
+    {
+        Terminal->ViewingLineOffset = -KeptLineCount;
+    }
+}
+
+static void HandleChar(example_terminal *Terminal, wchar_t Char)
+{
+    // NOTE: Running the command on return is left to the caller, so replay can skip it, since
+    // what the command printed is already in the recording
+    switch(Char)
+    {
+        case VK_BACK:
+        {
+            while((Terminal->CommandLineCount > 0) &&
+                  IsUTF8Extension(Terminal->CommandLine[Terminal->CommandLineCount - 1]))
+            {
+                --Terminal->CommandLineCount;
+            }
+
+            if(Terminal->CommandLineCount > 0)
+            {
+                --Terminal->CommandLineCount;
+            }
+        } break;
+
+        case VK_RETURN:
+        {
+            Terminal->CommandLineCount = 0;
+            Terminal->ViewingLineOffset = 0;
+        } break;
+
+        default:
+        {
+            wchar_t Chars[2];
+            int CharCount = 0;
+
+            if(IS_HIGH_SURROGATE(Char))
+            {
+                Terminal->LastChar = Char;
+            }
+            else if(IS_LOW_SURROGATE(Char))
+            {
+                if(IS_SURROGATE_PAIR(Terminal->LastChar, Char))
+                {
+                    Chars[0] = Terminal->LastChar;
+                    Chars[1] = Char;
+                    CharCount = 2;
+                }
+                Terminal->LastChar = 0;
+            }
+            else
+            {
+                Chars[0] = Char;
+                CharCount = 1;
+            }
+
+            if(CharCount)
+            {
+                DWORD SpaceLeft = ArrayCount(Terminal->CommandLine) - Terminal->CommandLineCount;
+                Terminal->CommandLineCount +=
+                    WideCharToMultiByte(CP_UTF8, 0,
+                                        Chars, CharCount,
+                                        Terminal->CommandLine + Terminal->CommandLineCount,
+                                        SpaceLeft, 0, 0);
+            }
+        } break;
+    }
+}
+
+static void ResizeScreenBuffer(example_terminal *Terminal, uint32_t DimX, uint32_t DimY)
+{
+    if(DimX > Terminal->REFTERM_MAX_WIDTH) DimX = Terminal->REFTERM_MAX_WIDTH;
+    if(DimY > Terminal->REFTERM_MAX_HEIGHT) DimY = Terminal->REFTERM_MAX_HEIGHT;
+
+    if(((Terminal->ScreenBuffer.DimX != DimX) ||
+        (Terminal->ScreenBuffer.DimY != DimY)) &&
+       ResizeTerminalBuffer(Terminal, &Terminal->ScreenBuffer, DimX, DimY))
+    {
+        RecordEvent(&Terminal->Recorder, RecordType_Resize, DimX, DimY);
+
+        if(Terminal->PseudoConsole)
+        {
+            COORD Size = {(SHORT)DimX, (SHORT)DimY};
+            Terminal->ResizePseudoConsole(Terminal->PseudoConsole, Size);
+        }
+    }
+}
+
+static void LayoutUnderLock(example_terminal *Terminal)
+{
+    // NOTE: For callers that already hold the lock and need the screen to match the scrollback
+    // now, rather than whenever the ingest thread next publishes
+    LARGE_INTEGER Now;
+    QueryPerformanceCounter(&Now);
+    PublishSnapshot(Terminal, Now.QuadPart);
+
+    terminal_snapshot Snapshot = Terminal->Snapshot;
+    LayoutSnapshot(Terminal, &Snapshot, GetOldestLineNumber(&Terminal->Lines), 1);
+}
+
+static uint64_t ComputeGridHash(example_terminal *Terminal)
+{
+    // NOTE: FNV-1a over the size and every cell top to bottom, with cached glyphs identified by
+    // their hash rather than by wherever they happen to sit in the cache texture this run.  Cells
+    // past the end of a row are hashed as the blank cells they show as.
+    terminal_buffer *Buffer = &Terminal->ScreenBuffer;
+    renderer_cell Blank;
+    ClearCellCount(Terminal, 1, &Blank);
+    uint64_t Result = 0xcbf29ce484222325ull;
+
+    uint64_t Dim = ((uint64_t)Buffer->DimY << 32) | Buffer->DimX;
+    for(uint32_t ByteIndex = 0; ByteIndex < sizeof(Dim); ++ByteIndex)
+    {
+        Result = (Result ^ ((Dim >> (8*ByteIndex)) & 0xff))*0x100000001b3ull;
+    }
+
+    for(uint32_t Row = 0; Row < Buffer->DimY; ++Row)
+    {
+        uint32_t Y = (Buffer->FirstLineY + Row) % Buffer->DimY;
+        for(uint32_t Column = 0; Column < Buffer->DimX; ++Column)
+        {
+            renderer_cell *Cell = (Column < Buffer->RowLengths[Y]) ? (Buffer->Cells + Y*Buffer->DimX + Column) : &Blank;
+            uint64_t Words[3] = {Cell->GlyphIndex, Cell->Foreground, Cell->Background};
+
+            glyph_hash GlyphHash;
+            gpu_glyph_index GPUIndex = {Cell->GlyphIndex};
+            if(GetGlyphHashForGPUIndex(Terminal->GlyphTable, GPUIndex, &GlyphHash))
+            {
+                Words[0] = (uint64_t)_mm_cvtsi128_si64(GlyphHash.Value) | ((uint64_t)1 << 63);
+            }
+
+            unsigned char *Bytes = (unsigned char *)Words;
+            for(uint32_t ByteIndex = 0; ByteIndex < sizeof(Words); ++ByteIndex)
+            {
+                Result = (Result ^ Bytes[ByteIndex])*0x100000001b3ull;
+            }
+        }
+    }
 
     return Result;
 }
 
+static void AppendReplayResults(char *Line)
+{
+    // NOTE: Every replay adds a line, so runs of the same recording on different builds end up
+    // side by side
+    HANDLE File = CreateFileA("refterm_replay.csv", FILE_APPEND_DATA, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if(File != INVALID_HANDLE_VALUE)
+    {
+        DWORD Written = 0;
+        if(GetLastError() != ERROR_ALREADY_EXISTS)
+        {
+            char Header[] = "version,recording,mode,grid_hash,matched,bytes,frames,total_us,parse_us,layout_us,max_layout_us,recorded_us\r\n";
+            WriteFile(File, Header, sizeof(Header) - 1, &Written, 0);
+        }
+        WriteFile(File, Line, lstrlenA(Line), &Written, 0);
+        CloseHandle(File);
+    }
+}
+
+static void ReplayRecording(example_terminal *Terminal, char *FileName, int RealTime)
+{
+    /* NOTE: Replay runs on the render thread with the lock held, and the ingest thread holds off
+       while Replaying is set, so nothing else touches the terminal until it finishes - realtime
+       replay lets go of the lock while it waits, so the ingest thread isn't stuck on it.  It never
+       draws, so the numbers are just parsing and layout.  Data goes through the same CommitAndParse the ingest thread uses, and there is a
+       layout for every frame the recording saw.  Commands are not run again, since their output
+       is already in the recording, but what was typed still shows on the command line.
+    */
+    recording_reader Reader;
+    if(Terminal->Recorder.Active)
+    {
+        AppendOutput(Terminal, "Replay: can't replay while recording\n");
+    }
+    else if(!OpenRecording(&Reader, FileName))
+    {
+        AppendOutput(Terminal, "Replay: %s is missing or not a recording\n", FileName);
+    }
+    else
+    {
+        DrainFastPipeReads(Terminal);
+        Terminal->Replaying = 1;
+
+        // NOTE: Start from the same empty screen the recording did
+        int OldLineWrap = Terminal->LineWrap;
+        Terminal->LineWrap = Reader.Header.LineWrap;
+        ClearCursor(Terminal, &Terminal->RunningCursor);
+        ResetLineIndex(&Terminal->Lines, GetCurrentAbsoluteP(&Terminal->ScrollBackBuffer), Terminal->RunningCursor.Props);
+        Terminal->CommandLineCount = 0;
+        Terminal->ViewingLineOffset = 0;
+        Terminal->LastChar = 0;
+        ResizeScreenBuffer(Terminal, Reader.Header.DimX, Reader.Header.DimY);
+
+        int64_t Frequency = Terminal->Telemetry.TicksPerSecond;
+        int64_t StartTicks = GetTelemetryTicks();
+        int64_t RecordedTicks = 0;
+        int64_t ParseTicks = 0;
+        int64_t LayoutTicks = 0;
+        int64_t MaxLayoutTicks = 0;
+        uint64_t DataBytes = 0;
+        uint32_t FrameCount = 0;
+        int Ended = 0;
+        uint64_t RecordedGridHash = 0;
+
+        recording_entry Entry;
+        while(!Ended && ReadRecordingEntry(&Reader, &Entry))
+        {
+            RecordedTicks += Entry.DeltaTicks;
+            if(RealTime)
+            {
+                int64_t DueTicks = StartTicks + RecordedTicks*Frequency/Reader.Header.TicksPerSecond;
+                int64_t NowTicks = GetTelemetryTicks();
+                if(NowTicks < DueTicks)
+                {
+                    LeaveCriticalSection(&Terminal->Lock);
+                    Sleep((DWORD)((DueTicks - NowTicks)*1000/Frequency));
+                    EnterCriticalSection(&Terminal->Lock);
+                }
+            }
+
+            switch(Entry.Type)
+            {
+                case RecordType_Data:
+                {
+                    int64_t ParseStartTicks = GetTelemetryTicks();
+                    size_t Offset = 0;
+                    while(Offset < Entry.Count)
+                    {
+                        size_t ChunkSize = Entry.Count - Offset;
+                        if(ChunkSize > 64*1024) ChunkSize = 64*1024;
+
+                        source_buffer_range Dest = GetNextWritableRange(&Terminal->ScrollBackBuffer, ChunkSize);
+                        if(!Dest.Count)
+                        {
+                            break;
+                        }
+
+                        __movsb((unsigned char *)Dest.Data, (unsigned char *)Entry.Data + Offset, Dest.Count);
+                        CommitAndParse(Terminal, Dest);
+                        Offset += Dest.Count;
+                    }
+                    ParseTicks += GetTelemetryTicks() - ParseStartTicks;
+                    DataBytes += Entry.Count;
+                } break;
+
+                case RecordType_KeyDown:
+                {
+                    HandleKeyDown(Terminal, Entry.A);
+                } break;
+
+                case RecordType_Char:
+                {
+                    HandleChar(Terminal, (wchar_t)Entry.A);
+                } break;
+
+                case RecordType_Resize:
+                {
+                    ResizeScreenBuffer(Terminal, Entry.A, Entry.B);
+                } break;
+
+                case RecordType_Frame:
+                {
+                    int64_t LayoutStartTicks = GetTelemetryTicks();
+                    LayoutUnderLock(Terminal);
+                    int64_t Ticks = GetTelemetryTicks() - LayoutStartTicks;
+                    LayoutTicks += Ticks;
+                    if(MaxLayoutTicks < Ticks) MaxLayoutTicks = Ticks;
+                    ++FrameCount;
+                } break;
+
+                case RecordType_End:
+                {
+                    RecordedGridHash = Entry.GridHash;
+                    Ended = 1;
+                } break;
+            }
+        }
+
+        // NOTE: Recording hashes the screen the same way when it stops
+        LayoutUnderLock(Terminal);
+        uint64_t GridHash = ComputeGridHash(Terminal);
+        int64_t TotalTicks = GetTelemetryTicks() - StartTicks;
+
+        CloseRecording(&Reader);
+        Terminal->Replaying = 0;
+        Terminal->LineWrap = OldLineWrap;
+
+        int Matched = (Ended && (GridHash == RecordedGridHash));
+        uint32_t RecordedUS = (uint32_t)(RecordedTicks*1000000/Reader.Header.TicksPerSecond);
+        char *Mode = RealTime ? "realtime" : "fast";
+        AppendOutput(Terminal, "Replay: %s in %ums (recorded %ums), %ukb, %u frames, %uus parsing, %uus/frame layout (%uus max)\n",
+                     FileName, TelemetryMicroseconds(&Terminal->Telemetry, TotalTicks)/1000, RecordedUS/1000,
+                     (uint32_t)(DataBytes/1024), FrameCount, TelemetryMicroseconds(&Terminal->Telemetry, ParseTicks),
+                     (uint32_t)SafeRatio1(TelemetryMicroseconds(&Terminal->Telemetry, LayoutTicks), FrameCount),
+                     TelemetryMicroseconds(&Terminal->Telemetry, MaxLayoutTicks));
+        AppendOutput(Terminal, "Replay: grid %08x%08x %s\n", (uint32_t)(GridHash >> 32), (uint32_t)GridHash,
+                     !Ended ? "(recording was cut short, nothing to compare)" :
+                     Matched ? "matches the recording" : "DIFFERS from the recording");
+
+        char Line[512];
+        wsprintfA(Line, "%u,%s,%s,%08x%08x,%u,%u,%u,%u,%u,%u,%u,%u\r\n", REFTERM_VERSION, FileName, Mode,
+                  (uint32_t)(GridHash >> 32), (uint32_t)GridHash, Matched, (uint32_t)DataBytes, FrameCount,
+                  TelemetryMicroseconds(&Terminal->Telemetry, TotalTicks),
+                  TelemetryMicroseconds(&Terminal->Telemetry, ParseTicks),
+                  TelemetryMicroseconds(&Terminal->Telemetry, LayoutTicks),
+                  TelemetryMicroseconds(&Terminal->Telemetry, MaxLayoutTicks), RecordedUS);
+        AppendReplayResults(Line);
+    }
+}
+
 static int StringsAreEqual(char *A, char *B)
 {
     if(A && B)
@@ -918,6 +3095,9 @@ RefreshFont(example_terminal *Terminal)
 
     InitializeDirectGlyphTable(Params, Terminal->ReservedTileTable, 1);
 
+    // NOTE: Cells laid out with the old font are no longer valid
+    AdvanceFontGeneration(Terminal);
+
     //
     // NOTE(casey): Pre-rasterize all the ASCII characters, since they are directly mapped rather than hash-mapped.
     //
@@ -942,6 +3122,13 @@ RefreshFont(example_terminal *Terminal)
     return Result;
 }
 
+static char *FlowControlModeNames[FlowControl_Count] =
+{
+    "drop oldest",
+    "block producer",
+    "coalesce frames",
+};
+
 static void ExecuteCommandLine(example_terminal *Terminal)
 {
     // TODO(casey): All of this is complete garbage and should never ever be used.
@@ -953,38 +3140,273 @@ static void ExecuteCommandLine(example_terminal *Terminal)
         if(Terminal->CommandLine[ParamStart] == ' ') break;
         ++ParamStart;
     }
-
-    char *A = Terminal->CommandLine;
-    char *B = Terminal->CommandLine + ParamStart;
-    *B = 0;
-    if(ParamStart < Terminal->CommandLineCount)
+
+    char *A = Terminal->CommandLine;
+    char *B = Terminal->CommandLine + ParamStart;
+    *B = 0;
+    if(ParamStart < Terminal->CommandLineCount)
+    {
+        ++ParamStart;
+        ++B;
+    }
+
+    source_buffer_range ParamRange = {0};
+    ParamRange.Data = B;
+    ParamRange.Count = Terminal->CommandLineCount - ParamStart;
+
+    // TODO(casey): Collapse all these options into a little array, so there's no
+    // copy-pasta.
+    AppendOutput(Terminal, "\n");
+    if(StringsAreEqual(Terminal->CommandLine, "status"))
+    {
+        ClearProps(Terminal, &Terminal->RunningCursor.Props);
+        AppendOutput(Terminal, "RefTerm v%u\n", REFTERM_VERSION);
+        AppendOutput(Terminal, "Size: %u x %u\n", Terminal->ScreenBuffer.DimX, Terminal->ScreenBuffer.DimY);
+        AppendOutput(Terminal, "Fast pipe: %s\n", Terminal->EnableFastPipe ? "ON" : "off");
+        AppendOutput(Terminal, "Fast pipe read-ahead: %s (%u x %ukb, %umb moved to close gaps, %u waits on layout)\n",
+                     Terminal->FastPipeReadAhead ? "ON" : "off", FAST_PIPE_READ_COUNT,
+                     (uint32_t)(Terminal->FastPipeReads.ChunkSize / 1024),
+                     (uint32_t)(Terminal->FastPipeReads.CompactedBytes / (1024*1024)),
+                     (uint32_t)Terminal->FastPipeReads.PinStallCount);
+        AppendOutput(Terminal, "Pseudoconsole: %s\n", !Terminal->CreatePseudoConsole ? "unavailable" :
+                     Terminal->EnablePseudoConsole ? "ON" : "off");
+        AppendOutput(Terminal, "Fast ring: %s%s\n", Terminal->EnableFastRing ? "ON" : "off",
+                     Terminal->FastRing.Header ? " (child has one)" : "");
+        AppendOutput(Terminal, "Recording: %s (%u records, %ukb)\n", Terminal->Recorder.Active ? "ON" : "off",
+                     (uint32_t)Terminal->Recorder.RecordCount, (uint32_t)(Terminal->Recorder.DataBytes / 1024));
+        AppendOutput(Terminal, "Font: %S %u\n", Terminal->RequestedFontName, Terminal->RequestedFontHeight);
+        AppendOutput(Terminal, "Line Wrap: %s\n", Terminal->LineWrap ? "ON" : "off");
+        AppendOutput(Terminal, "Debug: %s\n", Terminal->DebugHighlighting ? "ON" : "off");
+        AppendOutput(Terminal, "Throttling: %s\n", !Terminal->NoThrottle ? "ON" : "off");
+        AppendOutput(Terminal, "Rendering: %s\n", !Terminal->DisableRendering ? "ON" : "off");
+        AppendOutput(Terminal, "Compact cells: %s (%u color pairs last frame)\n", Terminal->Renderer.UseCompactCells ? "ON" : "off",
+                     Terminal->Renderer.Palette ? Terminal->Renderer.Palette->Count : 0);
+        AppendOutput(Terminal, "Damage rects: %s (%u pixels composed last frame)\n", !Terminal->Renderer.DisableDamageRects ? "ON" : "off",
+                     Terminal->Renderer.Damage.ComposedPixels);
+        AppendOutput(Terminal, "Ingest: %umb total, %umb/s, %u bytes/syscall, %u%% CPU\n",
+                     (uint32_t)(Terminal->IngestedBytes / (1024*1024)), (uint32_t)(Terminal->IngestBytesPerSecond / (1024*1024)),
+                     (uint32_t)Terminal->IngestBytesPerSyscall, Terminal->IngestCPUPercent);
+        ingest_policy *Policy = &Terminal->IngestPolicy;
+        AppendOutput(Terminal, "Ingest policy: %ums target, %ukb-%ukb reads (%ukb now), %uus worst echo latency\n",
+                     Policy->LatencyTargetMS, (uint32_t)(Policy->MinReadSize / 1024), (uint32_t)(Policy->MaxReadSize / 1024),
+                     (uint32_t)(GetIngestReadSize(Policy) / 1024), Terminal->EchoLatencyUS);
+        flow_control *Flow = &Terminal->Flow;
+        AppendOutput(Terminal, "Flow control: %s, %ukb-%ukb backlog, engaged %u times\n",
+                     FlowControlModeNames[Flow->Mode], (uint32_t)(Flow->LowWatermark / 1024),
+                     (uint32_t)(Flow->HighWatermark / 1024), (uint32_t)Flow->EngagedCount);
+        AppendOutput(Terminal, "Flow control: %umb dropped unseen, %ums producer stalled, %u frames coalesced\n",
+                     (uint32_t)(Flow->DroppedBytes / (1024*1024)),
+                     (uint32_t)(Flow->StallTicks * 1000 / Terminal->IngestPolicy.TicksPerSecond),
+                     (uint32_t)Flow->CoalescedCount);
+        render_scheduler *Scheduler = &Terminal->Scheduler;
+        AppendOutput(Terminal, "Render: %uHz, %u frames, %u wakeups coalesced, %uus/frame, %uus input-to-photon\n",
+                     (uint32_t)SafeRatio1(Scheduler->TicksPerSecond, Scheduler->RefreshTicks), (uint32_t)Scheduler->FrameCount,
+                     (uint32_t)Scheduler->CoalescedWakeCount,
+                     (uint32_t)SafeRatio1(Scheduler->FrameTicks * 1000000, Scheduler->TicksPerSecond),
+                     (uint32_t)SafeRatio1(Scheduler->InputToPhotonTicks * 1000000, Scheduler->TicksPerSecond));
+        AppendOutput(Terminal, "Layout: %u retried, %u under the lock\n",
+                     (uint32_t)Terminal->LayoutRetryCount, (uint32_t)Terminal->LockedLayoutCount);
+
+        glyph_table_stats GlyphStats = GetGlyphTableStats(Terminal->GlyphTable);
+        size_t GlyphLookupCount = GlyphStats.HitCount + GlyphStats.MissCount;
+        size_t ProbeLength100 = SafeRatio1(100*GlyphStats.ProbeCount, GlyphLookupCount);
+        AppendOutput(Terminal, "Glyph cache: %u%% hits (%u/%u), %u recycled, %u.%02u probes/lookup (%u max)\n",
+                     (uint32_t)SafeRatio1(100*GlyphStats.HitCount, GlyphLookupCount), (uint32_t)GlyphStats.HitCount,
+                     (uint32_t)GlyphLookupCount, (uint32_t)GlyphStats.RecycleCount,
+                     (uint32_t)(ProbeLength100 / 100), (uint32_t)(ProbeLength100 % 100), (uint32_t)GlyphStats.MaxProbeLength);
+        size_t *Ages = GlyphStats.EvictionAgeCounts;
+        AppendOutput(Terminal, "Glyph evictions by age in lookups: <4:%u <16:%u <64:%u <256:%u <1k:%u <4k:%u <16k:%u older:%u\n",
+                     (uint32_t)Ages[0], (uint32_t)Ages[1], (uint32_t)Ages[2], (uint32_t)Ages[3],
+                     (uint32_t)Ages[4], (uint32_t)Ages[5], (uint32_t)Ages[6], (uint32_t)Ages[7]);
+        glyph_table_census Census = GetGlyphTableCensus(Terminal->GlyphTable);
+        uint32_t *Chains = Census.ChainLengthCounts;
+        AppendOutput(Terminal, "Glyph entries: %u used (%u sized, %u rasterized), %u free\n",
+                     Census.UsedEntryCount, Census.StateCounts[GlyphState_Sized],
+                     Census.StateCounts[GlyphState_Rasterized], Census.FreeEntryCount);
+        AppendOutput(Terminal, "Glyph hash chains by length: 0:%u 1:%u 2:%u 3:%u 4:%u 5:%u 6:%u longer:%u\n",
+                     Chains[0], Chains[1], Chains[2], Chains[3], Chains[4], Chains[5], Chains[6], Chains[7]);
+
+        layout_cache *Cache = &Terminal->LayoutCache;
+        size_t LookupCount = Cache->HitCount + Cache->MissCount;
+        AppendOutput(Terminal, "Layout cache: %u%% hits (%u/%u), %ukb\n",
+                     (uint32_t)SafeRatio1(100*Cache->HitCount, LookupCount), (uint32_t)Cache->HitCount, (uint32_t)LookupCount,
+                     (uint32_t)(GetLayoutCacheFootprint(Cache) / 1024));
+
+        line_index *Index = &Terminal->Lines;
+        size_t KeptLineCount = GetKeptLineCount(Index);
+        size_t BytesPerLine100 = SafeRatio1(100*GetLineIndexFootprint(Index), KeptLineCount);
+        AppendOutput(Terminal, "Line index: %u lines (%u max), %u.%02u bytes/line, %u cycles/lookup\n",
+                     (uint32_t)KeptLineCount, (uint32_t)(Index->LineMask + 1 - LINE_BLOCK_SIZE),
+                     (uint32_t)(BytesPerLine100 / 100), (uint32_t)(BytesPerLine100 % 100),
+                     (uint32_t)MeasureLineLookupCycles(Index));
+
+        trigram_index *Trigrams = &Terminal->TrigramIndex;
+        AppendOutput(Terminal, "Trigram index: %u blocks (%u missed), %ukb, %u%% of a core max\n",
+                     (uint32_t)Trigrams->IndexedBlockCount, (uint32_t)Trigrams->MissedBlockCount,
+                     (uint32_t)(GetTrigramIndexFootprint(Trigrams) / 1024), Trigrams->BudgetPercent);
+
+        cold_store *Cold = &Terminal->ScrollBackBuffer.ColdStore;
+        if(Cold->Arena)
+        {
+            size_t CompressedBytes = Cold->CompressedBytes;
+            size_t Ratio100 = SafeRatio1(100*Cold->RawBytes, CompressedBytes);
+            AppendOutput(Terminal, "Cold scrollback: %u segments (%umb -> %umb, %u.%02ux), %u cycles/byte to archive\n",
+                         (uint32_t)(Cold->SegmentCount - Cold->FirstSegment),
+                         (uint32_t)(Cold->RawBytes / (1024*1024)), (uint32_t)(CompressedBytes / (1024*1024)),
+                         (uint32_t)(Ratio100 / 100), (uint32_t)(Ratio100 % 100),
+                         (uint32_t)SafeRatio1(Cold->CompressCycles, Cold->RawBytes));
+            AppendOutput(Terminal, "Cold reads: %u decodes, %u cycles/decode, %u cycles/random read\n",
+                         (uint32_t)Cold->DecodeCount, (uint32_t)SafeRatio1(Cold->DecodeCycles, Cold->DecodeCount),
+                         (uint32_t)MeasureColdReadCycles(&Terminal->ScrollBackBuffer));
+        }
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "fastpipe"))
+    {
+        Terminal->EnableFastPipe = !Terminal->EnableFastPipe;
+        AppendOutput(Terminal, "Fast pipe: %s\n", Terminal->EnableFastPipe ? "ON" : "off");
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "fastring"))
+    {
+        Terminal->EnableFastRing = !Terminal->EnableFastRing;
+        AppendOutput(Terminal, "Fast ring: %s\n", Terminal->EnableFastRing ? "ON" : "off");
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "ingest"))
+    {
+        // NOTE: ingest <latency target in ms> <largest read in kb>
+        ingest_policy *Policy = &Terminal->IngestPolicy;
+        uint32_t LatencyTargetMS = ParseNumber(&ParamRange);
+        if(PeekToken(&ParamRange, 0) == ' ') GetToken(&ParamRange);
+        uint32_t MaxReadKB = ParseNumber(&ParamRange);
+
+        if(LatencyTargetMS) Policy->LatencyTargetMS = LatencyTargetMS;
+        if(MaxReadKB) Policy->MaxReadSize = (size_t)MaxReadKB*1024;
+        if(Policy->MaxReadSize < Policy->MinReadSize) Policy->MaxReadSize = Policy->MinReadSize;
+
+        AppendOutput(Terminal, "Ingest policy: %ums target, %ukb largest read\n",
+                     Policy->LatencyTargetMS, (uint32_t)(Policy->MaxReadSize / 1024));
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "flow"))
+    {
+        // NOTE: flow on its own cycles the mode, flow <high kb> <low kb> sets the watermarks,
+        // with the low one at half the high one if it's left off
+        flow_control *Flow = &Terminal->Flow;
+        if(ParamRange.Count)
+        {
+            uint32_t HighKB = ParseNumber(&ParamRange);
+            if(PeekToken(&ParamRange, 0) == ' ') GetToken(&ParamRange);
+            int HasLow = IsDigit(PeekToken(&ParamRange, 0));
+            uint32_t LowKB = ParseNumber(&ParamRange);
+
+            // NOTE: Kept well short of the whole ring, since layout still needs the screenful before LaidOutP
+            size_t MaxHighWatermark = Terminal->ScrollBackBuffer.DataSize / 2;
+            if(HighKB) Flow->HighWatermark = (size_t)HighKB*1024;
+            if(Flow->HighWatermark > MaxHighWatermark) Flow->HighWatermark = MaxHighWatermark;
+            Flow->LowWatermark = HasLow ? (size_t)LowKB*1024 : Flow->HighWatermark / 2;
+            if(Flow->LowWatermark >= Flow->HighWatermark) Flow->LowWatermark = Flow->HighWatermark / 2;
+        }
+        else
+        {
+            Flow->Mode = (Flow->Mode + 1) % FlowControl_Count;
+        }
+
+        AppendOutput(Terminal, "Flow control: %s, %ukb-%ukb backlog\n", FlowControlModeNames[Flow->Mode],
+                     (uint32_t)(Flow->LowWatermark / 1024), (uint32_t)(Flow->HighWatermark / 1024));
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "telemetry"))
+    {
+        // NOTE: telemetry csv or telemetry trace writes the last TELEMETRY_FRAME_COUNT frames out
+        // to the current directory, the trace being Chrome's JSON format (chrome://tracing, Perfetto)
+        int Format = StringsAreEqual(B, "trace") ? TelemetryFormat_Trace : TelemetryFormat_CSV;
+        char *FileName = (Format == TelemetryFormat_Trace) ? "refterm_trace.json" : "refterm_telemetry.csv";
+
+        uint32_t FrameCount = 0;
+        if(WriteTelemetryFile(&Terminal->Telemetry, FileName, Format, &FrameCount))
+        {
+            AppendOutput(Terminal, "Telemetry: %u frames written to %s\n", FrameCount, FileName);
+        }
+        else
+        {
+            AppendOutput(Terminal, "Telemetry: unable to write %s\n", FileName);
+        }
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "record"))
+    {
+        // NOTE: record <file> clears the screen and starts recording, record on its own stops
+        recorder *Recorder = &Terminal->Recorder;
+        if(Recorder->Active)
+        {
+            LayoutUnderLock(Terminal);
+            uint64_t GridHash = ComputeGridHash(Terminal);
+            uint64_t RecordCount = Recorder->RecordCount;
+            uint64_t DataBytes = Recorder->DataBytes;
+            int Written = StopRecorder(Recorder, GridHash);
+            AppendOutput(Terminal, "Record: %s, %u records, %ukb, grid %08x%08x\n",
+                         Written ? "stopped" : "stopped, but the file could not be written", (uint32_t)RecordCount,
+                         (uint32_t)(DataBytes / 1024), (uint32_t)(GridHash >> 32), (uint32_t)GridHash);
+        }
+        else if(!*B)
+        {
+            AppendOutput(Terminal, "Usage: record <file>, then record again to stop\n");
+        }
+        else
+        {
+            DrainFastPipeReads(Terminal);
+            ClearCursor(Terminal, &Terminal->RunningCursor);
+            ResetLineIndex(&Terminal->Lines, GetCurrentAbsoluteP(&Terminal->ScrollBackBuffer), Terminal->RunningCursor.Props);
+
+            recording_header Header = {0};
+            Header.TicksPerSecond = Terminal->Telemetry.TicksPerSecond;
+            Header.DimX = Terminal->ScreenBuffer.DimX;
+            Header.DimY = Terminal->ScreenBuffer.DimY;
+            Header.LineWrap = Terminal->LineWrap;
+            if(StartRecorder(Recorder, B, Header))
+            {
+                AppendOutput(Terminal, "Record: recording to %s\n", B);
+            }
+            else
+            {
+                AppendOutput(Terminal, "Record: unable to write %s\n", B);
+            }
+        }
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "replay"))
     {
-        ++ParamStart;
-        ++B;
-    }
-
-    source_buffer_range ParamRange = {0};
-    ParamRange.Data = B;
-    ParamRange.Count = Terminal->CommandLineCount - ParamStart;
+        // NOTE: replay <file> runs as fast as it can, replay <file> realtime keeps the recorded pace
+        char *FileName = B;
+        int RealTime = 0;
+        char *Space = B;
+        while(*Space && (*Space != ' ')) ++Space;
+        if(*Space)
+        {
+            *Space = 0;
+            RealTime = StringsAreEqual(Space + 1, "realtime");
+        }
 
-    // TODO(casey): Collapse all these options into a little array, so there's no
-    // copy-pasta.
-    AppendOutput(Terminal, "\n");
-    if(StringsAreEqual(Terminal->CommandLine, "status"))
+        if(*FileName)
+        {
+            ReplayRecording(Terminal, FileName, RealTime);
+        }
+        else
+        {
+            AppendOutput(Terminal, "Usage: replay <file> [realtime]\n");
+        }
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "readahead"))
     {
-        ClearProps(Terminal, &Terminal->RunningCursor.Props);
-        AppendOutput(Terminal, "RefTerm v%u\n", REFTERM_VERSION);
-        AppendOutput(Terminal, "Size: %u x %u\n", Terminal->ScreenBuffer.DimX, Terminal->ScreenBuffer.DimY);
-        AppendOutput(Terminal, "Fast pipe: %s\n", Terminal->EnableFastPipe ? "ON" : "off");
-        AppendOutput(Terminal, "Font: %S %u\n", Terminal->RequestedFontName, Terminal->RequestedFontHeight);
-        AppendOutput(Terminal, "Line Wrap: %s\n", Terminal->LineWrap ? "ON" : "off");
-        AppendOutput(Terminal, "Debug: %s\n", Terminal->DebugHighlighting ? "ON" : "off");
-        AppendOutput(Terminal, "Throttling: %s\n", !Terminal->NoThrottle ? "ON" : "off");
+        Terminal->FastPipeReadAhead = !Terminal->FastPipeReadAhead;
+        AppendOutput(Terminal, "Fast pipe read-ahead: %s\n", Terminal->FastPipeReadAhead ? "ON" : "off");
     }
-    else if(StringsAreEqual(Terminal->CommandLine, "fastpipe"))
+    else if(StringsAreEqual(Terminal->CommandLine, "conpty"))
     {
-        Terminal->EnableFastPipe = !Terminal->EnableFastPipe;
-        AppendOutput(Terminal, "Fast pipe: %s\n", Terminal->EnableFastPipe ? "ON" : "off");
+        if(Terminal->CreatePseudoConsole)
+        {
+            Terminal->EnablePseudoConsole = !Terminal->EnablePseudoConsole;
+            AppendOutput(Terminal, "Pseudoconsole: %s\n", Terminal->EnablePseudoConsole ? "ON" : "off");
+        }
+        else
+        {
+            AppendOutput(Terminal, "Pseudoconsoles aren't supported on this version of Windows.\n");
+        }
     }
     else if(StringsAreEqual(Terminal->CommandLine, "linewrap"))
     {
@@ -996,6 +3418,28 @@ static void ExecuteCommandLine(example_terminal *Terminal)
         Terminal->DebugHighlighting = !Terminal->DebugHighlighting;
         AppendOutput(Terminal, "Debug: %s\n", Terminal->DebugHighlighting ? "ON" : "off");
     }
+    else if(StringsAreEqual(Terminal->CommandLine, "render"))
+    {
+        Terminal->DisableRendering = !Terminal->DisableRendering;
+        AppendOutput(Terminal, "Rendering: %s\n", !Terminal->DisableRendering ? "ON" : "off");
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "compact"))
+    {
+        if(RENDERER_SHADER_HEADERS_CURRENT)
+        {
+            Terminal->Renderer.UseCompactCells = !Terminal->Renderer.UseCompactCells;
+            AppendOutput(Terminal, "Compact cells: %s\n", Terminal->Renderer.UseCompactCells ? "ON" : "off");
+        }
+        else
+        {
+            AppendOutput(Terminal, "Compact cells: unavailable until the shader headers are rebuilt from refterm.hlsl\n");
+        }
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "damage"))
+    {
+        Terminal->Renderer.DisableDamageRects = !Terminal->Renderer.DisableDamageRects;
+        AppendOutput(Terminal, "Damage rects: %s\n", !Terminal->Renderer.DisableDamageRects ? "ON" : "off");
+    }
     else if(StringsAreEqual(Terminal->CommandLine, "throttle"))
     {
         Terminal->NoThrottle = !Terminal->NoThrottle;
@@ -1021,11 +3465,24 @@ static void ExecuteCommandLine(example_terminal *Terminal)
     {
         KillProcess(Terminal);
     }
+    else if(StringsAreEqual(Terminal->CommandLine, "find"))
+    {
+        StartSearch(Terminal, SearchMode_Literal, ParamRange);
+    }
+    else if(StringsAreEqual(Terminal->CommandLine, "findre"))
+    {
+        StartSearch(Terminal, SearchMode_Regex, ParamRange);
+    }
     else if((StringsAreEqual(Terminal->CommandLine, "clear")) ||
             (StringsAreEqual(Terminal->CommandLine, "cls")))
     {
         ClearCursor(Terminal, &Terminal->RunningCursor);
-        memset(Terminal->Lines, 0, Terminal->MaxLineCount*sizeof(example_line));
+        ResetLineIndex(&Terminal->Lines, GetCurrentAbsoluteP(&Terminal->ScrollBackBuffer), Terminal->RunningCursor.Props);
+
+        // NOTE: Layout walks the published snapshot, not the line index, so it has to see the reset
+        LARGE_INTEGER Now;
+        QueryPerformanceCounter(&Now);
+        PublishSnapshot(Terminal, Now.QuadPart);
     }
     else if((StringsAreEqual(Terminal->CommandLine, "exit")) ||
             (StringsAreEqual(Terminal->CommandLine, "quit")))
@@ -1060,14 +3517,111 @@ static void ExecuteCommandLine(example_terminal *Terminal)
     }
 }
 
-static int IsUTF8Extension(char A)
+static render_scheduler InitRenderScheduler(int64_t TicksPerSecond, uint32_t RefreshHz, uint32_t BlinkMS, int64_t NowTicks)
 {
-    int Result = ((A & 0xc0) == 0x80);
+    render_scheduler Result = {0};
+
+    Result.TicksPerSecond = TicksPerSecond;
+    Result.RefreshTicks = TicksPerSecond / RefreshHz;
+    Result.BlinkTicks = TicksPerSecond*BlinkMS / 1000;
+    Result.StartTicks = NowTicks;
+    Result.LastFrameTicks = NowTicks - Result.RefreshTicks;
+
+    // NOTE: The first frame always has to happen
+    Result.DirtyReasons = RenderReason_Resize;
+    Result.FirstDirtyTicks = NowTicks;
+
+    return Result;
+}
+
+static void MarkRenderDirty(render_scheduler *Scheduler, uint32_t Reason, int64_t EventTicks)
+{
+    if(!Scheduler->DirtyReasons || (Scheduler->FirstDirtyTicks > EventTicks))
+    {
+        Scheduler->FirstDirtyTicks = EventTicks;
+    }
+    Scheduler->DirtyReasons |= Reason;
+}
+
+static int UpdateRenderBlink(render_scheduler *Scheduler, int64_t NowTicks)
+{
+    int Result = (int)(((NowTicks - Scheduler->StartTicks) / Scheduler->BlinkTicks) & 1);
+    if(Result != Scheduler->BlinkOn)
+    {
+        Scheduler->BlinkOn = Result;
+        MarkRenderDirty(Scheduler, RenderReason_Blink, NowTicks);
+    }
+
+    return Result;
+}
+
+static int64_t GetEarliestFrameTicks(render_scheduler *Scheduler)
+{
+    // NOTE: A little before a whole interval is up, since the frame latency wait holds the
+    // frame to the vblank anyway, and starting late would miss it
+    int64_t Result = Scheduler->LastFrameTicks + Scheduler->RefreshTicks - Scheduler->RefreshTicks/8;
+    return Result;
+}
+
+static DWORD GetRenderWaitMS(render_scheduler *Scheduler, int64_t NowTicks)
+{
+    // NOTE: If nothing else wakes the loop up, this is when the next frame is due - either the
+    // next refresh if something is waiting to be shown, or the next blink if not.  Rounded up,
+    // so the loop doesn't wake a hair early and spin.
+    int64_t Elapsed = NowTicks - Scheduler->StartTicks;
+    int64_t NextTicks = Scheduler->StartTicks + (Elapsed / Scheduler->BlinkTicks + 1)*Scheduler->BlinkTicks;
+    if(Scheduler->DirtyReasons)
+    {
+        NextTicks = GetEarliestFrameTicks(Scheduler);
+    }
+
+    DWORD Result = 0;
+    if(NextTicks > NowTicks)
+    {
+        Result = (DWORD)(((NextTicks - NowTicks)*1000 + Scheduler->TicksPerSecond - 1) / Scheduler->TicksPerSecond);
+    }
+
+    return Result;
+}
+
+static int ShouldRender(render_scheduler *Scheduler, int64_t NowTicks)
+{
+    int Result = 0;
+    if(Scheduler->DirtyReasons)
+    {
+        Result = (NowTicks >= GetEarliestFrameTicks(Scheduler));
+        if(!Result)
+        {
+            ++Scheduler->CoalescedWakeCount;
+        }
+    }
+
     return Result;
 }
 
-static void ProcessMessages(example_terminal *Terminal)
+static void RenderFrameDone(render_scheduler *Scheduler, int64_t StartTicks, int64_t EndTicks)
+{
+    // NOTE: Only changes somebody caused count toward input-to-photon, not blinks or resizes
+    if(Scheduler->DirtyReasons & (RenderReason_Content|RenderReason_Input))
+    {
+        int64_t InputToPhoton = EndTicks + Scheduler->RefreshTicks - Scheduler->FirstDirtyTicks;
+        if(Scheduler->MaxInputToPhotonTicks < InputToPhoton)
+        {
+            Scheduler->MaxInputToPhotonTicks = InputToPhoton;
+        }
+    }
+
+    Scheduler->FrameTicks += ((EndTicks - StartTicks) - Scheduler->FrameTicks) / 8;
+    Scheduler->LastFrameTicks = StartTicks;
+    Scheduler->DirtyReasons = 0;
+    ++Scheduler->FrameCount;
+}
+
+static int ProcessMessages(example_terminal *Terminal)
 {
+    // NOTE: Returns whether anything came in that could change what is on screen
+    int Result = 0;
+
     MSG Message;
     while(PeekMessage(&Message, 0, 0, 0, PM_REMOVE))
     {
@@ -1080,95 +3634,223 @@ static void ProcessMessages(example_terminal *Terminal)
 
             case WM_KEYDOWN:
             {
-                switch(Message.wParam)
-                {
-                    case VK_PRIOR:
-                    {
-                        Terminal->ViewingLineOffset -= Terminal->ScreenBuffer.DimY/2;
-                    } break;
+                Result = 1;
+                RecordEvent(&Terminal->Recorder, RecordType_KeyDown, (uint32_t)Message.wParam, 0);
+                HandleKeyDown(Terminal, Message.wParam);
+            } break;
 
-                    case VK_NEXT:
-                    {
-                        Terminal->ViewingLineOffset += Terminal->ScreenBuffer.DimY/2;
-                    } break;
+            case WM_CHAR:
+            {
+                // NOTE: A return is recorded after it runs, so the one that starts a recording
+                // isn't in it and the one that stops it is the only thing missing from the end
+                Result = 1;
+                wchar_t Char = (wchar_t)Message.wParam;
+                int WasRecording = Terminal->Recorder.Active;
+                if(Char != VK_RETURN)
+                {
+                    RecordEvent(&Terminal->Recorder, RecordType_Char, Char, 0);
                 }
 
-                if(Terminal->ViewingLineOffset > 0)
+                if(Char == VK_RETURN)
                 {
-                    Terminal->ViewingLineOffset = 0;
+                    EnterCriticalSection(&Terminal->Lock);
+                    ExecuteCommandLine(Terminal);
+                    LeaveCriticalSection(&Terminal->Lock);
                 }
+                HandleChar(Terminal, Char);
 
-                if(Terminal->ViewingLineOffset < -(int)Terminal->LineCount)
+                if((Char == VK_RETURN) && WasRecording)
                 {
-                    Terminal->ViewingLineOffset = -(int)Terminal->LineCount;
+                    RecordEvent(&Terminal->Recorder, RecordType_Char, Char, 0);
                 }
             } break;
+        }
+    }
 
-            case WM_CHAR:
+    return Result;
+}
+
+static int OtherInputIsPending(example_terminal *Terminal)
+{
+    // NOTE: Only peeks, so nothing moves the commit point.  A pipe that can't be peeked is
+    // counted as pending, so the read that finds out it broke still happens.
+    fast_ring_header *Header = Terminal->FastRing.Header;
+    int Result = (Header && (Header->WriteP != Terminal->FastRingReadP));
+
+    HANDLE Pipes[] = {Terminal->Legacy_ReadStdOut, Terminal->Legacy_ReadStdError};
+    for(uint32_t PipeIndex = 0; !Result && (PipeIndex < ArrayCount(Pipes)); ++PipeIndex)
+    {
+        if(Pipes[PipeIndex] != INVALID_HANDLE_VALUE)
+        {
+            DWORD PendingCount = 0;
+            ++Terminal->IngestSyscallCount;
+            Result = (!PeekNamedPipe(Pipes[PipeIndex], 0, 0, 0, &PendingCount, 0) || PendingCount);
+        }
+    }
+
+    return Result;
+}
+
+static DWORD WINAPI IngestThread(LPVOID Param)
+{
+    example_terminal *Terminal = (example_terminal *)Param;
+
+    while(!Terminal->Quit)
+    {
+        LARGE_INTEGER BatchStart;
+        QueryPerformanceCounter(&BatchStart);
+
+        EnterCriticalSection(&Terminal->Lock);
+        int64_t LockedTicks = GetTelemetryTicks();
+
+        size_t StartP = GetCurrentAbsoluteP(&Terminal->ScrollBackBuffer);
+        // NOTE: A replay owns the scrollback until it's done, including while it waits outside the lock
+        int Blocked = Terminal->Replaying ? 1 : UpdateFlowControl(Terminal, BatchStart.QuadPart);
+
+        // NOTE: Reads already in flight still complete while blocked, since the allowance
+        // covered them when they were issued
+        int ReadAhead = (Terminal->FastPipeReadAhead && (Terminal->FastPipe != INVALID_HANDLE_VALUE));
+        if(ReadAhead && !CompleteFastPipeReads(Terminal, 0))
+        {
+            // NOTE: The child is gone, so the rest of the reads come back broken too
+            DrainFastPipeReads(Terminal);
+            CloseHandle(Terminal->FastPipe);
+            Terminal->FastPipe = INVALID_HANDLE_VALUE;
+            ReadAhead = 0;
+        }
+
+        int SlowIn = 1;
+        int ErrIn = 1;
+        if(!Blocked)
+        {
+            // NOTE: Reads in flight are writing past the commit point, so nothing else can commit
+            // until they are done.  When something else has data waiting, they are drained so it
+            // gets its turn, and reissued after it.
+            if(Terminal->FastPipeReads.ReadCount && OtherInputIsPending(Terminal))
+            {
+                DrainFastPipeReads(Terminal);
+            }
+
+            if(!Terminal->FastPipeReads.ReadCount)
             {
-                switch(Message.wParam)
+                if(!ReadAhead)
                 {
-                    case VK_BACK:
-                    {
-                        while((Terminal->CommandLineCount > 0) &&
-                              IsUTF8Extension(Terminal->CommandLine[Terminal->CommandLineCount - 1]))
-                        {
-                            --Terminal->CommandLineCount;
-                        }
+                    UpdateTerminalBuffer(Terminal, Terminal->FastPipe, 0, 0);
+                }
+                UpdateFromFastRing(Terminal);
+                SlowIn = UpdateTerminalBuffer(Terminal, Terminal->Legacy_ReadStdOut, Terminal->LegacyPipesNoWait,
+                                              Terminal->PseudoConsole ? &Terminal->PseudoConsoleRead : 0);
+                ErrIn = UpdateTerminalBuffer(Terminal, Terminal->Legacy_ReadStdError, Terminal->LegacyPipesNoWait, 0);
+            }
 
-                        if(Terminal->CommandLineCount > 0)
-                        {
-                            --Terminal->CommandLineCount;
-                        }
-                    } break;
+            if(ReadAhead)
+            {
+                IssueFastPipeReads(Terminal);
+            }
+        }
 
-                    case VK_RETURN:
-                    {
-                        ExecuteCommandLine(Terminal);
-                        Terminal->CommandLineCount = 0;
-                        Terminal->ViewingLineOffset = 0;
-                    } break;
+        if(!SlowIn && (Terminal->Legacy_ReadStdOut != INVALID_HANDLE_VALUE))
+        {
+            CancelPseudoConsoleTrigger(Terminal);
+            CloseHandle(Terminal->Legacy_ReadStdOut); // TODO(casey): Not sure if this is supposed to be called?
+            Terminal->Legacy_ReadStdOut = INVALID_HANDLE_VALUE;
+        }
 
-                    default:
-                    {
-                        wchar_t Char = (wchar_t)Message.wParam;
-                        wchar_t Chars[2];
-                        int CharCount = 0;
+        if(!ErrIn && (Terminal->Legacy_ReadStdError != INVALID_HANDLE_VALUE))
+        {
+            CloseHandle(Terminal->Legacy_ReadStdError); // TODO(casey): Not sure if this is supposed to be called?
+            Terminal->Legacy_ReadStdError = INVALID_HANDLE_VALUE;
+        }
 
-                        if(IS_HIGH_SURROGATE(Char))
-                        {
-                            Terminal->LastChar = Char;
-                        }
-                        else if(IS_LOW_SURROGATE(Char))
-                        {
-                            if(IS_SURROGATE_PAIR(Terminal->LastChar, Char))
-                            {
-                                Chars[0] = Terminal->LastChar;
-                                Chars[1] = Char;
-                                CharCount = 2;
-                            }
-                            Terminal->LastChar = 0;
-                        }
-                        else
-                        {
-                            Chars[0] = Char;
-                            CharCount = 1;
-                        }
+        int FastRingPending = 0;
+        size_t IngestedCount = GetCurrentAbsoluteP(&Terminal->ScrollBackBuffer) - StartP;
+        UpdateIngestPolicy(&Terminal->IngestPolicy, IngestedCount, BatchStart.QuadPart);
+        int Publish = (GetCurrentAbsoluteP(&Terminal->ScrollBackBuffer) != Terminal->Snapshot.AbsoluteFilledSize);
+        if(Publish && IngestedCount && ShouldCoalesce(Terminal, BatchStart.QuadPart))
+        {
+            ++Terminal->Flow.CoalescedCount;
+            Publish = 0;
+        }
 
-                        if(CharCount)
-                        {
-                            DWORD SpaceLeft = ArrayCount(Terminal->CommandLine) - Terminal->CommandLineCount;
-                            Terminal->CommandLineCount +=
-                                WideCharToMultiByte(CP_UTF8, 0,
-                                                    Chars, CharCount,
-                                                    Terminal->CommandLine + Terminal->CommandLineCount,
-                                                    SpaceLeft, 0, 0);
-                        }
-                    } break;
-                }
-            } break;
+        if(Publish)
+        {
+            PublishSnapshot(Terminal, BatchStart.QuadPart);
+            Terminal->Flow.LastPublishTicks = BatchStart.QuadPart;
+        }
+
+        if(!IngestedCount && !Blocked)
+        {
+            if(!ReadAhead)
+            {
+                ResetEvent(Terminal->FastPipeReady);
+                ReadFile(Terminal->FastPipe, 0, 0, 0, &Terminal->FastPipeTrigger);
+            }
+
+            // NOTE: The trigger can only be reissued once the last one has signaled, since
+            // it is the same OVERLAPPED
+            DWORD Ignored;
+            if(Terminal->PseudoConsoleTriggerPending &&
+               (GetOverlappedResult(Terminal->Legacy_ReadStdOut, &Terminal->PseudoConsoleTrigger, &Ignored, FALSE) ||
+                (GetLastError() != ERROR_IO_INCOMPLETE)))
+            {
+                Terminal->PseudoConsoleTriggerPending = 0;
+            }
+
+            if(Terminal->PseudoConsole && !Terminal->PseudoConsoleTriggerPending)
+            {
+                ResetEvent(Terminal->PseudoConsoleReady);
+                Terminal->PseudoConsoleTriggerPending =
+                    (!ReadFile(Terminal->Legacy_ReadStdOut, 0, 0, 0, &Terminal->PseudoConsoleTrigger) &&
+                     (GetLastError() == ERROR_IO_PENDING));
+            }
+
+            fast_ring_header *Header = Terminal->FastRing.Header;
+            if(Header)
+            {
+                // NOTE: Flagged before the last look at WriteP, so either the child sees the flag
+                // and signals, or this sees what it wrote and doesn't wait
+                Header->ReaderWaiting = 1;
+                MemoryBarrier();
+                FastRingPending = (Header->WriteP != Terminal->FastRingReadP);
+            }
+        }
+
+        Terminal->Telemetry.IngestTicks += GetTelemetryTicks() - LockedTicks;
+        LeaveCriticalSection(&Terminal->Lock);
+
+        if(IngestedCount)
+        {
+            Terminal->IngestedBytes += IngestedCount;
+        }
+
+        if(Publish)
+        {
+            SetEvent(Terminal->ContentChanged);
+        }
+
+        if(Blocked)
+        {
+            // NOTE: Nothing gets read until the renderer catches up, which is what pushes back on the child
+            WaitForSingleObject(Terminal->Flow.LaidOut, 1);
+        }
+        else if(!IngestedCount && !FastRingPending)
+        {
+            // NOTE: The fast pipe, the fast ring and the pseudoconsole can wake this up, but the legacy pipes
+            // can't be waited on, so they only get polled at whatever the timer resolution makes
+            // this timeout.
+            read_pipeline *Pipeline = &Terminal->FastPipeReads;
+            HANDLE Ready[] =
+            {
+                Terminal->FastPipeReady,
+                Terminal->PseudoConsoleReady,
+                Terminal->FastRing.DataReady,
+                Pipeline->Reads[Pipeline->FirstRead % FAST_PIPE_READ_COUNT].Overlapped.hEvent,
+            };
+            WaitForMultipleObjects(Pipeline->ReadCount ? 4 : 3, Ready, FALSE, 1);
         }
     }
+
+    return 0;
 }
 
 static char OpeningMessage[] = { 0xE0, 0xA4, 0x9C, 0xE0, 0xA5, 0x8B, 0x20, 0xE0, 0xA4, 0xB8, 0xE0, 0xA5, 0x8B, 0x20, 0xE0, 0xA4, 0xB0, 0xE0, 0xA4, 0xB9, 0xE0, 0xA4, 0xBE, 0x20, 0xE0, 0xA4, 0xB9, 0xE0, 0xA5, 0x8B, 0x20, 0xE0, 0xA4, 0x89, 0xE0, 0xA4, 0xB8, 0xE0, 0xA5, 0x87, 0x20, 0xE0, 0xA4, 0xA4, 0xE0, 0xA5, 0x8B, 0x20, 0xE0, 0xA4, 0x9C, 0xE0, 0xA4, 0x97, 0xE0, 0xA4, 0xBE, 0x20, 0xE0, 0xA4, 0xB8, 0xE0, 0xA4, 0x95, 0xE0, 0xA4, 0xA4, 0xE0, 0xA5, 0x87, 0x20, 0xE0, 0xA4, 0xB9, 0xE0, 0xA5, 0x88, 0xE0, 0xA4, 0x82, 0x2C, 0x20, 0xE0, 0xA4, 0xB2, 0xE0, 0xA5, 0x87, 0xE0, 0xA4, 0x95, 0xE0, 0xA4, 0xBF, 0xE0, 0xA4, 0xA8, 0x20, 0xE0, 0xA4, 0x9C, 0xE0, 0xA5, 0x8B, 0x20, 0xE0, 0xA4, 0x86, 0xE0, 0xA4, 0x81, 0xE0, 0xA4, 0x96, 0xE0, 0xA5, 0x87, 0x20, 0xE0, 0xA4, 0xAE, 0xE0, 0xA5, 0x82, 0xE0, 0xA4, 0x81, 0xE0, 0xA4, 0xA6, 0x20, 0xE0, 0xA4, 0x95, 0xE0, 0xA4, 0xB0, 0x20, 0xE0, 0xA4, 0xB8, 0xE0, 0xA5, 0x8B, 0xE0, 0xA4, 0xA8, 0xE0, 0xA5, 0x87, 0x20, 0xE0, 0xA4, 0x95, 0xE0, 0xA4, 0xBE, 0x20, 0xE0, 0xA4, 0x85, 0xE0, 0xA4, 0xAD, 0xE0, 0xA4, 0xBF, 0xE0, 0xA4, 0xA8, 0xE0, 0xA4, 0xAF, 0x20, 0xE0, 0xA4, 0x95, 0xE0, 0xA4, 0xB0, 0x20, 0xE0, 0xA4, 0xB0, 0xE0, 0xA4, 0xB9, 0xE0, 0xA4, 0xBE, 0x20, 0xE0, 0xA4, 0xB9, 0xE0, 0xA5, 0x8B, 0x20, 0xE0, 0xA4, 0x89, 0xE0, 0xA4, 0xB8, 0xE0, 0xA5, 0x87, 0x20, 0xE0, 0xA4, 0x95, 0xE0, 0xA5, 0x88, 0xE0, 0xA4, 0xB8, 0xE0, 0xA5, 0x87, 0x20, 0xE0, 0xA4, 0x9C, 0xE0, 0xA4, 0x97, 0xE0, 0xA4, 0xBE, 0xE0, 0xA4, 0x8F, 0xE0, 0xA4, 0x82, 0xE0, 0xA4, 0x97, 0xE0, 0xA5, 0x87, 0x20, 0x7C, 0x20, '\n' };
@@ -1186,8 +3868,41 @@ static DWORD WINAPI TerminalThread(LPVOID Param)
     Terminal->DefaultBackgroundColor = 0x000c0c0c;
     Terminal->FastPipeReady = CreateEventW(0, TRUE, FALSE, 0);
     Terminal->FastPipeTrigger.hEvent = Terminal->FastPipeReady;
+    Terminal->PseudoConsoleReady = CreateEventW(0, TRUE, FALSE, 0);
+    Terminal->PseudoConsoleTrigger.hEvent = Terminal->PseudoConsoleReady;
+    Terminal->PseudoConsoleRead.hEvent = CreateEventW(0, TRUE, FALSE, 0);
+    for(uint32_t ReadIndex = 0; ReadIndex < FAST_PIPE_READ_COUNT; ++ReadIndex)
+    {
+        Terminal->FastPipeReads.Reads[ReadIndex].Overlapped.hEvent = CreateEventW(0, TRUE, FALSE, 0);
+    }
+
+    wchar_t FastRingEventName[64];
+    wsprintfW(FastRingEventName, L"fastringdata%x", GetCurrentProcessId());
+    Terminal->FastRing.DataReady = CreateEventW(0, FALSE, FALSE, FastRingEventName);
+    wsprintfW(FastRingEventName, L"fastringspace%x", GetCurrentProcessId());
+    Terminal->FastRing.SpaceReady = CreateEventW(0, FALSE, FALSE, FastRingEventName);
+
+    LARGE_INTEGER IngestFrequency;
+    QueryPerformanceFrequency(&IngestFrequency);
+    Terminal->IngestPolicy.TicksPerSecond = IngestFrequency.QuadPart;
+    Terminal->Telemetry.TicksPerSecond = IngestFrequency.QuadPart;
+    Terminal->IngestPolicy.LatencyTargetMS = 2;
+    Terminal->IngestPolicy.MinReadSize = 16*1024;
+    Terminal->IngestPolicy.MaxReadSize = 4*1024*1024;
     Terminal->PipeSize = 16*1024*1024;
 
+    HMODULE Kernel = LoadLibraryW(L"kernel32.dll");
+    Terminal->CreatePseudoConsole = (create_pseudo_console *)GetProcAddress(Kernel, "CreatePseudoConsole");
+    Terminal->ResizePseudoConsole = (resize_pseudo_console *)GetProcAddress(Kernel, "ResizePseudoConsole");
+    Terminal->ClosePseudoConsole = (close_pseudo_console *)GetProcAddress(Kernel, "ClosePseudoConsole");
+    if(!Terminal->ResizePseudoConsole || !Terminal->ClosePseudoConsole)
+    {
+        Terminal->CreatePseudoConsole = 0;
+    }
+    Terminal->ContentChanged = CreateEventW(0, FALSE, FALSE, 0);
+    InitializeCriticalSection(&Terminal->Lock);
+    InitializeCriticalSection(&Terminal->Recorder.Lock);
+
     ClearCursor(Terminal, &Terminal->RunningCursor);
 
     // TODO(casey): I believe this should probably be sized to be the same
@@ -1208,6 +3923,7 @@ static DWORD WINAPI TerminalThread(LPVOID Param)
 
     Terminal->REFTERM_MAX_WIDTH = 1024;
     Terminal->REFTERM_MAX_HEIGHT = 1024;
+    Terminal->ScreenBuffer = AllocateTerminalBuffer(Terminal->REFTERM_MAX_WIDTH, Terminal->REFTERM_MAX_HEIGHT);
 
     int DebugD3D11 = 0;
 #if _DEBUG
@@ -1220,12 +3936,23 @@ static DWORD WINAPI TerminalThread(LPVOID Param)
 
     Terminal->GlyphGen = AllocateGlyphGenerator(Terminal->TransferWidth, Terminal->TransferHeight, Terminal->Renderer.GlyphTransferSurface);
     Terminal->ScrollBackBuffer = AllocateSourceBuffer(Terminal->PipeSize);
+    Terminal->Flow.HighWatermark = Terminal->ScrollBackBuffer.DataSize / 2;
+    Terminal->Flow.LowWatermark = Terminal->ScrollBackBuffer.DataSize / 4;
+    Terminal->Flow.CoalesceMS = 16;
+    Terminal->Flow.LaidOut = CreateEventW(0, FALSE, FALSE, 0);
+    Terminal->ScrollBackBuffer.ColdStore = AllocateColdStore(64*1024, (size_t)1024*1024*1024, 64*1024);
+    StartTrigramIndex(&Terminal->TrigramIndex, &Terminal->ScrollBackBuffer, 64*1024, 25);
 
     ScriptRecordDigitSubstitution(LOCALE_USER_DEFAULT, &Terminal->Partitioner.UniDigiSub); // TODO(casey): Move this out to the stored code
     ScriptApplyDigitSubstitution(&Terminal->Partitioner.UniDigiSub, &Terminal->Partitioner.UniControl, &Terminal->Partitioner.UniState);
 
-    Terminal->MaxLineCount = 8192;
-    Terminal->Lines = VirtualAlloc(0, Terminal->MaxLineCount*sizeof(example_line), MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+    // NOTE: Size the line index so it runs out about when the scrollback does, even if every line is short
+    size_t LineCapacity = 1024;
+    while(LineCapacity < (Terminal->PipeSize / 8)) LineCapacity *= 2;
+    Terminal->Lines = AllocateLineIndex(LineCapacity);
+    AppendLine(&Terminal->Lines, 0, Terminal->RunningCursor.Props);
+    Terminal->LayoutCache = AllocateLayoutCache(8192, 512*1024);
+    Terminal->Search.DFA = VirtualAlloc(0, sizeof(search_dfa), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
 
     RevertToDefaultFont(Terminal);
     RefreshFont(Terminal);
@@ -1243,8 +3970,10 @@ static DWORD WINAPI TerminalThread(LPVOID Param)
     AppendOutput(Terminal, "\n");
     AppendOutput(Terminal, OpeningMessage);
     AppendOutput(Terminal, "\n");
+
+    Terminal->IngestThread = CreateThread(0, 0, IngestThread, Terminal, 0, 0);
     
-    int BlinkMS = 500; // TODO(casey): Use this in blink determination
+    int BlinkMS = 500;
     int MinTermSize = 512;
     uint32_t Width = MinTermSize;
     uint32_t Height = MinTermSize;
@@ -1253,29 +3982,57 @@ static DWORD WINAPI TerminalThread(LPVOID Param)
     QueryPerformanceFrequency(&Frequency);
     QueryPerformanceCounter(&Time);
 
-    LARGE_INTEGER StartTime;
-    QueryPerformanceCounter(&StartTime);
+    DEVMODEW DisplayMode = {0};
+    DisplayMode.dmSize = sizeof(DisplayMode);
+    uint32_t RefreshHz = 60;
+    if(EnumDisplaySettingsW(0, ENUM_CURRENT_SETTINGS, &DisplayMode) && (DisplayMode.dmDisplayFrequency > 1))
+    {
+        RefreshHz = DisplayMode.dmDisplayFrequency;
+    }
+    render_scheduler *Scheduler = &Terminal->Scheduler;
+    *Scheduler = InitRenderScheduler(Frequency.QuadPart, RefreshHz, BlinkMS, Time.QuadPart);
 
     size_t FrameCount = 0;
     size_t FrameIndex = 0;
     int64_t UpdateTitle = Time.QuadPart + Frequency.QuadPart;
+    int64_t LastIngestedBytes = 0;
+    int64_t LastIngestSyscallCount = 0;
+    int64_t LastIngestBusy = 0;
+    int64_t LastArrivalTicks = 0;
+    int64_t MaxLatency = 0;
+    uint32_t LastSnapshotSequence = 0;
+    glyph_table_stats FrameGlyphStats = GetGlyphTableStats(Terminal->GlyphTable);
+    glyph_table_stats TitleGlyphStats = FrameGlyphStats;
+    uint32_t GlyphStatsFontGeneration = Terminal->FontGeneration;
 
     wchar_t LastChar = 0;
 
     while(!Terminal->Quit)
     {
+        LARGE_INTEGER WaitStart;
+        QueryPerformanceCounter(&WaitStart);
         if(!Terminal->NoThrottle)
         {
-            HANDLE Handles[8];
-            DWORD HandleCount = 0;
+            DWORD HandleCount = Terminal->DisableRendering ? 0 : 1;
+            MsgWaitForMultipleObjects(HandleCount, &Terminal->ContentChanged, FALSE,
+                                      GetRenderWaitMS(Scheduler, WaitStart.QuadPart), QS_ALLINPUT);
+        }
+
+        LARGE_INTEGER Wake;
+        QueryPerformanceCounter(&Wake);
 
-            Handles[HandleCount++] = Terminal->FastPipeReady;
-            if(Terminal->Legacy_ReadStdOut != INVALID_HANDLE_VALUE) Handles[HandleCount++] = Terminal->Legacy_ReadStdOut;
-            if(Terminal->Legacy_ReadStdError != INVALID_HANDLE_VALUE) Handles[HandleCount++] = Terminal->Legacy_ReadStdError;
-            MsgWaitForMultipleObjects(HandleCount, Handles, FALSE, BlinkMS, QS_ALLINPUT);
+        if(ProcessMessages(Terminal))
+        {
+            MarkRenderDirty(Scheduler, RenderReason_Input, Wake.QuadPart);
         }
 
-        ProcessMessages(Terminal);
+        // NOTE: A font change places a new glyph table, whose stats start over from zero
+        if(GlyphStatsFontGeneration != Terminal->FontGeneration)
+        {
+            GlyphStatsFontGeneration = Terminal->FontGeneration;
+            glyph_table_stats ZeroStats = {0};
+            FrameGlyphStats = TitleGlyphStats = ZeroStats;
+        }
 
         RECT Rect;
         GetClientRect(Terminal->Window, &Rect);
@@ -1283,88 +4040,167 @@ static DWORD WINAPI TerminalThread(LPVOID Param)
         if(((Rect.left + MinTermSize) <= Rect.right) &&
            ((Rect.top + MinTermSize) <= Rect.bottom))
         {
+            if((Width != (uint32_t)(Rect.right - Rect.left)) ||
+               (Height != (uint32_t)(Rect.bottom - Rect.top)))
+            {
+                MarkRenderDirty(Scheduler, RenderReason_Resize, Wake.QuadPart);
+            }
+
             Width = Rect.right - Rect.left;
             Height = Rect.bottom - Rect.top;
 
             uint32_t Margin = 8;
             uint32_t NewDimX = SafeRatio1(Width - Margin, Terminal->GlyphGen.FontWidth);
             uint32_t NewDimY = SafeRatio1(Height - Margin, Terminal->GlyphGen.FontHeight);
-            if(NewDimX > Terminal->REFTERM_MAX_WIDTH) NewDimX = Terminal->REFTERM_MAX_WIDTH;
-            if(NewDimY > Terminal->REFTERM_MAX_HEIGHT) NewDimY = Terminal->REFTERM_MAX_HEIGHT;
-
-            // TODO(casey): Maybe only allocate on size differences,
-            // etc. Make a real resize function here for people who care.
-            if((Terminal->ScreenBuffer.DimX != NewDimX) ||
-               (Terminal->ScreenBuffer.DimY != NewDimY))
+            terminal_buffer OldBuffer = Terminal->ScreenBuffer;
+            ResizeScreenBuffer(Terminal, NewDimX, NewDimY);
+            if((Terminal->ScreenBuffer.DimX != OldBuffer.DimX) ||
+               (Terminal->ScreenBuffer.DimY != OldBuffer.DimY))
             {
-                DeallocateTerminalBuffer(&Terminal->ScreenBuffer);
-                Terminal->ScreenBuffer = AllocateTerminalBuffer(NewDimX, NewDimY);
+                MarkRenderDirty(Scheduler, RenderReason_Resize, Wake.QuadPart);
             }
         }
 
-        do
+        uint32_t SnapshotSequence = Terminal->SnapshotSequence;
+        if(SnapshotSequence != LastSnapshotSequence)
+        {
+            LastSnapshotSequence = SnapshotSequence;
+            MarkRenderDirty(Scheduler, RenderReason_Content, ReadSnapshot(Terminal).ArrivalTicks);
+        }
+
+        if(Terminal->Search.Mode)
         {
-            int FastIn = UpdateTerminalBuffer(Terminal, Terminal->FastPipe);
-            int SlowIn = UpdateTerminalBuffer(Terminal, Terminal->Legacy_ReadStdOut);
-            int ErrIn = UpdateTerminalBuffer(Terminal, Terminal->Legacy_ReadStdError);
+            // NOTE: A search in progress gets a slice every frame, so it needs frames to keep coming
+            MarkRenderDirty(Scheduler, RenderReason_Content, Wake.QuadPart);
+        }
+
+        int Blink = UpdateRenderBlink(Scheduler, Wake.QuadPart);
 
-            if(!SlowIn && (Terminal->Legacy_ReadStdOut != INVALID_HANDLE_VALUE))
+        if(Terminal->DisableRendering)
+        {
+            // NOTE: Nothing would show it, so don't let it pile up and keep the loop awake
+            Scheduler->DirtyReasons = 0;
+        }
+        else if(Terminal->NoThrottle || ShouldRender(Scheduler, Wake.QuadPart))
+        {
+            if(Terminal->Renderer.FrameLatencyWaitableObject != INVALID_HANDLE_VALUE)
             {
-                CloseHandle(Terminal->Legacy_ReadStdOut); // TODO(casey): Not sure if this is supposed to be called?
-                Terminal->Legacy_ReadStdOut = INVALID_HANDLE_VALUE;
+                WaitForSingleObject(Terminal->Renderer.FrameLatencyWaitableObject, BlinkMS);
             }
 
-            if(!ErrIn && (Terminal->Legacy_ReadStdError != INVALID_HANDLE_VALUE))
+            LARGE_INTEGER FrameStart;
+            QueryPerformanceCounter(&FrameStart);
+            BeginTelemetryFrame(&Terminal->Telemetry, FrameStart.QuadPart);
+
+            if(Terminal->Search.Mode)
             {
-                CloseHandle(Terminal->Legacy_ReadStdError); // TODO(casey): Not sure if this is supposed to be called?
-                Terminal->Legacy_ReadStdError = INVALID_HANDLE_VALUE;
+                // NOTE: Searches run a few megabytes per frame so typing and scrolling still respond
+                EnterCriticalSection(&Terminal->Lock);
+                ContinueSearch(Terminal, 4*1024*1024);
+                LeaveCriticalSection(&Terminal->Lock);
             }
-        }
-        while((Terminal->Renderer.FrameLatencyWaitableObject != INVALID_HANDLE_VALUE) &&
-                  (WaitForSingleObject(Terminal->Renderer.FrameLatencyWaitableObject, 0) == WAIT_TIMEOUT));
-
-        ResetEvent(Terminal->FastPipeReady);
-        ReadFile(Terminal->FastPipe, 0, 0, 0, &Terminal->FastPipeTrigger);
 
-        LayoutLines(Terminal);
+            // NOTE: If only the blink phase changed, the screen buffer is still the last layout, and
+            // the renderer only has to recompose the blinking cells.  A renderer that has to be
+            // acquired again gets a new font, though, so that needs a layout.
+            int BlinkOnly = ((Scheduler->DirtyReasons == RenderReason_Blink) && Terminal->Renderer.Device);
+            if(!BlinkOnly)
+            {
+                int64_t LayoutStartTicks = GetTelemetryTicks();
+                LayoutLines(Terminal);
+                Terminal->Telemetry.Current.LayoutTicks = GetTelemetryTicks() - LayoutStartTicks;
+                RecordEvent(&Terminal->Recorder, RecordType_Frame, 0, 0);
+                if(Terminal->Flow.Blocked)
+                {
+                    SetEvent(Terminal->Flow.LaidOut);
+                }
+            }
 
-        // TODO(casey): Split RendererDraw into two!
-        // Update, and render, since we only need to update if we actually get new input.
+            // TODO(casey): Split RendererDraw into two!
+            // Update, and render, since we only need to update if we actually get new input.
 
-        LARGE_INTEGER BlinkTimer;
-        QueryPerformanceCounter(&BlinkTimer);
-        int Blink = ((1000*(BlinkTimer.QuadPart - StartTime.QuadPart) / (BlinkMS*Frequency.QuadPart)) & 1);
-        if(!Terminal->Renderer.Device)
-        {
-            Terminal->Renderer = AcquireD3D11Renderer(Terminal->Window, 0);
-            RefreshFont(Terminal);
-        }
-        if(Terminal->Renderer.Device)
-        {
-            RendererDraw(Terminal, Width, Height, &Terminal->ScreenBuffer, Blink ? 0xffffffff : 0xff222222);
+            if(!Terminal->Renderer.Device)
+            {
+                Terminal->Renderer = AcquireD3D11Renderer(Terminal->Window, 0);
+                RefreshFont(Terminal);
+            }
+            if(Terminal->Renderer.Device)
+            {
+                RendererDraw(Terminal, Width, Height, &Terminal->ScreenBuffer, Blink ? 0xffffffff : 0xff222222, BlinkOnly);
+            }
+            ++FrameIndex;
+            ++FrameCount;
+
+            LARGE_INTEGER FrameEnd;
+            QueryPerformanceCounter(&FrameEnd);
+            RenderFrameDone(Scheduler, FrameStart.QuadPart, FrameEnd.QuadPart);
+
+            glyph_table_stats GlyphStats = GetGlyphTableStats(Terminal->GlyphTable);
+            EndTelemetryFrame(&Terminal->Telemetry, FrameEnd.QuadPart, Terminal->IngestedBytes,
+                              DiffGlyphTableStats(GlyphStats, FrameGlyphStats),
+                              Terminal->ScreenBuffer.DimX*Terminal->ScreenBuffer.DimY);
+            FrameGlyphStats = GlyphStats;
         }
-        ++FrameIndex;
-        ++FrameCount;
 
         LARGE_INTEGER Now;
         QueryPerformanceCounter(&Now);
 
+        // NOTE: From the start of the read that brought the data in to the frame that shows it
+        if(Terminal->LaidOutArrivalTicks != LastArrivalTicks)
+        {
+            LastArrivalTicks = Terminal->LaidOutArrivalTicks;
+            int64_t Latency = Now.QuadPart - LastArrivalTicks;
+            if(MaxLatency < Latency) MaxLatency = Latency;
+        }
+
         if (Now.QuadPart >= UpdateTitle)
         {
             UpdateTitle = Now.QuadPart + Frequency.QuadPart;
 
             double FramesPerSec = (double)FrameCount * Frequency.QuadPart / (Now.QuadPart - Time.QuadPart);
+            int64_t IngestedBytes = Terminal->IngestedBytes;
+            int64_t IngestSyscallCount = Terminal->IngestSyscallCount;
+            Terminal->IngestBytesPerSecond = (IngestedBytes - LastIngestedBytes) * Frequency.QuadPart / (Now.QuadPart - Time.QuadPart);
+            Terminal->IngestBytesPerSyscall = SafeRatio1(IngestedBytes - LastIngestedBytes, IngestSyscallCount - LastIngestSyscallCount);
+            LastIngestedBytes = IngestedBytes;
+            LastIngestSyscallCount = IngestSyscallCount;
+            Terminal->EchoLatencyUS = (uint32_t)(MaxLatency * 1000000 / Frequency.QuadPart);
+            MaxLatency = 0;
+            Scheduler->InputToPhotonTicks = Scheduler->MaxInputToPhotonTicks;
+            Scheduler->MaxInputToPhotonTicks = 0;
+
+            FILETIME Creation, Exit, Kernel, User;
+            if(GetThreadTimes(Terminal->IngestThread, &Creation, &Exit, &Kernel, &User))
+            {
+                // NOTE: Thread times are in 100ns units
+                int64_t IngestBusy = ((((int64_t)Kernel.dwHighDateTime << 32) | Kernel.dwLowDateTime) +
+                                      (((int64_t)User.dwHighDateTime << 32) | User.dwLowDateTime));
+                int64_t Elapsed = (Now.QuadPart - Time.QuadPart) * 10000000 / Frequency.QuadPart;
+                Terminal->IngestCPUPercent = (uint32_t)SafeRatio1(100*(IngestBusy - LastIngestBusy), Elapsed);
+                LastIngestBusy = IngestBusy;
+            }
             Time = Now;
             FrameCount = 0;
+            glyph_table_stats GlyphStats = GetGlyphTableStats(Terminal->GlyphTable);
+            glyph_table_stats Stats = DiffGlyphTableStats(GlyphStats, TitleGlyphStats);
+            TitleGlyphStats = GlyphStats;
 
             WCHAR Title[1024];
 
             if(Terminal->NoThrottle)
             {
-                glyph_table_stats Stats = GetAndClearStats(Terminal->GlyphTable);
-                wsprintfW(Title, L"refterm Size=%dx%d RenderFPS=%d.%02d CacheHits/Misses=%d/%d Recycle:%d",
+                layout_cache *Cache = &Terminal->LayoutCache;
+                int IngestMBPerSec = (int)(Terminal->IngestBytesPerSecond / (1024*1024));
+                wsprintfW(Title, L"refterm Size=%dx%d RenderFPS=%d.%02d Ingest=%d.%02dGB/s (%d%% CPU, %dkb/syscall, %dkb reads) Latency=%dus Frame=%dus%s CacheHits/Misses=%d/%d Recycle:%d LayoutHits=%d%% (%dkb)",
                               Terminal->ScreenBuffer.DimX, Terminal->ScreenBuffer.DimY, (int)FramesPerSec, (int)(FramesPerSec*100) % 100,
-                              (int)Stats.HitCount, (int)Stats.MissCount, (int)Stats.RecycleCount);
+                              IngestMBPerSec / 1024, (100*(IngestMBPerSec % 1024)) / 1024,
+                              (int)Terminal->IngestCPUPercent, (int)(Terminal->IngestBytesPerSyscall / 1024),
+                              (int)(GetIngestReadSize(&Terminal->IngestPolicy) / 1024), (int)Terminal->EchoLatencyUS,
+                              (int)(Scheduler->FrameTicks * 1000000 / Frequency.QuadPart),
+                              Terminal->DisableRendering ? L" (not rendering)" : L"",
+                              (int)Stats.HitCount, (int)Stats.MissCount, (int)Stats.RecycleCount,
+                              (int)SafeRatio1(100*Cache->HitCount, Cache->HitCount + Cache->MissCount),
+                              (int)(GetLayoutCacheFootprint(Cache) / 1024));
             }
             else
             {
@@ -1380,6 +4216,7 @@ static DWORD WINAPI TerminalThread(LPVOID Param)
 
     // TODO(casey): How do we actually do an ensured-kill here?  Like even if we crash?  Is there some kind
     // of process parameter we can pass to CreateProcess that will ensure it is killed?  Because this won't.
+    EnterCriticalSection(&Terminal->Lock);
     KillProcess(Terminal);
 
     ExitProcess(0);
@@ -10,11 +10,38 @@ enum
     TerminalCell_Strikethrough = 0x80,
 };
 
+#define MAX_BLINK_RUN_COUNT 256
+typedef struct
+{
+    uint16_t X;
+    uint16_t Y; // NOTE: A row of the buffer, not of the screen, since FirstLineY moves
+    uint16_t Count;
+    uint16_t Reserved;
+} blink_run;
+
 typedef struct
 {
     renderer_cell *Cells;
     uint32_t DimX, DimY;
     uint32_t FirstLineY;
+
+    // NOTE: Only the first RowLengths[Y] cells of each row hold anything.  The rest of the row
+    // is blank - the default background - without those cells ever being written or uploaded.
+    uint32_t *RowLengths;
+
+    // NOTE: Cells has address space for MaxCellCount cells, but only the first CommittedCellCount
+    // have memory behind them.  Resizing commits more as needed and never gives any back.
+    uint32_t MaxCellCount;
+    uint32_t CommittedCellCount;
+    uint32_t MaxDimY;
+
+    // NOTE: Where the blinking cells are, so a frame that only changes the blink phase can
+    // recompose just those without laying anything out.  Runs can outlive what was written
+    // over them, which only costs recomposing a few cells that didn't need it.  BlinkOverflow
+    // means there were too many to keep track of.
+    uint32_t BlinkRunCount;
+    int BlinkOverflow;
+    blink_run BlinkRuns[MAX_BLINK_RUN_COUNT];
 } terminal_buffer;
 
 typedef struct
@@ -56,8 +83,225 @@ typedef struct
     size_t OnePastLastP;
     uint32_t ContainsComplexChars;
     glyph_props StartingProps;
+    size_t PropsIndex; // NOTE: Where StartingProps lives in the line index's props ring
 } example_line;
 
+#define LINE_ROWS_CURSOR_JUMPED 0xffff
+#define LINE_COLUMNS_UNKNOWN 0xffffffff
+#define LINE_BLOCK_SHIFT 6
+#define LINE_BLOCK_SIZE (1 << LINE_BLOCK_SHIFT)
+enum
+{
+    LineLength_Mask = 0x1fffffff,
+    LineFlag_EndsWithNewline = 0x20000000,
+    LineFlag_ContainsComplexChars = 0x40000000,
+    LineFlag_PropsChanged = 0x80000000,
+};
+
+typedef struct
+{
+    uint32_t LengthAndFlags;
+
+    // NOTE: Number of rows this line advances when laid out under RowCountKey, so layout
+    // can find the first visible line without parsing anything that isn't on screen.
+    uint16_t RowCount;
+    uint16_t RowCountKey;
+
+    // NOTE: Cells the line takes up laid out on one endless row, so the rows it wraps to at any
+    // width are just a divide, without reading it back out of the scrollback.  LINE_COLUMNS_UNKNOWN
+    // for lines where that doesn't hold - a carriage return with more of the line after it, or a
+    // cursor jump - which have to be measured instead.
+    uint32_t ColumnCount;
+} compact_line;
+
+typedef struct
+{
+    size_t FirstP;
+    size_t PropsIndex;
+} line_block;
+
+typedef struct
+{
+    // NOTE: Lines are contiguous in the scrollback, so each one only stores its length, and
+    // every LINE_BLOCK_SIZE lines there is a block with the absolute position to count from.
+    // Props are only pushed onto the props ring when they differ from the previous line's.
+    // All the rings are indexed by absolute counts masked with LineMask.
+    size_t LineMask;
+    compact_line *Lines;
+    line_block *Blocks;
+    glyph_props *Props;
+
+    size_t LineCount; // NOTE: Absolute, so the line currently being parsed is always LineCount - 1
+    size_t PropsCount;
+    size_t CurrentFirstP;
+
+    // NOTE: The last thing parsed was a carriage return, which only matters to the current line's
+    // ColumnCount if something other than a newline comes after it, possibly in the next read
+    int PendingReturn;
+} line_index;
+
+typedef struct
+{
+    // NOTE: Key
+    size_t FirstP;
+    size_t Count;
+    uint32_t DimX;
+    uint32_t Generation;
+
+    // NOTE: Laid-out rows, stored in the cache's cell ring starting at CellP, after the row lengths
+    size_t CellP;
+    uint32_t RowCount;
+    int Blinking; // NOTE: Whether any of the rows have blinking cells in them
+    cursor_state EndCursor; // NOTE: EndCursor.At.Y is relative to the first row
+} layout_cache_entry;
+
+typedef struct
+{
+    uint32_t EntryMask;
+    layout_cache_entry *Entries;
+
+    // NOTE: Cells are handed out in a circular buffer, so an entry is only valid
+    // as long as AbsoluteCellP hasn't gotten more than CellCount past its CellP.
+    size_t CellCount;
+    renderer_cell *Cells;
+    size_t AbsoluteCellP;
+
+    size_t HitCount;
+    size_t MissCount;
+} layout_cache;
+
+typedef struct
+{
+    // NOTE: Where the scrollback stood at the end of the last ingest batch (or AppendOutput),
+    // which is what layout draws, so it never shows half a batch.  Layout stops short of the
+    // current line, and every line before it is finished by then, so none of the line index
+    // has to be copied.
+    int64_t ArrivalTicks; // NOTE: When the batch that made this snapshot started reading
+    size_t LineCount;
+    size_t AbsoluteFilledSize;
+    cursor_state RunningCursor;
+} terminal_snapshot;
+
+typedef struct
+{
+    // NOTE: Reads are sized so that, at the rate the producer has been going, one read's worth
+    // of data takes about LatencyTargetMS to arrive.  That is also roughly how long the lock is
+    // held parsing it, so slow producers get small reads that show up promptly and fast ones
+    // get big reads that cost fewer syscalls.  MaxReadSize is the throughput end of the knob.
+    uint32_t LatencyTargetMS;
+    size_t MinReadSize;
+    size_t MaxReadSize;
+
+    int64_t TicksPerSecond;
+    int64_t SampleStartTicks;
+    size_t SampleBytes;
+    int64_t BytesPerSecond; // NOTE: Moving average
+} ingest_policy;
+
+enum
+{
+    FlowControl_DropOldest,
+    FlowControl_BlockProducer,
+    FlowControl_CoalesceFrames,
+
+    FlowControl_Count,
+};
+
+typedef struct
+{
+    // NOTE: The backlog is how far ingest has got past the end of the last frame that was laid
+    // out.  Once it reaches HighWatermark the mode kicks in, and it stays in until the backlog is
+    // back down to LowWatermark:
+    //
+    //   DropOldest - keep reading, and let the ring overwrite whatever the renderer never got to.
+    //     Best for tailing logs, where the child should never be slowed down.
+    //   BlockProducer - stop reading until the renderer catches up, so the pipe fills and the
+    //     child blocks.  Nothing is ever overwritten unseen, which is what interactive use wants.
+    //   CoalesceFrames - keep reading, but only publish a new snapshot every CoalesceMS, so the
+    //     renderer isn't woken for states that would be stale before it got to them.
+    int Mode;
+    size_t HighWatermark;
+    size_t LowWatermark;
+    uint32_t CoalesceMS;
+
+    volatile size_t LaidOutP; // NOTE: Written by the render thread
+    volatile int Blocked;
+    HANDLE LaidOut; // NOTE: Signalled by the render thread after each layout while Blocked
+    int Engaged;
+    size_t Allowance; // NOTE: How much more can be read this batch
+
+    int64_t LastTicks;
+    int64_t LastPublishTicks;
+    size_t DroppedThroughP;
+
+    size_t EngagedCount;
+    size_t DroppedBytes;
+    int64_t StallTicks;
+    size_t CoalescedCount;
+} flow_control;
+
+enum
+{
+    RenderReason_Content = 0x1,
+    RenderReason_Input = 0x2,
+    RenderReason_Blink = 0x4,
+    RenderReason_Resize = 0x8,
+};
+
+typedef struct
+{
+    // NOTE: Frames are only rendered when something changed, and never more than once per
+    // refresh interval, so a burst of changes all lands in the same frame.  Nothing in here
+    // reads a clock - every time comes in as a parameter, so it can be driven by a fake one.
+    int64_t TicksPerSecond;
+    int64_t RefreshTicks;
+    int64_t BlinkTicks;
+    int64_t StartTicks;
+
+    uint32_t DirtyReasons;
+    int64_t FirstDirtyTicks;
+    int64_t LastFrameTicks;
+    int BlinkOn;
+
+    size_t FrameCount;
+    size_t CoalescedWakeCount;
+    int64_t FrameTicks; // NOTE: Moving average, from the start of layout to present returning
+    int64_t InputToPhotonTicks; // NOTE: Worst in the last second, estimated as up to the next vblank
+    int64_t MaxInputToPhotonTicks;
+} render_scheduler;
+
+#define FAST_PIPE_READ_COUNT 4
+typedef struct
+{
+    OVERLAPPED Overlapped;
+    char *Data;
+
+    // NOTE: Once the read has finished, how much of it is still waiting to be committed
+    int Completed;
+    size_t Count;
+} pending_read;
+
+typedef struct
+{
+    // NOTE: Reads are issued back to back into the ring past the commit point and complete in
+    // the order they were issued.  A read that comes back short leaves a gap, which gets closed
+    // by moving the next read's data down when it completes.  TailOffset is how far past the
+    // commit point the last issued read ends, gaps included.
+    pending_read Reads[FAST_PIPE_READ_COUNT];
+    uint32_t FirstRead;
+    uint32_t ReadCount;
+    size_t TailOffset;
+    size_t ChunkSize;
+
+    size_t CompactedBytes;
+    size_t PinStallCount; // NOTE: Times a finished read had to wait for layout to unpin
+} read_pipeline;
+
+// NOTE: Loaded at runtime, since pseudoconsoles only exist on Windows 10 1809 and later
+typedef HRESULT WINAPI create_pseudo_console(COORD Size, HANDLE Input, HANDLE Output, DWORD Flags, void **Console);
+typedef HRESULT WINAPI resize_pseudo_console(void *Console, COORD Size);
+typedef void WINAPI close_pseudo_console(void *Console);
+
 typedef struct
 {
     HWND Window;
@@ -68,6 +312,7 @@ typedef struct
     void *GlyphTableMem;
     glyph_table *GlyphTable;
     terminal_buffer ScreenBuffer;
+    uint32_t RowAdvanceCount;
     source_buffer ScrollBackBuffer;
     example_partitioner Partitioner;
 
@@ -76,6 +321,7 @@ typedef struct
     HANDLE Legacy_WriteStdIn;
     HANDLE Legacy_ReadStdOut;
     HANDLE Legacy_ReadStdError;
+    int LegacyPipesNoWait;
 
     int EnableFastPipe;
     HANDLE FastPipeReady;
@@ -84,6 +330,59 @@ typedef struct
 
     HANDLE ChildProcess;
 
+    int FastPipeReadAhead;
+    read_pipeline FastPipeReads;
+
+    // NOTE: When the child runs on a pseudoconsole, its output comes back on Legacy_ReadStdOut
+    // and there is no separate stderr.  The pipe is overlapped on this end, so the ingest
+    // thread can wait on it the same way it does on the fast pipe.  The zero-byte trigger read
+    // and the real reads each need their own OVERLAPPED, since the trigger stays pending
+    // until data shows up.
+    int EnablePseudoConsole;
+    void *PseudoConsole;
+    uint32_t PseudoConsoleCount;
+    HANDLE PseudoConsoleReady;
+    OVERLAPPED PseudoConsoleTrigger;
+    int PseudoConsoleTriggerPending;
+    OVERLAPPED PseudoConsoleRead;
+    create_pseudo_console *CreatePseudoConsole;
+    resize_pseudo_console *ResizePseudoConsole;
+    close_pseudo_console *ClosePseudoConsole;
+
+    // NOTE: The ring itself is mapped per child, but its events live as long as the terminal
+    // does, so the ingest thread can always wait on FastRing.DataReady.
+    int EnableFastRing;
+    HANDLE FastRingMapping;
+    fast_ring FastRing;
+    size_t FastRingSize;
+    uint64_t FastRingReadP;
+
+    // NOTE: The ingest thread owns reading the pipes, CommitWrite and ParseLines.  Anything else
+    // that touches the scrollback, the line index or the pipes has to hold Lock, except layout,
+    // which reads the snapshot instead.  The snapshot is published seqlock-style: the sequence
+    // is odd while it is being written.
+    CRITICAL_SECTION Lock;
+    HANDLE IngestThread;
+    HANDLE ContentChanged;
+    volatile uint32_t SnapshotSequence;
+    terminal_snapshot Snapshot;
+    size_t LayoutRetryCount;
+    size_t LockedLayoutCount;
+    volatile int64_t IngestedBytes;
+    volatile int64_t IngestSyscallCount;
+    int64_t IngestBytesPerSecond;
+    int64_t IngestBytesPerSyscall;
+    uint32_t IngestCPUPercent;
+    ingest_policy IngestPolicy;
+    flow_control Flow;
+    render_scheduler Scheduler;
+    telemetry Telemetry;
+    recorder Recorder;
+    int Replaying;
+    int64_t LaidOutArrivalTicks;
+    uint32_t EchoLatencyUS;
+    int DisableRendering;
+
     cursor_state RunningCursor;
 
     wchar_t LastChar;
@@ -93,10 +392,12 @@ typedef struct
     int NoThrottle;
     int DebugHighlighting;
 
-    uint32_t MaxLineCount;
-    uint32_t CurrentLineIndex;
-    uint32_t LineCount;
-    example_line *Lines;
+    line_index Lines;
+    scrollback_search Search;
+    trigram_index TrigramIndex;
+
+    layout_cache LayoutCache;
+    uint32_t FontGeneration;
 
     int32_t ViewingLineOffset;
 
@@ -0,0 +1,146 @@
+static uint32_t HashTrigram(char unsigned *At)
+{
+    uint32_t Trigram = (At[0] | (At[1] << 8) | (At[2] << 16));
+    uint32_t Result = (Trigram*2654435761u) >> 19;
+    Assert(Result < TRIGRAM_FILTER_BITS);
+    return Result;
+}
+
+static void BuildTrigramFilter(trigram_filter *Filter, char unsigned *Data)
+{
+    // NOTE: Reads two bytes past the end of the block, so trigrams that straddle into the
+    // next block still belong to the block they start in.
+    __stosb((unsigned char *)Filter->Bits, 0, sizeof(Filter->Bits));
+    for(size_t At = 0; At < TRIGRAM_BLOCK_SIZE; ++At)
+    {
+        uint32_t Hash = HashTrigram(Data + At);
+        Filter->Bits[Hash >> 6] |= (uint64_t)1 << (Hash & 63);
+    }
+}
+
+static DWORD WINAPI TrigramIndexThread(LPVOID Param)
+{
+    trigram_index *Index = (trigram_index *)Param;
+    source_buffer *Buffer = Index->Source;
+
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+    int64_t OwedSleepTicks = 0;
+
+    for(;;)
+    {
+        size_t Block = Index->IndexedBlockCount;
+        size_t BlockP = Block*TRIGRAM_BLOCK_SIZE;
+        size_t FilledP = *(volatile size_t *)&Buffer->AbsoluteFilledSize;
+        if(FilledP >= (BlockP + TRIGRAM_BLOCK_SIZE + 2))
+        {
+            LARGE_INTEGER StartTime;
+            QueryPerformanceCounter(&StartTime);
+
+            // NOTE: The block has to be past the overwrite horizon both before and after it is read,
+            // otherwise the writer may have been refilling that part of the ring the whole time.
+            trigram_filter *Filter = Index->Filters + (Block & Index->BlockMask);
+            int Valid = (BlockP >= Buffer->OverwriteHorizonP);
+            if(Valid)
+            {
+                _ReadWriteBarrier();
+                BuildTrigramFilter(Filter, (char unsigned *)Buffer->Data + (BlockP % Buffer->DataSize));
+                _ReadWriteBarrier();
+                Valid = (BlockP >= Buffer->OverwriteHorizonP);
+            }
+
+            if(!Valid)
+            {
+                // NOTE: Never got a clean look at this block, so it has to be a candidate for everything
+                __stosb((unsigned char *)Filter->Bits, 0xff, sizeof(Filter->Bits));
+                ++Index->MissedBlockCount;
+            }
+
+            _ReadWriteBarrier();
+            Index->IndexedBlockCount = Block + 1;
+
+            LARGE_INTEGER EndTime;
+            QueryPerformanceCounter(&EndTime);
+            int64_t BusyTicks = EndTime.QuadPart - StartTime.QuadPart;
+            Index->BusyTicks += BusyTicks;
+
+            // NOTE: Sleep off enough time to keep the thread under its share of a core
+            OwedSleepTicks += BusyTicks*(100 - Index->BudgetPercent) / Index->BudgetPercent;
+            DWORD SleepMS = (DWORD)(1000*OwedSleepTicks / Frequency.QuadPart);
+            if(SleepMS)
+            {
+                Sleep(SleepMS);
+                OwedSleepTicks -= SleepMS*Frequency.QuadPart / 1000;
+            }
+        }
+        else
+        {
+            Sleep(16);
+            OwedSleepTicks = 0;
+        }
+    }
+
+    return 0;
+}
+
+static void StartTrigramIndex(trigram_index *Index, source_buffer *Source, size_t MaxBlockCount, uint32_t BudgetPercent)
+{
+    Assert(IsPowerOfTwo(MaxBlockCount));
+    Assert((BudgetPercent > 0) && (BudgetPercent <= 100));
+
+    Index->Filters = VirtualAlloc(0, MaxBlockCount*sizeof(trigram_filter), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    if(Index->Filters)
+    {
+        Index->BlockMask = MaxBlockCount - 1;
+        Index->Source = Source;
+        Index->BudgetPercent = BudgetPercent;
+        Index->Thread = CreateThread(0, 0, TrigramIndexThread, Index, 0, 0);
+        if(Index->Thread)
+        {
+            SetThreadPriority(Index->Thread, THREAD_PRIORITY_BELOW_NORMAL);
+        }
+    }
+}
+
+static int IsTrigramCandidate(trigram_index *Index, size_t Block, uint32_t HashCount, uint16_t *Hashes)
+{
+    // NOTE: A match starting in this block can run into the next one, so both filters count.
+    // Anything the index can't vouch for is always a candidate.
+    int Result = 1;
+
+    size_t IndexedBlockCount = Index->IndexedBlockCount;
+    _ReadWriteBarrier();
+
+    // NOTE: The index thread reuses a block's filter once it gets BlockMask + 1 blocks further along
+    if(Index->Thread && HashCount &&
+       ((Block + 1) < IndexedBlockCount) &&
+       ((IndexedBlockCount - Block) <= Index->BlockMask))
+    {
+        trigram_filter *A = Index->Filters + (Block & Index->BlockMask);
+        trigram_filter *B = Index->Filters + ((Block + 1) & Index->BlockMask);
+
+        for(uint32_t HashIndex = 0; Result && (HashIndex < HashCount); ++HashIndex)
+        {
+            uint32_t Hash = Hashes[HashIndex];
+            Result = (((A->Bits[Hash >> 6] | B->Bits[Hash >> 6]) >> (Hash & 63)) & 1);
+        }
+
+        // NOTE: If the index thread lapped us while we were reading, the answer can't be trusted
+        _ReadWriteBarrier();
+        if((Index->IndexedBlockCount - Block) > Index->BlockMask)
+        {
+            Result = 1;
+        }
+    }
+
+    return Result;
+}
+
+static size_t GetTrigramIndexFootprint(trigram_index *Index)
+{
+    size_t BlockCount = Index->IndexedBlockCount;
+    if(BlockCount > (Index->BlockMask + 1)) BlockCount = Index->BlockMask + 1;
+
+    size_t Result = Index->Filters ? BlockCount*sizeof(trigram_filter) : 0;
+    return Result;
+}
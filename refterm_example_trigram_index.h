@@ -0,0 +1,25 @@
+#define TRIGRAM_BLOCK_SIZE (64*1024)
+#define TRIGRAM_FILTER_BITS 8192
+typedef struct
+{
+    // NOTE: One bit per hashed trigram that starts in the block, so a block whose bits don't
+    // cover every trigram of a pattern can't contain a match starting in it.
+    uint64_t Bits[TRIGRAM_FILTER_BITS / 64];
+} trigram_filter;
+
+typedef struct
+{
+    // NOTE: Only the index thread writes filters.  Filter N covers scrollback bytes
+    // [N*TRIGRAM_BLOCK_SIZE, (N + 1)*TRIGRAM_BLOCK_SIZE), and is only safe to read once
+    // IndexedBlockCount is past N and before the ring has wrapped back around onto it.
+    size_t BlockMask;
+    trigram_filter *Filters;
+    volatile size_t IndexedBlockCount;
+
+    source_buffer *Source;
+    uint32_t BudgetPercent;
+    HANDLE Thread;
+
+    volatile size_t MissedBlockCount;
+    volatile int64_t BusyTicks;
+} trigram_index;
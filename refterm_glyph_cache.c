@@ -18,6 +18,8 @@ struct glyph_entry
     uint32_t FilledState;
     uint16_t DimX;
     uint16_t DimY;
+
+    size_t LastLookup; // NOTE: Value of the table's LookupCount when this entry was last found
     
 #if DEBUG_VALIDATE_LRU
     size_t Ordering;
@@ -27,10 +29,13 @@ struct glyph_entry
 struct glyph_table
 {
     glyph_table_stats Stats;
+    size_t LookupCount;
 
     uint32_t HashMask;
     uint32_t HashCount;
     uint32_t EntryCount;
+    uint32_t ReservedTileCount;
+    uint32_t CacheTileCountInX;
 
     uint32_t *HashTable;
     glyph_entry *Entries;
@@ -88,11 +93,40 @@ static glyph_entry *GetSentinel(glyph_table *Table)
     return Result;
 }
 
-static glyph_table_stats GetAndClearStats(glyph_table *Table)
+static glyph_table_stats GetGlyphTableStats(glyph_table *Table)
 {
     glyph_table_stats Result = Table->Stats;
-    glyph_table_stats ZeroStats = {0};
-    Table->Stats = ZeroStats;
+    return Result;
+}
+
+static glyph_table_stats DiffGlyphTableStats(glyph_table_stats New, glyph_table_stats Old)
+{
+    glyph_table_stats Result;
+
+    Result.HitCount = New.HitCount - Old.HitCount;
+    Result.MissCount = New.MissCount - Old.MissCount;
+    Result.RecycleCount = New.RecycleCount - Old.RecycleCount;
+    Result.ProbeCount = New.ProbeCount - Old.ProbeCount;
+    Result.MaxProbeLength = New.MaxProbeLength;
+    for(uint32_t BucketIndex = 0;
+        BucketIndex < GLYPH_TABLE_AGE_BUCKET_COUNT;
+        ++BucketIndex)
+    {
+        Result.EvictionAgeCounts[BucketIndex] = New.EvictionAgeCounts[BucketIndex] - Old.EvictionAgeCounts[BucketIndex];
+    }
+
+    return Result;
+}
+
+static uint32_t GetAgeBucket(size_t Age)
+{
+    // NOTE: Bucket i holds ages below 4^(i+1)
+    uint32_t Result = 0;
+    while((Result < (GLYPH_TABLE_AGE_BUCKET_COUNT - 1)) && (Age >= 4))
+    {
+        Age >>= 2;
+        ++Result;
+    }
 
     return Result;
 }
@@ -106,6 +140,22 @@ static void UpdateGlyphCacheEntry(glyph_table *Table, uint32_t ID, uint32_t NewS
     Entry->DimY = NewDimY;
 }
 
+static int GetGlyphHashForGPUIndex(glyph_table *Table, gpu_glyph_index Index, glyph_hash *Hash)
+{
+    // NOTE: Entries were handed tiles in order, starting right after the reserved ones
+    glyph_cache_point Point = UnpackGlyphCachePoint(Index);
+    uint32_t Tile = Point.Y*Table->CacheTileCountInX + Point.X;
+
+    int Result = ((Tile >= Table->ReservedTileCount) &&
+                  ((Tile - Table->ReservedTileCount) < Table->EntryCount));
+    if(Result)
+    {
+        *Hash = GetEntry(Table, Tile - Table->ReservedTileCount)->HashValue;
+    }
+
+    return Result;
+}
+
 #if DEBUG_VALIDATE_LRU
 static void ValidateLRU(glyph_table *Table, int ExpectedCountChange)
 {
@@ -167,6 +217,7 @@ static void RecycleLRU(glyph_table *Table)
     UpdateGlyphCacheEntry(Table, EntryIndex, 0, 0, 0);
 
     ++Table->Stats.RecycleCount;
+    ++Table->Stats.EvictionAgeCounts[GetAgeBucket(Table->LookupCount - Entry->LastLookup)];
 }
 
 static uint32_t PopFreeEntry(glyph_table *Table)
@@ -200,12 +251,14 @@ static uint32_t PopFreeEntry(glyph_table *Table)
 static glyph_state FindGlyphEntryByHash(glyph_table *Table, glyph_hash RunHash)
 {
     glyph_entry *Result = 0;
+    size_t ProbeLength = 0;
 
     uint32_t *Slot = GetSlotPointer(Table, RunHash);
     uint32_t EntryIndex = *Slot;
     while(EntryIndex)
     {
         glyph_entry *Entry = GetEntry(Table, EntryIndex);
+        ++ProbeLength;
         if(GlyphHashesAreEqual(Entry->HashValue, RunHash))
         {
             Result = Entry;
@@ -215,6 +268,12 @@ static glyph_state FindGlyphEntryByHash(glyph_table *Table, glyph_hash RunHash)
         EntryIndex = Entry->NextWithSameHash;
     }
 
+    Table->Stats.ProbeCount += ProbeLength;
+    if(Table->Stats.MaxProbeLength < ProbeLength)
+    {
+        Table->Stats.MaxProbeLength = ProbeLength;
+    }
+
     if(Result)
     {
         Assert(EntryIndex);
@@ -263,6 +322,7 @@ static glyph_state FindGlyphEntryByHash(glyph_table *Table, glyph_hash RunHash)
 #if DEBUG_VALIDATE_LRU
     Result->Ordering = Sentinel->Ordering++;
 #endif
+    Result->LastLookup = Table->LookupCount++;
     ValidateLRU(Table, 1);
 
     glyph_state State;
@@ -332,6 +392,8 @@ static glyph_table *PlaceGlyphTableInMemory(glyph_table_params Params, void *Mem
         Result->HashMask = Params.HashCount - 1;
         Result->HashCount = Params.HashCount;
         Result->EntryCount = Params.EntryCount;
+        Result->ReservedTileCount = Params.ReservedTileCount;
+        Result->CacheTileCountInX = Params.CacheTileCountInX;
 
         memset(Result->HashTable, 0, Result->HashCount*sizeof(Result->HashTable[0]));
 
@@ -364,11 +426,56 @@ static glyph_table *PlaceGlyphTableInMemory(glyph_table_params Params, void *Mem
             Entry->FilledState = 0;
             Entry->DimX = 0;
             Entry->DimY = 0;
+            Entry->LastLookup = 0;
             
             ++X;
         }
 
-        GetAndClearStats(Result);
+        glyph_table_stats ZeroStats = {0};
+        Result->Stats = ZeroStats;
+        Result->LookupCount = 0;
+    }
+
+    return Result;
+}
+
+static glyph_table_census GetGlyphTableCensus(glyph_table *Table)
+{
+    glyph_table_census Result = {0};
+
+    for(uint32_t HashIndex = 0;
+        HashIndex < Table->HashCount;
+        ++HashIndex)
+    {
+        uint32_t ChainLength = 0;
+        for(uint32_t EntryIndex = Table->HashTable[HashIndex];
+            EntryIndex;
+            EntryIndex = GetEntry(Table, EntryIndex)->NextWithSameHash)
+        {
+            glyph_entry *Entry = GetEntry(Table, EntryIndex);
+            uint32_t State = Entry->FilledState;
+            if(State > (GLYPH_TABLE_STATE_BUCKET_COUNT - 1))
+            {
+                State = GLYPH_TABLE_STATE_BUCKET_COUNT - 1;
+            }
+            ++Result.StateCounts[State];
+            ++Result.UsedEntryCount;
+            ++ChainLength;
+        }
+
+        if(ChainLength > (GLYPH_TABLE_CHAIN_BUCKET_COUNT - 1))
+        {
+            ChainLength = GLYPH_TABLE_CHAIN_BUCKET_COUNT - 1;
+        }
+        ++Result.ChainLengthCounts[ChainLength];
+    }
+
+    // NOTE: The sentinel heads the free list but is never on it
+    for(uint32_t EntryIndex = GetSentinel(Table)->NextWithSameHash;
+        EntryIndex;
+        EntryIndex = GetEntry(Table, EntryIndex)->NextWithSameHash)
+    {
+        ++Result.FreeEntryCount;
     }
 
     return Result;
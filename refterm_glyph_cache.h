@@ -27,6 +27,7 @@ typedef struct glyph_hash glyph_hash;
 typedef struct glyph_cache_point glyph_cache_point;
 typedef struct gpu_glyph_index gpu_glyph_index;
 typedef struct glyph_table_stats glyph_table_stats;
+typedef struct glyph_table_census glyph_table_census;
 typedef struct glyph_state glyph_state;
 
 // NOTE(Casey): "Opaque" types used for the internals:
@@ -152,18 +153,59 @@ static glyph_state FindGlyphEntryByHash(glyph_table *Table, glyph_hash RunHash);
 */
 static void UpdateGlyphCacheEntry(glyph_table *Table, uint32_t ID, uint32_t NewState, uint16_t NewDimX, uint16_t NewDimY);
 
+/* NOTE:
+
+   GetGlyphHashForGPUIndex goes the other way, from a spot in the cache texture back to the hash
+   of whatever is cached there.  GPU indexes depend on the order glyphs happened to come into the
+   cache, but hashes don't, so this is how to compare what two runs put on screen.  It returns 0
+   for reserved tiles, which are already the same from run to run, and for indexes outside the table.
+*/
+static int GetGlyphHashForGPUIndex(glyph_table *Table, gpu_glyph_index Index, glyph_hash *Hash);
+
 /* NOTE(casey):
 
-   The table keeps some simple internal stats.  The values are zeroed after every GetAndClearStats,
-   so the count is the total number since the last time the stats were retrieved.
+   The table keeps some simple internal stats.  They accumulate for the life of the table and are
+   never cleared, so any number of callers can each keep their own old copy from GetGlyphTableStats
+   and DiffGlyphTableStats against it to find out what happened in between, without stepping on
+   each other.  MaxProbeLength is a high-water mark, so a diff just passes the newer one through.
    
-   TODO(casey): This may be a mistake.  Perhaps the stats should just accumulate ad infinitum,
-   and people can diff vs. their old stats to find out the change?
+   Lookup ages are counted in lookups (hits plus misses), so an EvictionAgeCounts bucket says how
+   many lookups went by between the last use of an entry and its recycling.  Bucket i holds ages
+   below 4^(i+1), and the last bucket holds everything older than that.  Lots of evictions in the
+   low buckets means the table is too small for the working set and is thrashing.
 */
+#define GLYPH_TABLE_AGE_BUCKET_COUNT 8
 struct glyph_table_stats
 {
     size_t HitCount; // NOTE(casey): Number of times FindGlyphEntryByHash hit the cache
     size_t MissCount; // NOTE(casey): Number of times FindGlyphEntryByHash misses the cache
     size_t RecycleCount;  // NOTE(casey): Number of times an entry had to be recycled to fill a cache miss
+    
+    size_t ProbeCount; // NOTE: Number of entries FindGlyphEntryByHash compared against, over all lookups
+    size_t MaxProbeLength; // NOTE: Most entries any single lookup compared against
+    size_t EvictionAgeCounts[GLYPH_TABLE_AGE_BUCKET_COUNT]; // NOTE: Recycles, by the age of what was recycled
+};
+static glyph_table_stats GetGlyphTableStats(glyph_table *Table);
+static glyph_table_stats DiffGlyphTableStats(glyph_table_stats New, glyph_table_stats Old);
+
+/* NOTE:
+
+   Unlike the stats, the census is not kept as the table runs.  GetGlyphTableCensus walks every
+   hash chain and entry to build it, so it costs time proportional to HashCount + EntryCount, and
+   is meant for occasional diagnostics rather than every frame.
+   
+   ChainLengthCounts[n] is the number of hash slots whose chain is n entries long, with the last
+   bucket holding every longer chain too.  StateCounts[n] is the number of entries in use whose
+   FilledState is n (again with the last bucket holding everything larger), so with states like
+   None/Sized/Rasterized you can see how many glyphs were sized but never drawn.
+*/
+#define GLYPH_TABLE_CHAIN_BUCKET_COUNT 8
+#define GLYPH_TABLE_STATE_BUCKET_COUNT 4
+struct glyph_table_census
+{
+    uint32_t UsedEntryCount;
+    uint32_t FreeEntryCount;
+    uint32_t ChainLengthCounts[GLYPH_TABLE_CHAIN_BUCKET_COUNT];
+    uint32_t StateCounts[GLYPH_TABLE_STATE_BUCKET_COUNT];
 };
-static glyph_table_stats GetAndClearStats(glyph_table *Table);
+static glyph_table_census GetGlyphTableCensus(glyph_table *Table);
@@ -1,8 +1,10 @@
 #define _CRT_SECURE_NO_WARNINGS 1
 #include <stdio.h>
 #include <time.h>
+#include <string.h>
 
 #include "fast_pipe.h"
+#include "fast_ring.h"
 
 int main(int ArgCount, char **Args)
 {
@@ -16,6 +18,7 @@ int main(int ArgCount, char **Args)
     }
 #endif
     
+    fast_ring Ring = {0};
     size_t TotalTransfer = 0;
     size_t BufferSize = 64*1024*1024;
     char *Buffer = (char *)malloc(BufferSize);
@@ -26,6 +29,17 @@ int main(int ArgCount, char **Args)
             ++ArgIndex)
         {
             char *FileName = Args[ArgIndex];
+            if(strcmp(FileName, "-ring") == 0)
+            {
+                // NOTE: Files after this go through the fast ring, if the terminal made one
+                Ring = OPEN_FAST_RING_IF_AVAILABLE();
+                if(!Ring.Header)
+                {
+                    fprintf(stderr, "Fast ring not available - writing to stdout instead.\n");
+                }
+                continue;
+            }
+
             FILE *File = fopen(FileName, "rb");
             if(File)
             {
@@ -33,13 +47,29 @@ int main(int ArgCount, char **Args)
                 while(size_t ByteCount = fread(Buffer, 1, BufferSize, File))
                 {
                     TotalTransfer += ByteCount;
-                    fwrite(Buffer, 1, ByteCount, stdout);
+                    if(Ring.Header)
+                    {
+                        FastRingWrite(&Ring, Buffer, ByteCount);
+                    }
+                    else
+                    {
+                        fwrite(Buffer, 1, ByteCount, stdout);
+                    }
                 }
                 clock_t End = clock();
                 
                 double Elapsed = (double)(End - Start) / (double)CLOCKS_PER_SEC;
-                fprintf(stdout, "\n\nTotal sink time: %.03fs (%fgb/s)\n", 
-                        Elapsed, TotalTransfer / (1024.0*1024.0*1024.0*Elapsed));
+                char Summary[256];
+                int SummaryLength = sprintf(Summary, "\n\nTotal sink time: %.03fs (%fgb/s)\n", 
+                                            Elapsed, TotalTransfer / (1024.0*1024.0*1024.0*Elapsed));
+                if(Ring.Header)
+                {
+                    FastRingWrite(&Ring, Summary, SummaryLength);
+                }
+                else
+                {
+                    fwrite(Summary, 1, SummaryLength, stdout);
+                }
                 
                 fclose(File);
             }
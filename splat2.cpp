@@ -4,6 +4,7 @@
 #include <windows.h>
 
 #include "fast_pipe.h"
+#include "fast_ring.h"
 
 int main(int ArgCount, char **Args)
 {
@@ -19,6 +20,7 @@ int main(int ArgCount, char **Args)
 
     HANDLE StdOut = GetStdHandle(STD_OUTPUT_HANDLE);
 
+    fast_ring Ring = {0};
     int VTEnabled = 0;
     double Elapsed = 0.0;
     size_t TotalTransfer = 0;
@@ -45,8 +47,15 @@ int main(int ArgCount, char **Args)
                 clock_t Start = clock();
                 while(TotalTransfer < 1024*1024*1024)
                 {
-                    DWORD ByteCount = 0;
-                    WriteFile(StdOut, Buffer, (DWORD)BufferSize, &ByteCount, 0);
+                    DWORD ByteCount = (DWORD)BufferSize;
+                    if(Ring.Header)
+                    {
+                        FastRingWrite(&Ring, Buffer, BufferSize);
+                    }
+                    else
+                    {
+                        WriteFile(StdOut, Buffer, (DWORD)BufferSize, &ByteCount, 0);
+                    }
                     TotalTransfer += ByteCount;
                 }
                 clock_t End = clock();
@@ -65,6 +74,15 @@ int main(int ArgCount, char **Args)
 #endif
                 VTEnabled = 1;
             }
+            else if(strcmp(Args[ArgIndex], "-ring") == 0)
+            {
+                // NOTE: Everything after this goes through the fast ring, if the terminal made one
+                Ring = OPEN_FAST_RING_IF_AVAILABLE();
+                if(!Ring.Header)
+                {
+                    fprintf(stderr, "Fast ring not available - writing to stdout instead.\n");
+                }
+            }
             else
             {
                 char *FileName = Args[ArgIndex];
@@ -76,7 +94,14 @@ int main(int ArgCount, char **Args)
                     DWORD ByteCount = 0;
                     while(ReadFile(File, Buffer, (DWORD)BufferSize, &ByteCount, 0) && ByteCount)
                     {
-                        WriteFile(StdOut, Buffer, (DWORD)ByteCount, &ByteCount, 0);
+                        if(Ring.Header)
+                        {
+                            FastRingWrite(&Ring, Buffer, ByteCount);
+                        }
+                        else
+                        {
+                            WriteFile(StdOut, Buffer, (DWORD)ByteCount, &ByteCount, 0);
+                        }
                         TotalTransfer += ByteCount;
                     }
                     clock_t End = clock();
@@ -91,17 +116,24 @@ int main(int ArgCount, char **Args)
             }
         }
         
-        if(VTEnabled)
-        {
-            fprintf(stdout, "\x1b[0m");
-        }
-        
         double GBs = 0;
         if(Elapsed)
         {
             GBs = TotalTransfer / (1024.0*1024.0*1024.0*Elapsed);
         }
-        fprintf(stdout, "\n\nTotal sink time: %.03fs (%fgb/s)\n", Elapsed, GBs);
+
+        // NOTE: The summary has to go the same way as the output, or it can overtake it
+        char Summary[256];
+        int SummaryLength = sprintf(Summary, "%s\n\nTotal sink time: %.03fs (%fgb/s)\n",
+                                    VTEnabled ? "\x1b[0m" : "", Elapsed, GBs);
+        if(Ring.Header)
+        {
+            FastRingWrite(&Ring, Summary, SummaryLength);
+        }
+        else
+        {
+            fwrite(Summary, 1, SummaryLength, stdout);
+        }
 
         free(Buffer);
     }